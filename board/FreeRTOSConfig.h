@@ -19,13 +19,43 @@
 #define configTICK_RATE_HZ			  ((TickType_t)1000)
 #define configMAX_PRIORITIES		  (5)
 #define configMINIMAL_STACK_SIZE	  ((unsigned short)128)
-#define configTOTAL_HEAP_SIZE		  ((size_t)(14 * 1024))
 #define configMAX_TASK_NAME_LEN		  (16)
-#define configUSE_TRACE_FACILITY	  0
+#define configUSE_TRACE_FACILITY	  1
 #define configUSE_16_BIT_TICKS		  0
 #define configIDLE_SHOULD_YIELD		  1
 #define configUSE_MUTEXES             1
 
+/* all kernel objects are statically allocated, there is no heap */
+#define configSUPPORT_STATIC_ALLOCATION   1
+#define configSUPPORT_DYNAMIC_ALLOCATION  0
+
+/* tickless idle, core sleeps (wfi) until next timer deadline or any 
+   interrupt */
+#define configUSE_TICKLESS_IDLE               1
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP (2)
+extern void power_pre_sleep(unsigned long idle);
+extern void power_post_sleep(unsigned long idle);
+#define configPRE_SLEEP_PROCESSING(x)         power_pre_sleep(x)
+#define configPOST_SLEEP_PROCESSING(x)        power_post_sleep(x)
+
+/* software timers, periodic jobs run in timer service task */
+#define configUSE_TIMERS              1
+#define configTIMER_TASK_PRIORITY     (2)
+#define configTIMER_QUEUE_LENGTH      (8)
+#define configTIMER_TASK_STACK_DEPTH  (configMINIMAL_STACK_SIZE * 2)
+/* interrupts defer work to timer service task */
+#define INCLUDE_xTimerPendFunctionCall  1
+/* timer callbacks are told apart from tasks by daemon handle */
+#define INCLUDE_xTimerGetTimerDaemonTaskHandle  1
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+
+/* run time statistics, counter is driven by TIM2 */
+#define configGENERATE_RUN_TIME_STATS 1
+extern void runstats_timer_init(void);
+extern unsigned long runstats_timer_value(void);
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()  runstats_timer_init()
+#define portGET_RUN_TIME_COUNTER_VALUE()          runstats_timer_value()
+
 
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES 		0
@@ -38,7 +68,7 @@ to exclude the API function. */
 #define INCLUDE_uxTaskPriorityGet		        0
 #define INCLUDE_vTaskDelete				        1
 #define INCLUDE_vTaskCleanUpResources	        0
-#define INCLUDE_vTaskSuspend			        0
+#define INCLUDE_vTaskSuspend			        1
 #define INCLUDE_vTaskDelayUntil			        0
 #define INCLUDE_vTaskDelay				        1
 #define INCLUDE_uxTaskGetStackHighWaterMark     1
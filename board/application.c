@@ -23,13 +23,28 @@
 #include "license.h"
 #include "modeswitch.h"
 #include "flash.h"
+#include "ota.h"
+#include "runstats.h"
+#include "capture.h"
+#include "netif.h"
+#include "connmgr.h"
+#include "sysinit.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[init]"
 
 
 #define DEFAULT_TIMEOUT      (3000 / portTICK_PERIOD_MS)
-#define VERSION  ("v1.0.2.5_alpha")
+
+/* init task storage, shared by system and test init task */
+static StackType_t xInitStack[INIT_SYSTEM_STACK_SIZE];
+static StaticTask_t xInitTaskBuffer;
+
+/* kernel idle and timer task storage */
+static StackType_t xIdleStack[configMINIMAL_STACK_SIZE];
+static StaticTask_t xIdleTaskBuffer;
+static StackType_t xTimerStack[configTIMER_TASK_STACK_DEPTH];
+static StaticTask_t xTimerTaskBuffer;
 
 /**
  * @brief initialize esp8266 module
@@ -46,28 +61,18 @@ static bool init_esp8266(void)
     {
         return FALSE;
     }
-    
-    if (ESP_ERR_OK != esp8266_send_ok("AT+CIPMUX=1\r\n"))
+
+    if (ESP_ERR_OK != esp8266_negotiate_baud())
     {
         return FALSE;
     }
     
-    if (flash_first_start())
-    {
-        TRACE("first start\r\n");
-        return http_init();
-    }
-    else
+    if (ESP_ERR_OK != esp8266_send_ok("AT+CIPMUX=1\r\n"))
     {
-        if (mqtt_init())
-        {
-            return wifi_init();
-        }
-        else
-        {
-            return FALSE;
-        }
+        return FALSE;
     }
+    
+    return TRUE;
 }
 
 /**
@@ -98,8 +103,15 @@ static bool init_m26()
     {
         return FALSE;
     }
+
+    if (M26_ERR_OK != m26_negotiate_baud())
+    {
+        return FALSE;
+    }
     
-    if (M26_ERR_OK != m26_send_ok("AT+QIHEAD=1\r\n", DEFAULT_TIMEOUT))
+    /* multiple connection mode, received data head is 
+     * "+RECEIVE: <id>, <length>" */
+    if (M26_ERR_OK != m26_send_ok("AT+QIMUX=1\r\n", DEFAULT_TIMEOUT))
     {
         return FALSE;
     }
@@ -113,49 +125,141 @@ static bool init_m26()
     {
         return FALSE;
     }
-    
-    mqtt_init();
-    wifi_init();
+
+    /* unsolicited result only reports changes, query current state */
+    if (M26_ERR_OK != m26_send_ok("AT+CGREG?\r\n", DEFAULT_TIMEOUT))
+    {
+        return FALSE;
+    }
 
     return TRUE;
 }
 
 /**
- * @brief network initialize task
- * @param pvParameter - task parameter
+ * @brief load configuration, ota state and start capture
+ * @return initialize status
+ */
+static bool init_storage(void)
+{
+    bool ret = flash_init();
+    ota_init();
+    capture_init();
+    return ret;
+}
+
+/**
+ * @brief initialize local peripherals
+ * @return initialize status
  */
-static void vInitNetwork(void *pvParameters)
+static bool init_board(void)
+{
+    led_motor_init();
+    led_net_init();
+    ir_init();
+    motor_init();
+    modeswitch_init();
+    runstats_init();
+    return TRUE;
+}
+
+/**
+ * @brief initialize network interface and link manager
+ * @return initialize status
+ */
+static bool init_netif(void)
 {
     TRACE("initialize network...\r\n");
-    
-    if (MODE_NET_WIFI == mode_net())
+    /* network switch selects preferred link, the other one is backup */
+    connmgr_init((MODE_NET_WIFI == mode_net()) ? LINK_WIFI : LINK_GPRS);
+    return netif_init();
+}
+
+/**
+ * @brief initialize m26 module, not needed while wifi is provisioned
+ * @return initialize status
+ */
+static bool init_gprs(void)
+{
+    if (flash_first_start())
     {
-        if (!init_esp8266())
+        TRACE("first start, skip m26\r\n");
+        return FALSE;
+    }
+
+    return init_m26();
+}
+
+/* init steps, index is used in dependencies */
+enum
+{
+    STEP_STORAGE,
+    STEP_BOARD,
+    STEP_NETIF,
+    STEP_WIFI,
+    STEP_GPRS,
+    STEP_NETWORK,
+    STEP_NUM,
+};
+
+/**
+ * @brief start provisioning server or network services on modules that
+ *        came up
+ * @return initialize status
+ */
+static bool init_network(void)
+{
+    if (sysinit_ok(STEP_WIFI))
+    {
+        connmgr_add(LINK_WIFI, &esp8266_netif);
+        if (flash_first_start())
         {
-            TRACE("initialize network failed\r\n");
-            led_net_set_action("LED_ERROR", on);
+            TRACE("first start\r\n");
+            if (!http_init())
+            {
+                led_net_set_action("LED_ERROR", on);
+                return FALSE;
+            }
+            return TRUE;
         }
     }
     else
     {
-        if (!init_m26())
-        {
-            TRACE("initialize network failed\r\n");
-            led_net_set_action("LED_ERROR", on);
-        }
+        TRACE("initialize esp8266 failed\r\n");
     }
-    
-    vTaskDelete(NULL);
+
+    if (sysinit_ok(STEP_GPRS))
+    {
+        connmgr_add(LINK_GPRS, &m26_netif);
+    }
+    else
+    {
+        TRACE("initialize m26 failed\r\n");
+    }
+
+    if ((!connmgr_has(LINK_WIFI) && !connmgr_has(LINK_GPRS)) ||
+        !mqtt_init() || !wifi_init())
+    {
+        TRACE("initialize network failed\r\n");
+        led_net_set_action("LED_ERROR", on);
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
-/**
- * @brief initialize network
- */
-static __INLINE void network_init(void)
+/* modules power up in parallel with local init, network services wait 
+ * for everything */
+static const init_step init_steps[STEP_NUM] =
 {
-    xTaskCreate(vInitNetwork, "Init", INIT_NETWORK_STACK_SIZE, NULL, 
-                INIT_NETWORK_PRIORITY, NULL);
-}
+    {"storage", init_storage, 0},
+    {"board", init_board, SYSINIT_STEP(STEP_STORAGE)},
+    {"netif", init_netif, 0},
+    {"esp8266", init_esp8266, 0},
+    {"m26", init_gprs, SYSINIT_STEP(STEP_STORAGE)},
+    {"network", init_network, SYSINIT_STEP(STEP_STORAGE) | 
+     SYSINIT_STEP(STEP_BOARD) | SYSINIT_STEP(STEP_NETIF) | 
+     SYSINIT_STEP(STEP_WIFI) | SYSINIT_STEP(STEP_GPRS)},
+};
 
 /**
  * @brief initialize system
@@ -165,12 +269,10 @@ static void vInitSystem(void *pvParameters)
 {
     TRACE("startup application...\r\n");
     TRACE("version = %s\r\n", VERSION);
-    led_motor_init();
-    led_net_init();
-    ir_init();
-    motor_init();
-    network_init();
-    modeswitch_init();
+    if (!sysinit_run(init_steps, STEP_NUM))
+    {
+        TRACE("initialize incomplete\r\n");
+    }
     
     vTaskDelete(NULL);
 }
@@ -195,15 +297,40 @@ void ApplicationStartup()
     license_init();
     if (MODE_WORK_NORMAL == mode_work())
     {
-        xTaskCreate(vInitSystem, "Init", INIT_SYSTEM_STACK_SIZE, NULL, 
-                    INIT_SYSTEM_PRIORITY, NULL);
+        xTaskCreateStatic(vInitSystem, "Init", INIT_SYSTEM_STACK_SIZE, NULL, 
+                          INIT_SYSTEM_PRIORITY, xInitStack, &xInitTaskBuffer);
     }
     else
     {
-        xTaskCreate(vTestSystem, "Test", INIT_SYSTEM_STACK_SIZE, NULL, 
-                    INIT_SYSTEM_PRIORITY, NULL);
+        xTaskCreateStatic(vTestSystem, "Test", INIT_SYSTEM_STACK_SIZE, NULL, 
+                          INIT_SYSTEM_PRIORITY, xInitStack, &xInitTaskBuffer);
     }
     
     /* Start the scheduler. */
     vTaskStartScheduler();
 }
+
+/**
+ * @brief provide idle task memory, kernel is built without dynamic 
+ *        allocation
+ */
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer,
+                                   StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize)
+{
+    *ppxIdleTaskTCBBuffer = &xIdleTaskBuffer;
+    *ppxIdleTaskStackBuffer = xIdleStack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/**
+ * @brief provide timer service task memory
+ */
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer,
+                                    StackType_t **ppxTimerTaskStackBuffer,
+                                    uint32_t *pulTimerTaskStackSize)
+{
+    *ppxTimerTaskTCBBuffer = &xTimerTaskBuffer;
+    *ppxTimerTaskStackBuffer = xTimerStack;
+    *pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
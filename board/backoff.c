@@ -0,0 +1,100 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "FreeRTOS.h"
+#include "task.h"
+#include "backoff.h"
+
+/* random state, machines must not retry in lock step */
+static uint32_t g_random = 0x2545f491;
+
+/**
+ * @brief set random seed, use something unique to machine
+ * @param seed - random seed
+ */
+void backoff_seed(uint32_t seed)
+{
+    if (0 != seed)
+    {
+        g_random = seed;
+    }
+}
+
+/**
+ * @brief xorshift random number
+ * @return random number
+ */
+static uint32_t next_random(void)
+{
+    g_random ^= g_random << 13;
+    g_random ^= g_random >> 17;
+    g_random ^= g_random << 5;
+    return g_random;
+}
+
+/**
+ * @brief initialize backoff, first attempt is due now
+ * @param bo - backoff
+ * @param base - first retry delay
+ * @param max - max retry delay
+ */
+void backoff_init(backoff *bo, TickType_t base, TickType_t max)
+{
+    assert_param(NULL != bo);
+    assert_param((base > 0) && (base <= max));
+    bo->base = base;
+    bo->max = max;
+    backoff_reset(bo);
+}
+
+/**
+ * @brief reset backoff after success
+ * @param bo - backoff
+ */
+void backoff_reset(backoff *bo)
+{
+    bo->attempts = 0;
+    bo->next = xTaskGetTickCount();
+}
+
+/**
+ * @brief schedule next attempt after failure, delay doubles each failure 
+ *        up to max, and a random half of it is dropped
+ * @param bo - backoff
+ * @return delay to next attempt
+ */
+TickType_t backoff_fail(backoff *bo)
+{
+    TickType_t delay = bo->base;
+    for (uint8_t i = 0; (i < bo->attempts) && (delay < bo->max); ++i)
+    {
+        delay <<= 1;
+    }
+    if (delay > bo->max)
+    {
+        delay = bo->max;
+    }
+
+    if (bo->attempts < 0xff)
+    {
+        bo->attempts ++;
+    }
+    
+    delay = delay / 2 + next_random() % (delay / 2 + 1);
+    bo->next = xTaskGetTickCount() + delay;
+    return delay;
+}
+
+/**
+ * @brief check next attempt is due
+ * @param bo - backoff
+ * @return TRUE: attempt now
+ */
+bool backoff_due(const backoff *bo)
+{
+    return (int32_t)(xTaskGetTickCount() - bo->next) >= 0;
+}
@@ -0,0 +1,32 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _BACKOFF_H_
+  #define _BACKOFF_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* jittered exponential backoff */
+typedef struct
+{
+    TickType_t base;
+    TickType_t max;
+    TickType_t next;
+    uint8_t attempts;
+}backoff;
+
+void backoff_seed(uint32_t seed);
+void backoff_init(backoff *bo, TickType_t base, TickType_t max);
+void backoff_reset(backoff *bo);
+TickType_t backoff_fail(backoff *bo);
+bool backoff_due(const backoff *bo);
+
+END_DECLS
+
+#endif /* _BACKOFF_H_ */
@@ -11,11 +11,14 @@
 #include "stm32f10x_cfg.h"
 #include "pinconfig.h"
 #include "dbgserial.h"
+#include "serial.h"
 #include "trace.h"
+#include "flash_map.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE   "[board]"
 
+static void vector_init(void);
 static void clock_init(void);
 
 /* init function */
@@ -24,9 +27,11 @@ typedef void (*init_fuc)(void);
 /* init sequence */
 init_fuc init_sequence[] = 
 {
+    vector_init,
     clock_init,
     pin_init,
     dbg_serial_setup,
+    serial_init,
 };
 
 /**
@@ -45,6 +50,17 @@ void board_init(void)
     return;
 }
 
+/**
+ * @brief application starts after bootloader, use its own vector table
+ */
+static void vector_init(void)
+{
+    VectTable table;
+    table.offsetAddr = (FLASH_APP_ADDR >> 9);
+    table.place = CODE;
+    SCB_SetVectTableConfig(table);
+}
+
 /**
  * @brief board clock init
  */
@@ -0,0 +1,263 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <stdio.h>
+#include "capture.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "trace.h"
+#include "global.h"
+#include "dbgserial.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[capture]"
+
+/**
+ * Serial traffic is copied into a ring buffer as records
+ *     tick(4) | port << 4 | dir (1) | len(1) | data[len]
+ * Bytes of the same port and direction within CAPTURE_GAP ticks are 
+ * appended to the open record. Writers never block, when the buffer is
+ * full the bytes are dropped and counted. A low priority task drains the
+ * records to the debug port.
+ */
+
+/* ring buffer size, must be power of 2 */
+#define CAPTURE_BUF_SIZE       (512)
+#define CAPTURE_BUF_MASK       (CAPTURE_BUF_SIZE - 1)
+#define CAPTURE_HEAD_SIZE      (6)
+#define CAPTURE_MAX_RECORD     (255)
+#define CAPTURE_GAP            (10 / portTICK_PERIOD_MS)
+#define CAPTURE_DRAIN_PERIOD   (50 / portTICK_PERIOD_MS)
+#define CAPTURE_NO_RECORD      (0xffff)
+
+#ifdef __DEBUG
+#define CAPTURE_DEFAULT_LEVEL  CAPTURE_ALL
+#else
+#define CAPTURE_DEFAULT_LEVEL  CAPTURE_OFF
+#endif
+
+static uint8_t g_buf[CAPTURE_BUF_SIZE];
+static uint16_t g_head = 0;
+static uint16_t g_tail = 0;
+static volatile uint8_t g_level = CAPTURE_DEFAULT_LEVEL;
+static uint32_t g_dropped = 0;
+
+/* open record */
+static uint16_t g_open = CAPTURE_NO_RECORD;
+static uint8_t g_open_flag = 0;
+static TickType_t g_open_tick = 0;
+
+/* drain task */
+static TaskHandle_t xCaptureTask = NULL;
+static StackType_t xCaptureStack[CAPTURE_STACK_SIZE];
+static StaticTask_t xCaptureTaskBuffer;
+
+/**
+ * @brief put byte to ring buffer
+ * @param data - data to put
+ */
+static __INLINE void put_byte(uint8_t data)
+{
+    g_buf[g_head & CAPTURE_BUF_MASK] = data;
+    g_head ++;
+}
+
+/**
+ * @brief get byte from ring buffer
+ * @param pos - byte position
+ * @return byte
+ */
+static __INLINE uint8_t get_byte(uint16_t pos)
+{
+    return g_buf[pos & CAPTURE_BUF_MASK];
+}
+
+/**
+ * @brief write serial traffic to capture buffer, never blocks
+ * @param port - serial port
+ * @param dir - CAPTURE_RX or CAPTURE_TX
+ * @param data - traffic data
+ * @param len - data length
+ */
+void capture_write(uint8_t port, uint8_t dir, const char *data, uint32_t len)
+{
+    if (0 == (g_level & dir))
+    {
+        return ;
+    }
+
+    uint8_t flag = (uint8_t)((port << 4) | dir);
+    TickType_t tick = xTaskGetTickCount();
+    
+    taskENTER_CRITICAL();
+    while (len > 0)
+    {
+        uint16_t free = CAPTURE_BUF_SIZE - (uint16_t)(g_head - g_tail);
+        if ((CAPTURE_NO_RECORD != g_open) && (g_open_flag == flag) &&
+            (get_byte(g_open) < CAPTURE_MAX_RECORD) && 
+            ((tick - g_open_tick) < CAPTURE_GAP) && (free > 0))
+        {
+            g_buf[g_open & CAPTURE_BUF_MASK] ++;
+            put_byte(*data++);
+            len --;
+        }
+        else if (free > CAPTURE_HEAD_SIZE)
+        {
+            put_byte((uint8_t)(tick & 0xff));
+            put_byte((uint8_t)((tick >> 8) & 0xff));
+            put_byte((uint8_t)((tick >> 16) & 0xff));
+            put_byte((uint8_t)((tick >> 24) & 0xff));
+            put_byte(flag);
+            g_open = g_head;
+            g_open_flag = flag;
+            g_open_tick = tick;
+            put_byte(0);
+        }
+        else
+        {
+            /* buffer full, drop and start new record later */
+            g_dropped += len;
+            g_open = CAPTURE_NO_RECORD;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief output one captured byte, unprintable byte is shown as hex
+ * @param data - byte to output
+ */
+static void output_byte(uint8_t data)
+{
+    if (((data >= 0x20) && (data < 0x7f)) || ('\r' == data) || 
+        ('\n' == data))
+    {
+        dbg_putchar(data);
+    }
+    else
+    {
+        char hex[5];
+        sprintf(hex, "\\x%02x", data);
+        dbg_putstring(hex, 4);
+    }
+}
+
+/**
+ * @brief drain one record to debug port
+ * @return TRUE: record drained FALSE: no record
+ */
+static bool drain_record(void)
+{
+    char head[40];
+    int cnt = 0;
+    uint16_t pos = 0;
+    uint8_t len = 0;
+    uint32_t tick = 0;
+    uint8_t flag = 0;
+    uint32_t dropped = 0;
+    
+    taskENTER_CRITICAL();
+    if (g_head == g_tail)
+    {
+        taskEXIT_CRITICAL();
+        return FALSE;
+    }
+    pos = g_tail;
+    /* close record, so its length can't change while reading */
+    if ((uint16_t)(pos + CAPTURE_HEAD_SIZE - 1) == g_open)
+    {
+        g_open = CAPTURE_NO_RECORD;
+    }
+    dropped = g_dropped;
+    g_dropped = 0;
+    taskEXIT_CRITICAL();
+
+    for (int i = 0; i < 4; ++i)
+    {
+        tick |= ((uint32_t)get_byte(pos++) << (i * 8));
+    }
+    flag = get_byte(pos++);
+    len = get_byte(pos++);
+
+    dbg_lock();
+    if (dropped > 0)
+    {
+        cnt = sprintf(head, "\r\n[cap] dropped %d bytes", (int)dropped);
+        dbg_putstring(head, cnt);
+    }
+    cnt = sprintf(head, "\r\n[cap %d.%03d COM%d %s] ", (int)(tick / 1000), 
+                  (int)(tick % 1000), (flag >> 4) + 1, 
+                  (flag & CAPTURE_RX) ? "rx" : "tx");
+    dbg_putstring(head, cnt);
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        output_byte(get_byte(pos++));
+    }
+    dbg_unlock();
+
+    taskENTER_CRITICAL();
+    g_tail = pos;
+    taskEXIT_CRITICAL();
+
+    return TRUE;
+}
+
+/**
+ * @brief capture drain task
+ * @param pvParameters - task parameter
+ */
+static void vCapture(void *pvParameters)
+{
+    for (;;)
+    {
+        if (CAPTURE_OFF == g_level)
+        {
+            /* wait until capture is turned on */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        
+        while (drain_record());
+        vTaskDelay(CAPTURE_DRAIN_PERIOD);
+    }
+}
+
+/**
+ * @brief set capture level
+ * @param level - CAPTURE_OFF, CAPTURE_RX, CAPTURE_TX or CAPTURE_ALL
+ */
+void capture_set_level(uint8_t level)
+{
+    assert_param(level <= CAPTURE_ALL);
+    TRACE("set capture level: %d\r\n", level);
+    g_level = level;
+    if ((CAPTURE_OFF != level) && (NULL != xCaptureTask))
+    {
+        xTaskNotifyGive(xCaptureTask);
+    }
+}
+
+/**
+ * @brief get capture level
+ * @return capture level
+ */
+uint8_t capture_get_level(void)
+{
+    return g_level;
+}
+
+/**
+ * @brief initialize traffic capture
+ */
+void capture_init(void)
+{
+    TRACE("initialize capture...\r\n");
+    xCaptureTask = xTaskCreateStatic(vCapture, "capture", CAPTURE_STACK_SIZE,
+                                     NULL, CAPTURE_PRIORITY, xCaptureStack, 
+                                     &xCaptureTaskBuffer);
+}
+
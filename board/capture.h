@@ -0,0 +1,30 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _CAPTURE_H_
+  #define _CAPTURE_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* capture level */
+#define CAPTURE_OFF        (0x00)
+#define CAPTURE_RX         (0x01)
+#define CAPTURE_TX         (0x02)
+#define CAPTURE_ALL        (CAPTURE_RX | CAPTURE_TX)
+
+void capture_init(void);
+void capture_set_level(uint8_t level);
+uint8_t capture_get_level(void);
+void capture_write(uint8_t port, uint8_t dir, const char *data, 
+                   uint32_t len);
+
+END_DECLS
+
+#endif /* _CAPTURE_H_ */
+
@@ -0,0 +1,55 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _CONFIG_H_
+  #define _CONFIG_H_
+
+/* machine configuration, buffers and tables are sized from here at
+ * compile time */
+
+/* machine geometry, motors sit on a row x column drive matrix, motor
+ * number is row * CONFIG_MOTOR_COLS + col */
+#define CONFIG_MOTOR_ROWS         (4)
+#define CONFIG_MOTOR_COLS         (4)
+#define CONFIG_MOTOR_NUM          (10)
+#define CONFIG_LED_NUM            (10)
+
+/* 1: drive lines and detect inputs are on spi1 shift register chains
+ * (74hc595 out, 74hc165 in) for large cabinets, 0: on mcu pins */
+#define CONFIG_MOTOR_EXPANDER     (0)
+
+#if CONFIG_MOTOR_NUM > CONFIG_MOTOR_ROWS * CONFIG_MOTOR_COLS
+#error "motor matrix is too small"
+#endif
+
+/* leds stay on this long after ir sensor sees nobody */
+#define CONFIG_IR_HOLD_MS         (10000)
+
+/* broker endpoint */
+#define CONFIG_BROKER_ADDRESS     "39.105.72.237"
+#define CONFIG_BROKER_PORT        (1883)
+
+/* machine id, chip unique id words in upper case hex */
+#define CONFIG_CHIPID_WORDS       (3)
+#define CONFIG_ID_LEN             (CONFIG_CHIPID_WORDS * 8)
+
+/* topic shared by all machines */
+#define CONFIG_TOPIC_REGISTER     "register"
+
+/* machine topics "<prefix>/<id>", X(name, prefix) */
+#define CONFIG_TOPICS(X) \
+    X(control, "controller") \
+    X(state, "state") \
+    X(stats, "stats") \
+    X(ota, "ota") \
+    X(ota_ack, "ota_ack") \
+    X(debug, "debug")
+
+/* machine topic length without terminator */
+#define CONFIG_TOPIC_LEN(prefix)  (sizeof(prefix) + CONFIG_ID_LEN)
+
+#endif /* _CONFIG_H_ */
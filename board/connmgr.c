@@ -0,0 +1,297 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "FreeRTOS.h"
+#include "task.h"
+#include "connmgr.h"
+#include "sysinit.h"
+#include "trace.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[connmgr]"
+
+/* round trip time before first ping(ms) */
+#define DEFAULT_RTT          (300)
+/* round trip time counted by score(ms) */
+#define MAX_RTT              (2000)
+/* score bonus of preferred link, wifi saves gprs data */
+#define PREFER_BONUS         (200)
+/* score lost per reconnect */
+#define RECONNECT_PENALTY    (100)
+/* other link must be better than this to switch */
+#define SWITCH_HYSTERESIS    (150)
+/* min time on a link before switch to a better one */
+#define MIN_DWELL            (120000 / portTICK_PERIOD_MS)
+/* down time of active link before switch */
+#define DOWN_GRACE           (15000 / portTICK_PERIOD_MS)
+/* reconnect count is halved every window */
+#define RECONNECT_WINDOW     (600000 / portTICK_PERIOD_MS)
+
+typedef struct
+{
+    const char *name;
+    const netif *nif;
+    bool up;
+    TickType_t down_time;
+    uint16_t rtt;
+    uint8_t loss;
+    uint8_t reconnects;
+}conn_link;
+
+static conn_link g_links[LINK_COUNT] = 
+{
+    {"wifi", NULL, FALSE, 0, DEFAULT_RTT, 0, 0},
+    {"gprs", NULL, FALSE, 0, DEFAULT_RTT, 0, 0},
+};
+
+static link_type g_prefer = LINK_WIFI;
+static link_type g_active = LINK_COUNT;
+static TickType_t g_switch_time = 0;
+static TickType_t g_window_time = 0;
+
+/* ping in flight */
+static bool g_ping_pending = FALSE;
+static TickType_t g_ping_time = 0;
+
+/**
+ * @brief initialize connection manager
+ * @param prefer - preferred link
+ */
+void connmgr_init(link_type prefer)
+{
+    assert_param(prefer < LINK_COUNT);
+    g_prefer = prefer;
+}
+
+/**
+ * @brief make link active, socket operations go to it
+ * @param type - link type
+ */
+static void activate(link_type type)
+{
+    g_active = type;
+    g_switch_time = xTaskGetTickCount();
+    g_ping_pending = FALSE;
+    netif_register(g_links[type].nif);
+}
+
+/**
+ * @brief add initialized link
+ * @param type - link type
+ * @param nif - link socket interface
+ */
+void connmgr_add(link_type type, const netif *nif)
+{
+    assert_param(type < LINK_COUNT);
+    assert_param(NULL != nif);
+    g_links[type].nif = nif;
+    if ((LINK_COUNT == g_active) || (g_prefer == type))
+    {
+        activate(type);
+    }
+}
+
+/**
+ * @brief check link is initialized
+ * @param type - link type
+ * @return TRUE: link is initialized
+ */
+bool connmgr_has(link_type type)
+{
+    return (type < LINK_COUNT) && (NULL != g_links[type].nif);
+}
+
+/**
+ * @brief get active link
+ * @return active link, LINK_COUNT if no link
+ */
+link_type connmgr_active(void)
+{
+    return g_active;
+}
+
+/**
+ * @brief check active link can reach network
+ * @return TRUE: ap connected or gprs attached
+ */
+bool connmgr_active_up(void)
+{
+    return (g_active < LINK_COUNT) && g_links[g_active].up;
+}
+
+/**
+ * @brief update link state
+ * @param type - link type
+ * @param up - TRUE: ap connected or gprs attached
+ */
+void connmgr_set_up(link_type type, bool up)
+{
+    assert_param(type < LINK_COUNT);
+    conn_link *link = &g_links[type];
+    if (link->up && !up)
+    {
+        link->down_time = xTaskGetTickCount();
+    }
+    else if (up)
+    {
+        sysinit_mark(BOOT_LINK);
+    }
+    link->up = up;
+}
+
+/**
+ * @brief ping request sent on active link
+ */
+void connmgr_ping_sent(void)
+{
+    if (g_active >= LINK_COUNT)
+    {
+        return;
+    }
+    
+    conn_link *link = &g_links[g_active];
+    uint8_t lost = g_ping_pending ? 100 : 0;
+    link->loss = (link->loss * 7 + lost) / 8;
+    g_ping_pending = TRUE;
+    g_ping_time = xTaskGetTickCount();
+}
+
+/**
+ * @brief ping response received on active link
+ */
+void connmgr_ping_resp(void)
+{
+    if ((g_active >= LINK_COUNT) || !g_ping_pending)
+    {
+        return;
+    }
+
+    conn_link *link = &g_links[g_active];
+    uint32_t rtt = (xTaskGetTickCount() - g_ping_time) * portTICK_PERIOD_MS;
+    if (rtt > MAX_RTT)
+    {
+        rtt = MAX_RTT;
+    }
+    link->rtt = (link->rtt * 7 + rtt) / 8;
+    link->loss = link->loss * 7 / 8;
+    g_ping_pending = FALSE;
+}
+
+/**
+ * @brief socket on active link reconnected
+ */
+void connmgr_reconnected(void)
+{
+    if ((g_active < LINK_COUNT) && (g_links[g_active].reconnects < 0xff))
+    {
+        g_links[g_active].reconnects ++;
+    }
+}
+
+/**
+ * @brief calculate link score, higher is better
+ * @param type - link type
+ * @return link score, negative if link can't be used
+ */
+static int16_t link_score(link_type type)
+{
+    const conn_link *link = &g_links[type];
+    if ((NULL == link->nif) || !link->up)
+    {
+        return -1;
+    }
+
+    int16_t score = 1000 - link->rtt / 4 - link->loss * 4 - 
+                    link->reconnects * RECONNECT_PENALTY;
+    if (g_prefer == type)
+    {
+        score += PREFER_BONUS;
+    }
+
+    return (score < 0) ? 0 : score;
+}
+
+/**
+ * @brief evaluate links and switch to the healthier one, call it 
+ *        periodically from the task which owns connections
+ * @return TRUE: active link changed, sockets on old link should be 
+ *         reconnected
+ */
+bool connmgr_evaluate(void)
+{
+    if (g_active >= LINK_COUNT)
+    {
+        return FALSE;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    if ((now - g_window_time) >= RECONNECT_WINDOW)
+    {
+        g_window_time = now;
+        for (int i = 0; i < LINK_COUNT; ++i)
+        {
+            g_links[i].reconnects /= 2;
+        }
+    }
+
+    link_type other = (LINK_WIFI == g_active) ? LINK_GPRS : LINK_WIFI;
+    int16_t active_score = link_score(g_active);
+    int16_t other_score = link_score(other);
+    if (other_score < 0)
+    {
+        return FALSE;
+    }
+
+    if (active_score < 0)
+    {
+        /* active link lost, wait a moment in case it comes back */
+        if (g_links[g_active].up || 
+            ((now - g_links[g_active].down_time) < DOWN_GRACE))
+        {
+            return FALSE;
+        }
+    }
+    else if ((other_score <= active_score + SWITCH_HYSTERESIS) ||
+             ((now - g_switch_time) < MIN_DWELL))
+    {
+        return FALSE;
+    }
+
+    TRACE("switch %s(%d) -> %s(%d)\r\n", g_links[g_active].name, 
+          active_score, g_links[other].name, other_score);
+    activate(other);
+    return TRUE;
+}
+
+/**
+ * @brief get link statistics
+ * @param stats - statistics buffer
+ * @param max - max links
+ * @return link count
+ */
+uint8_t connmgr_get_stats(link_stats *stats, uint8_t max)
+{
+    uint8_t count = 0;
+    for (int i = 0; (i < LINK_COUNT) && (count < max); ++i)
+    {
+        if (NULL == g_links[i].nif)
+        {
+            continue;
+        }
+        
+        stats[count].name = g_links[i].name;
+        stats[count].up = g_links[i].up;
+        stats[count].active = (g_active == i);
+        stats[count].rtt = g_links[i].rtt;
+        stats[count].loss = g_links[i].loss;
+        stats[count].reconnects = g_links[i].reconnects;
+        stats[count].score = link_score((link_type)i);
+        count ++;
+    }
+
+    return count;
+}
@@ -0,0 +1,53 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _CONNMGR_H_
+  #define _CONNMGR_H_
+
+#include "types.h"
+#include "netif.h"
+
+BEGIN_DECLS
+
+/* network link */
+typedef enum
+{
+    LINK_WIFI,
+    LINK_GPRS,
+    LINK_COUNT,
+}link_type;
+
+/* link statistics */
+typedef struct
+{
+    const char *name;
+    bool up;
+    bool active;
+    /* smoothed ping round trip time(ms) */
+    uint16_t rtt;
+    /* smoothed ping loss(%) */
+    uint8_t loss;
+    /* socket reconnects in recent window */
+    uint8_t reconnects;
+    int16_t score;
+}link_stats;
+
+void connmgr_init(link_type prefer);
+void connmgr_add(link_type type, const netif *nif);
+bool connmgr_has(link_type type);
+link_type connmgr_active(void);
+bool connmgr_active_up(void);
+void connmgr_set_up(link_type type, bool up);
+void connmgr_ping_sent(void);
+void connmgr_ping_resp(void);
+void connmgr_reconnected(void);
+bool connmgr_evaluate(void);
+uint8_t connmgr_get_stats(link_stats *stats, uint8_t max);
+
+END_DECLS
+
+#endif /* _CONNMGR_H_ */
@@ -0,0 +1,138 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "crc32.h"
+#include "assert.h"
+#ifndef __CRC_SOFTWARE
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cm3_core.h"
+#include "stm32f10x_cfg.h"
+#endif
+
+#define CRC32_INIT    (0xffffffff)
+
+/* nibble table for software crc, poly 0x04c11db7 msb first */
+static const uint32_t crc_table[16] = 
+{
+    0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9, 
+    0x130476dc, 0x17c56b6b, 0x1a864db2, 0x1e475005, 
+    0x2608edb8, 0x22c9f00f, 0x2f8ad6d6, 0x2b4bcb61, 
+    0x350c9b64, 0x31cd86d3, 0x3c8ea00a, 0x384fbdbd
+};
+
+/**
+ * @brief software crc for unaligned bytes
+ * @param crc - current crc
+ * @param data - data to calculate
+ * @param len - data length
+ * @return new crc
+ */
+static uint32_t crc_software(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    while (len--)
+    {
+        crc = (crc << 4) ^ crc_table[(crc >> 28) ^ (*data >> 4)];
+        crc = (crc << 4) ^ crc_table[(crc >> 28) ^ (*data & 0x0f)];
+        data ++;
+    }
+
+    return crc;
+}
+
+#ifndef __CRC_SOFTWARE
+/**
+ * @brief hardware crc for aligned words, crc unit can only be reset to
+ *        0xffffffff, current crc is folded into first word instead
+ * @param crc - current crc
+ * @param data - word aligned data
+ * @param count - word count
+ * @return new crc
+ */
+static uint32_t crc_hardware(uint32_t crc, const uint32_t *data, 
+                             uint32_t count)
+{
+    /* crc unit is shared, keep other tasks out */
+    vTaskSuspendAll();
+    CRC_ResetDR();
+    CRC_Cal(__REV(*data ++) ^ crc ^ CRC32_INIT);
+    while (--count)
+    {
+        CRC_Cal(__REV(*data ++));
+    }
+    crc = CRC_GetDR();
+    xTaskResumeAll();
+
+    return crc;
+}
+#endif
+
+/**
+ * @brief start new crc calculation
+ * @param ctx - crc context
+ */
+void crc32_init(crc32_ctx *ctx)
+{
+    assert_param(NULL != ctx);
+    ctx->crc = CRC32_INIT;
+}
+
+/**
+ * @brief add data to crc calculation, can be called many times
+ * @param ctx - crc context
+ * @param data - data to add
+ * @param len - data length
+ */
+void crc32_update(crc32_ctx *ctx, const void *data, uint32_t len)
+{
+    assert_param(NULL != ctx);
+    assert_param((NULL != data) || (0 == len));
+    const uint8_t *pdata = (const uint8_t *)data;
+#ifndef __CRC_SOFTWARE
+    uint32_t head = (4 - ((uint32_t)pdata & 0x03)) & 0x03;
+    if (head > len)
+    {
+        head = len;
+    }
+    ctx->crc = crc_software(ctx->crc, pdata, head);
+    pdata += head;
+    len -= head;
+
+    if (len >= 4)
+    {
+        ctx->crc = crc_hardware(ctx->crc, (const uint32_t *)pdata, len / 4);
+        pdata += len & ~0x03;
+        len &= 0x03;
+    }
+#endif
+    ctx->crc = crc_software(ctx->crc, pdata, len);
+}
+
+/**
+ * @brief get crc result
+ * @param ctx - crc context
+ * @return crc value
+ */
+uint32_t crc32_final(const crc32_ctx *ctx)
+{
+    assert_param(NULL != ctx);
+    return ctx->crc;
+}
+
+/**
+ * @brief calculate crc of one block
+ * @param data - data to calculate
+ * @param len - data length
+ * @return crc value
+ */
+uint32_t crc32_calc(const void *data, uint32_t len)
+{
+    crc32_ctx ctx;
+    crc32_init(&ctx);
+    crc32_update(&ctx, data, len);
+    return crc32_final(&ctx);
+}
@@ -0,0 +1,30 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _CRC32_H_
+  #define _CRC32_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* crc-32/mpeg-2 over byte stream: poly 0x04c11db7, init 0xffffffff, no 
+ * reflection and no final xor, same as stm32 crc unit fed with byte 
+ * swapped words */
+typedef struct
+{
+    uint32_t crc;
+}crc32_ctx;
+
+void crc32_init(crc32_ctx *ctx);
+void crc32_update(crc32_ctx *ctx, const void *data, uint32_t len);
+uint32_t crc32_final(const crc32_ctx *ctx);
+uint32_t crc32_calc(const void *data, uint32_t len);
+
+END_DECLS
+
+#endif /* _CRC32_H_ */
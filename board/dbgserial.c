@@ -12,10 +12,12 @@
 #include "dbgserial.h"
 #include "global.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 
 /* serial output mutex */
 SemaphoreHandle_t xSerialMutex = NULL;
+static StaticSemaphore_t xSerialMutexBuffer;
 
 /**
  * @brief init debug serial port
@@ -31,7 +33,7 @@ void dbg_serial_setup(void)
     USART_EnableInt(USART1, USART_IT_TXE, FALSE);
     USART_Enable(USART1, TRUE);
     
-    xSerialMutex = xSemaphoreCreateMutex();
+    xSerialMutex = xSemaphoreCreateMutexStatic(&xSerialMutexBuffer);
 }
 
 /**
@@ -55,6 +57,22 @@ void dbg_putstring(const char *string, uint32_t length)
         dbg_putchar(*pNext++);
 }
 
+/**
+ * @brief lock debug port, keep output of one writer together
+ */
+void dbg_lock(void)
+{
+    xSemaphoreTake(xSerialMutex, portMAX_DELAY);
+}
+
+/**
+ * @brief unlock debug port
+ */
+void dbg_unlock(void)
+{
+    xSemaphoreGive(xSerialMutex);
+}
+
 
 #ifdef __DEBUG
 void assert_failed(const char *file, const char *line, const char *exp)
@@ -87,5 +105,159 @@ void trace(const char *module, const char *fmt, ...)
 }
 #endif
 
+#if defined(__ENABLE_TRACE) && defined(__BINARY_TRACE)
+/* binary trace record definition, see tools/tracedec.py */
+#define TRACE_SYNC             (0xa5)
+#define TRACE_TYPE_MSG         (0x01)
+#define TRACE_TYPE_TASK        (0x02)
+#define TRACE_MAX_PAYLOAD      (96)
+#define TRACE_MAX_TASKS        (16)
+
+/* tasks whose name has already been sent */
+static TaskHandle_t trace_tasks[TRACE_MAX_TASKS];
+static uint8_t trace_task_count = 0;
 
+/**
+ * @brief put 32-bit value to buffer in little endian
+ * @param buf - buffer
+ * @param val - value to put
+ * @return buffer position after value
+ */
+static uint8_t *put_u32(uint8_t *buf, uint32_t val)
+{
+    *buf++ = (uint8_t)(val & 0xff);
+    *buf++ = (uint8_t)((val >> 8) & 0xff);
+    *buf++ = (uint8_t)((val >> 16) & 0xff);
+    *buf++ = (uint8_t)((val >> 24) & 0xff);
+    return buf;
+}
+
+/**
+ * @brief send one binary record: sync, type, length, payload, checksum
+ * @param type - record type
+ * @param payload - record payload
+ * @param len - payload length
+ */
+static void send_record(uint8_t type, const uint8_t *payload, uint8_t len)
+{
+    uint8_t sum = type ^ len;
+    dbg_putchar(TRACE_SYNC);
+    dbg_putchar(type);
+    dbg_putchar(len);
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        sum ^= payload[i];
+        dbg_putchar(payload[i]);
+    }
+    dbg_putchar(sum);
+}
 
+/**
+ * @brief send task name record the first time a task traces
+ * @param task - current task
+ */
+static void announce_task(TaskHandle_t task)
+{
+    uint8_t buf[4 + configMAX_TASK_NAME_LEN];
+    const char *name = NULL;
+    uint8_t len = 0;
+
+    for (uint8_t i = 0; i < trace_task_count; ++i)
+    {
+        if (trace_tasks[i] == task)
+        {
+            return ;
+        }
+    }
+
+    if (trace_task_count < TRACE_MAX_TASKS)
+    {
+        trace_tasks[trace_task_count++] = task;
+    }
+
+    name = pcTaskGetName(task);
+    put_u32(buf, (uint32_t)task);
+    while (('\0' != name[len]) && (len < configMAX_TASK_NAME_LEN))
+    {
+        buf[4 + len] = name[len];
+        len ++;
+    }
+    send_record(TRACE_TYPE_TASK, buf, 4 + len);
+}
+
+/**
+ * @brief output trace message as binary record, format string is not sent,
+ *        its address is used as format id
+ * @param module - module name
+ * @param fmt - format string
+ */
+void trace_bin(const char *module, const char *fmt, ...)
+{
+    uint8_t buf[TRACE_MAX_PAYLOAD];
+    uint8_t *pdata = buf;
+    const uint8_t *pend = buf + TRACE_MAX_PAYLOAD;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    const char *str = NULL;
+    va_list argptr;
+
+    pdata = put_u32(pdata, (uint32_t)xTaskGetTickCount());
+    pdata = put_u32(pdata, (uint32_t)task);
+    pdata = put_u32(pdata, (uint32_t)module);
+    pdata = put_u32(pdata, (uint32_t)fmt);
+
+    /* arguments follow the conversions in format string */
+    va_start(argptr, fmt);
+    for (const char *pfmt = fmt; '\0' != *pfmt; ++pfmt)
+    {
+        if ('%' != *pfmt)
+        {
+            continue;
+        }
+        pfmt ++;
+        if ('%' == *pfmt)
+        {
+            continue;
+        }
+        while (('\0' != *pfmt) && (NULL != strchr("-+ #0123456789.lh", *pfmt)))
+        {
+            pfmt ++;
+        }
+        if ('\0' == *pfmt)
+        {
+            break;
+        }
+        
+        if ('s' == *pfmt)
+        {
+            if (pdata >= pend)
+            {
+                break;
+            }
+            /* strings are sent inline, zero terminated */
+            str = va_arg(argptr, const char *);
+            while (('\0' != *str) && (pdata < pend - 1))
+            {
+                *pdata++ = *str++;
+            }
+            *pdata++ = '\0';
+        }
+        else if (pdata <= pend - 4)
+        {
+            pdata = put_u32(pdata, va_arg(argptr, uint32_t));
+        }
+        else
+        {
+            break;
+        }
+    }
+    va_end(argptr);
+
+    xSemaphoreTake(xSerialMutex, portMAX_DELAY);
+    if (NULL != task)
+    {
+        announce_task(task);
+    }
+    send_record(TRACE_TYPE_MSG, buf, (uint8_t)(pdata - buf));
+    xSemaphoreGive(xSerialMutex);
+}
+#endif
@@ -15,6 +15,8 @@ BEGIN_DECLS
 void dbg_serial_setup(void);
 void dbg_putchar(char data);
 void dbg_putstring(const char *string, uint32_t length);
+void dbg_lock(void);
+void dbg_unlock(void);
 
 END_DECLS
 
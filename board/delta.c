@@ -0,0 +1,168 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "delta.h"
+#include "assert.h"
+
+/* patch decoder shared by application, which verifies staged patch 
+ * against running image, and bootloader, which applies it */
+
+/**
+ * @brief get little endian word
+ * @param data - data buffer
+ * @return word
+ */
+static __INLINE uint32_t get_word(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16) |
+           ((uint32_t)data[3] << 24);
+}
+
+/**
+ * @brief get little endian halfword
+ * @param data - data buffer
+ * @return halfword
+ */
+static __INLINE uint16_t get_half(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+/**
+ * @brief check copy source lies in pages not rebuilt yet
+ * @param written - rebuilt pages
+ * @param src - source offset
+ * @param len - source length, not 0
+ * @return TRUE if source holds old image
+ */
+static bool source_ok(const uint32_t *written, uint32_t src, uint32_t len)
+{
+    uint32_t last = (src + len - 1) / FLASH_PAGE_SIZE;
+    for (uint32_t page = src / FLASH_PAGE_SIZE; page <= last; ++page)
+    {
+        if (0 != (written[page >> 5] & (1UL << (page & 0x1f))))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * @brief read and check patch header
+ * @param patch - patch data
+ * @param len - patch length
+ * @param header - header output
+ * @return TRUE if header is valid
+ */
+bool delta_header_get(const uint8_t *patch, uint32_t len, 
+                      delta_header *header)
+{
+    assert_param(NULL != patch);
+    assert_param(NULL != header);
+    if ((len < DELTA_HEADER_SIZE) || (0 != memcmp(patch, DELTA_MAGIC, 4)))
+    {
+        return FALSE;
+    }
+
+    header->old_size = get_word(patch + 4);
+    header->old_crc = get_word(patch + 8);
+    header->new_size = get_word(patch + 12);
+    header->new_crc = get_word(patch + 16);
+    header->pages = get_half(patch + 20);
+    return (header->old_size <= FLASH_APP_SIZE) &&
+           (0 != header->new_size) && (header->new_size <= FLASH_APP_SIZE) &&
+           (header->pages == (header->new_size + FLASH_PAGE_SIZE - 1) / 
+                             FLASH_PAGE_SIZE);
+}
+
+/**
+ * @brief get length of new image in page
+ * @param header - patch header
+ * @param page - page index
+ * @return page length
+ */
+uint32_t delta_page_len(const delta_header *header, uint16_t page)
+{
+    uint32_t len = header->new_size - page * FLASH_PAGE_SIZE;
+    return (len > FLASH_PAGE_SIZE) ? FLASH_PAGE_SIZE : len;
+}
+
+/**
+ * @brief decode one segment
+ * @param patch - patch data
+ * @param len - patch length
+ * @param offset - segment offset in patch
+ * @param header - patch header
+ * @param written - pages rebuilt by earlier segments
+ * @param seg - segment page and crc output
+ * @param out - page content output, NULL only reads segment head
+ * @param arg - output argument
+ * @return offset of next segment, 0 if segment is invalid
+ */
+uint32_t delta_segment(const uint8_t *patch, uint32_t len, uint32_t offset,
+                       const delta_header *header, const uint32_t *written,
+                       delta_seg *seg, delta_output out, void *arg)
+{
+    assert_param(NULL != seg);
+    if (offset + DELTA_SEGMENT_SIZE > len)
+    {
+        return 0;
+    }
+
+    seg->page = get_half(patch + offset);
+    seg->crc = get_word(patch + offset + 2);
+    uint32_t pos = offset + DELTA_SEGMENT_SIZE;
+    uint32_t end = pos + get_half(patch + offset + 6);
+    if ((seg->page >= header->pages) || (end > len))
+    {
+        return 0;
+    }
+
+    if (NULL == out)
+    {
+        return end;
+    }
+
+    uint32_t remain = delta_page_len(header, seg->page);
+    while (pos < end)
+    {
+        uint32_t size = 0;
+        if ((DELTA_CMD_COPY == patch[pos]) && (pos + 7 <= end))
+        {
+            uint32_t src = get_word(patch + pos + 1);
+            size = get_half(patch + pos + 5);
+            if ((0 == size) || (size > remain) || 
+                (src + size > header->old_size) ||
+                !source_ok(written, src, size))
+            {
+                return 0;
+            }
+            out(arg, (const uint8_t *)(FLASH_APP_ADDR + src), size);
+            pos += 7;
+        }
+        else if ((DELTA_CMD_DATA == patch[pos]) && (pos + 3 <= end))
+        {
+            size = get_half(patch + pos + 1);
+            if ((size > remain) || (pos + 3 + size > end))
+            {
+                return 0;
+            }
+            out(arg, patch + pos + 3, size);
+            pos += 3 + size;
+        }
+        else
+        {
+            return 0;
+        }
+        remain -= size;
+    }
+
+    return (0 == remain) ? end : 0;
+}
@@ -0,0 +1,64 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _DELTA_H_
+  #define _DELTA_H_
+
+#include "types.h"
+#include "flash_map.h"
+
+BEGIN_DECLS
+
+/* patch made by tools/mkdelta.py, bootloader rebuilds application area in
+ * place one page per segment, integers are little endian
+ *
+ * header:  "VMD2" | old size u32 | old crc u32 | new size u32 | 
+ *          new crc u32 | pages u16 | reserved u16
+ * segment: page u16 | page crc u32 | length u16 | commands
+ * command: 0x01 | source offset u32 | length u16 - copy from application
+ *          0x02 | length u16 | data - literal data
+ *
+ * copy source never lies in a page rebuilt by an earlier segment, so it 
+ * still holds old image when segment is applied
+ */
+#define DELTA_MAGIC          "VMD2"
+#define DELTA_HEADER_SIZE    (24)
+#define DELTA_SEGMENT_SIZE   (8)
+#define DELTA_CMD_COPY       (0x01)
+#define DELTA_CMD_DATA       (0x02)
+
+/* rebuilt pages, bit per application page */
+#define DELTA_BITMAP_WORDS   ((FLASH_APP_SIZE / FLASH_PAGE_SIZE + 31) / 32)
+
+typedef struct
+{
+    uint32_t old_size;
+    uint32_t old_crc;
+    uint32_t new_size;
+    uint32_t new_crc;
+    uint16_t pages;
+}delta_header;
+
+typedef struct
+{
+    uint16_t page;
+    uint32_t crc;
+}delta_seg;
+
+/* receives rebuilt page content in order */
+typedef void (*delta_output)(void *arg, const uint8_t *data, uint32_t len);
+
+bool delta_header_get(const uint8_t *patch, uint32_t len, 
+                      delta_header *header);
+uint32_t delta_page_len(const delta_header *header, uint16_t page);
+uint32_t delta_segment(const uint8_t *patch, uint32_t len, uint32_t offset,
+                       const delta_header *header, const uint32_t *written,
+                       delta_seg *seg, delta_output out, void *arg);
+
+END_DECLS
+
+#endif /* _DELTA_H_ */
@@ -7,6 +7,7 @@
 */
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
@@ -15,13 +16,12 @@
 #include "global.h"
 #include "trace.h"
 #include "pinconfig.h"
-#include "dbgserial.h"
+#include "linkbaud.h"
+#include "netif.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE "[esp8266]"
 
-//#define _PRINT_DETAIL 
-
 /* mqtt driver */
 static esp8266_driver g_driver;
 
@@ -53,24 +53,47 @@ static work_mode g_curmode = mode_at;
 /* serial handle */
 static serial *g_serial = NULL;
 
-/* recive queue */
-static xQueueHandle xStatusQueue = NULL;
-static xQueueHandle xTcpQueue = NULL;
-static xQueueHandle xAtQueue = NULL;
-
 #define ESP_MAX_NODE_NUM              (6)
 #define ESP_MAX_MSG_SIZE_PER_LINE     (64)
 #define ESP_MAX_CONNECT_NUM           (5)
+#define ESP_MAX_TCP_NODE_NUM          (3)
+/* wait for consumer when tcp queue is full, same as m26 */
+#define ESP_TCP_WAIT                  (100 / portTICK_PERIOD_MS)
+
+/* recive queue */
+static xQueueHandle xStatusQueue = NULL;
+static xQueueHandle xTcpQueue[ESP_MAX_CONNECT_NUM];
+static xQueueHandle xAtQueue = NULL;
+/* "ready" after module power up */
+static xQueueHandle xReadyQueue = NULL;
 
 typedef struct
 {
-    uint8_t id;
     uint16_t size;
     uint8_t data[ESP_MAX_MSG_SIZE_PER_LINE];
 }tcp_node;
 
+/* task and queue storage */
+static StackType_t xESP8266Stack[ESP8266_STACK_SIZE];
+static StaticTask_t xESP8266TaskBuffer;
+static uint8_t ucStatusStorage[ESP_MAX_NODE_NUM * sizeof(uint8_t)];
+static StaticQueue_t xStatusQueueBuffer;
+static uint8_t ucAtStorage[ESP_MAX_NODE_NUM * ESP_MAX_MSG_SIZE_PER_LINE];
+static StaticQueue_t xAtQueueBuffer;
+static uint8_t ucReadyStorage[1];
+static StaticQueue_t xReadyQueueBuffer;
+static uint8_t ucTcpStorage[ESP_MAX_CONNECT_NUM]
+                           [ESP_MAX_TCP_NODE_NUM * sizeof(tcp_node)];
+static StaticQueue_t xTcpQueueBuffer[ESP_MAX_CONNECT_NUM];
+/* data of link was dropped since last receive */
+static volatile bool g_tcp_lost[ESP_MAX_CONNECT_NUM];
+static uint32_t g_tcp_drops = 0;
+
 /* timeout time(ms) */
 #define DEFAULT_TIMEOUT      (3000 / portTICK_PERIOD_MS)
+#define SCAN_TIMEOUT         (10000 / portTICK_PERIOD_MS)
+/* module boot time is about 300ms, old firmware may not report ready */
+#define READY_TIMEOUT        (2000 / portTICK_PERIOD_MS)
 
 /**
  * @brief connedted default process function
@@ -86,22 +109,6 @@ static void esp8266_ap_disconnect(void)
 {
 }
 
-/**
- * @brief connedted default process function
- */
-static void esp8266_server_connect(uint8_t id)
-{
-    UNUSED(id);
-}
-
-/**
- * @brief connedted default process function
- */
-static void esp8266_server_disconnect(uint8_t id)
-{
-    UNUSED(id);
-}
-
 /**
  * @brief initialize esp8266 default driver
  */
@@ -109,8 +116,6 @@ static void init_esp8266_driver(void)
 {
     g_driver.ap_connect = esp8266_ap_connect;
     g_driver.ap_disconnect = esp8266_ap_disconnect;
-    g_driver.server_connect = esp8266_server_connect;
-    g_driver.server_disconnect = esp8266_server_disconnect;
 }
 
 /**
@@ -195,13 +200,13 @@ static bool try_process_server_connect(const char *data, uint8_t len)
         if (0 == strncmp(pdata, "CONNECT", 7))
         {
             id = parse_id(data);
-            g_driver.server_connect(id);
+            netif_notify(&esp8266_netif, id, NETIF_CONNECTED);
             return TRUE;
         }
         else if (0 == strncmp(pdata, "CLOSED", 6))
         {
             id = parse_id(data);
-            g_driver.server_disconnect(id);
+            netif_notify(&esp8266_netif, id, NETIF_DISCONNECTED);
             return TRUE;
         }
     }
@@ -230,6 +235,23 @@ static bool try_process_ap_connect(const char *data, uint8_t len)
     return FALSE;
 }
 
+/**
+ * @brief process module ready
+ * @param data - data to process
+ * @param len - data length
+ */
+static bool try_process_ready(const char *data, uint8_t len)
+{
+    if ((7 == len) && (0 == strncmp(data, "ready", 5)))
+    {
+        uint8_t flag = 0;
+        xQueueSend(xReadyQueue, &flag, 0);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 /**
  * @brief process default 
  * @param data - data to process
@@ -249,6 +271,7 @@ static process_func process_funcs[] =
     try_process_status,
     try_process_server_connect,
     try_process_ap_connect,
+    try_process_ready,
     try_process_default,
     NULL
 };
@@ -363,20 +386,32 @@ static int process_tcp_head(const char *data, uint8_t len, uint16_t *id,
 
 /**
  * @brief process reveived tcp data
+ * @param id - link id
  * @param data - data buffer
  * @param len - data length
  */
 static int process_tcp_data(uint8_t id, char *data, uint16_t len)
 {
+    if (id >= ESP_MAX_CONNECT_NUM)
+    {
+        TRACE("drop data of link %d\r\n", id);
+        return 0;
+    }
+    
     tcp_node node; 
-    node.id = id;
     node.size = len;
     for (int i = 0; i < len; ++i)
     {
         node.data[i] = data[i];
     }
-    //xQueueSend(xTcpQueue, &node, 100 / portTICK_PERIOD_MS);
-    xQueueSend(xTcpQueue, &node, 0);
+    if (!xQueueSend(xTcpQueue[id], &node, ESP_TCP_WAIT))
+    {
+        /* consumer is stuck, its stream is broken from here */
+        g_tcp_drops ++;
+        g_tcp_lost[id] = TRUE;
+        TRACE("link %d drop %d bytes\r\n", id, len);
+    }
+    netif_notify(&esp8266_netif, id, NETIF_RECEIVED);
     return 0;
 }
 
@@ -406,22 +441,18 @@ static void vESP8266Response(void *pvParameters)
             /* receive data */
             *pData++ = data;
             node_size ++;
-#ifdef _PRINT_DETAIL
-            dbg_putchar(data);
-#endif
             while (serial_getchar(pserial, &data, xDelay))
             {
-#ifdef _PRINT_DETAIL
-                dbg_putchar(data);
-#endif
                 /* receive data */
                 *pData++ = data;
                 node_size ++;
                 switch (g_curmode)
                 {
                 case mode_at:
-                    if (process_at_data(node_data, node_size) > 0)
+                    if ((process_at_data(node_data, node_size) > 0) ||
+                        (node_size >= ESP_MAX_MSG_SIZE_PER_LINE))
                     {
+                        /* overlong line is dropped */
                         pData = node_data;
                         node_size = 0;
                     }
@@ -471,9 +502,6 @@ bool esp8266_init(void)
     TRACE("initialize esp8266...\r\n");
     pin_set("WIFI_RST");
     pin_reset("WIFI_EN");
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    pin_set("WIFI_EN");
-    vTaskDelay(2000 / portTICK_PERIOD_MS);
     
     g_serial = serial_request(COM2);
     if (NULL == g_serial)
@@ -484,14 +512,23 @@ bool esp8266_init(void)
     serial_open(g_serial);
 
     init_esp8266_driver();
-    xStatusQueue = xQueueCreate(ESP_MAX_NODE_NUM, ESP_MAX_NODE_NUM);
-    xAtQueue = xQueueCreate(ESP_MAX_NODE_NUM, ESP_MAX_MSG_SIZE_PER_LINE);
-    xTcpQueue = xQueueCreate(ESP_MAX_NODE_NUM * 2, 
-                             sizeof(tcp_node) / sizeof(char));
+    xStatusQueue = xQueueCreateStatic(ESP_MAX_NODE_NUM, sizeof(uint8_t),
+                                      ucStatusStorage, &xStatusQueueBuffer);
+    xAtQueue = xQueueCreateStatic(ESP_MAX_NODE_NUM, ESP_MAX_MSG_SIZE_PER_LINE,
+                                  ucAtStorage, &xAtQueueBuffer);
+    xReadyQueue = xQueueCreateStatic(1, 1, ucReadyStorage, 
+                                     &xReadyQueueBuffer);
+    for (int i = 0; i < ESP_MAX_CONNECT_NUM; ++i)
+    {
+        xTcpQueue[i] = xQueueCreateStatic(ESP_MAX_TCP_NODE_NUM, 
+                                          sizeof(tcp_node) / sizeof(char),
+                                          ucTcpStorage[i], 
+                                          &xTcpQueueBuffer[i]);
+    }
 
     if ((NULL == xStatusQueue) || 
-        (NULL == xAtQueue) || 
-        (NULL == xTcpQueue))
+        (NULL == xAtQueue) ||
+        (NULL == xReadyQueue))
     {
         TRACE("initialize failed, can't create queue\'COM2\'\r\n");
         serial_release(g_serial);
@@ -499,8 +536,19 @@ bool esp8266_init(void)
         return FALSE;
     }
     
-    xTaskCreate(vESP8266Response, "ESP8266Response", ESP8266_STACK_SIZE, 
-            g_serial, ESP8266_PRIORITY, &task_esp8266);
+    task_esp8266 = xTaskCreateStatic(vESP8266Response, "ESP8266Response", 
+                                     ESP8266_STACK_SIZE, g_serial, 
+                                     ESP8266_PRIORITY, xESP8266Stack, 
+                                     &xESP8266TaskBuffer);
+
+    /* power up with response task running, so ready is not missed */
+    vTaskDelay(100 / portTICK_PERIOD_MS);
+    pin_set("WIFI_EN");
+    uint8_t flag;
+    if (!xQueueReceive(xReadyQueue, &flag, READY_TIMEOUT))
+    {
+        TRACE("no ready from module\r\n");
+    }
      
     return TRUE;
 }
@@ -599,15 +647,27 @@ esp8266_mode esp8266_getmode(void)
 }
 
 /**
- * @brief connect ap
+ * @brief connect ap, known bssid skips the scan for ap
  * @param ssid - ap ssid
  * @param pwd - ap password
+ * @param bssid - ap bssid, NULL to join any ap of ssid
+ * @param time - timeout time
  * @return 0 means connect success, otherwise failed
  */
-int esp8266_connect_ap(const char *ssid, const char *pwd, TickType_t time)
+int esp8266_connect_ap(const char *ssid, const char *pwd, 
+                       const uint8_t *bssid, TickType_t time)
 {
-    char str_mode[64];
-    sprintf(str_mode, "AT+CWJAP_CUR=\"%s\",\"%s\"\r\n", ssid, pwd);
+    char str_mode[112];
+    if (NULL == bssid)
+    {
+        sprintf(str_mode, "AT+CWJAP_CUR=\"%s\",\"%s\"\r\n", ssid, pwd);
+    }
+    else
+    {
+        sprintf(str_mode, "AT+CWJAP_CUR=\"%s\",\"%s\","
+                "\"%02x:%02x:%02x:%02x:%02x:%02x\"\r\n", ssid, pwd, 
+                bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+    }
     send_at_cmd(str_mode, strlen(str_mode));
     int ret = ESP_ERR_OK;
 
@@ -641,6 +701,98 @@ int esp8266_connect_ap(const char *ssid, const char *pwd, TickType_t time)
     return ret;
 }
 
+/**
+ * @brief disconnect ap
+ * @return 0 means success, otherwise error code
+ */
+int esp8266_disconnect_ap(void)
+{
+    return esp8266_send_ok("AT+CWQAP\r\n");
+}
+
+/**
+ * @brief parse scan line, +CWLAP:(rssi,"bssid",channel)
+ * @param data - line data
+ * @param ap - parsed ap
+ * @return TRUE if line is scan result
+ */
+static bool parse_scan(const char *data, esp8266_ap *ap)
+{
+    char *end = NULL;
+    if (0 != strncmp(data, "+CWLAP:(", 8))
+    {
+        return FALSE;
+    }
+
+    ap->rssi = strtol(data + 8, &end, 10);
+    if ((',' != end[0]) || ('"' != end[1]))
+    {
+        return FALSE;
+    }
+
+    const char *pdata = end + 2;
+    for (uint8_t i = 0; i < 6; ++i)
+    {
+        ap->bssid[i] = strtoul(pdata, &end, 16);
+        if (*end != ((i < 5) ? ':' : '"'))
+        {
+            return FALSE;
+        }
+        pdata = end + 1;
+    }
+
+    if (',' != *pdata)
+    {
+        return FALSE;
+    }
+    ap->channel = strtoul(pdata + 1, NULL, 10);
+    return TRUE;
+}
+
+/**
+ * @brief scan aps of ssid, result is sorted by signal strength and only 
+ *        strongest aps are kept
+ * @param ssid - ap ssid
+ * @param aps - scan result
+ * @param max - max result number
+ * @return ap number, negative error code if failed
+ */
+int esp8266_scan(const char *ssid, esp8266_ap *aps, uint8_t max)
+{
+    /* sorted by rssi, only rssi, bssid and channel so lines stay short */
+    int ret = esp8266_send_ok("AT+CWLAPOPT=1,28\r\n");
+    if (ESP_ERR_OK != ret)
+    {
+        return ret;
+    }
+
+    char str_mode[48];
+    sprintf(str_mode, "AT+CWLAP=\"%s\"\r\n", ssid);
+    send_at_cmd(str_mode, strlen(str_mode));
+    uint8_t status;
+    if (pdPASS != xQueueReceive(xStatusQueue, &status, SCAN_TIMEOUT))
+    {
+        return -ESP_ERR_TIMEOUT;
+    }
+    if (ESP_ERR_OK != status)
+    {
+        return -status;
+    }
+
+    char buf[ESP_MAX_MSG_SIZE_PER_LINE];
+    uint8_t count = 0;
+    while ((count < max) && xQueueReceive(xAtQueue, buf, 0))
+    {
+        buf[ESP_MAX_MSG_SIZE_PER_LINE - 1] = '\0';
+        if (parse_scan(buf, &aps[count]))
+        {
+            count ++;
+        }
+    }
+
+    return count;
+}
+
 /**
  * @brief set software ap parameter
  * @param ssid - ap ssid
@@ -685,6 +837,9 @@ int esp8266_set_apaddr(const char *ip, const char *gateway, const char *netmask)
 int esp8266_connect_server(uint8_t id, const char *mode, const char *ip, 
                     uint16_t port)
 {
+    assert_param(id < ESP_MAX_CONNECT_NUM);
+    xQueueReset(xTcpQueue[id]);
+    g_tcp_lost[id] = FALSE;
     char str_mode[64];
     sprintf(str_mode, "AT+CIPSTART=%d,\"%s\",\"%s\",%d\r\n", id, mode, 
             ip, port);
@@ -701,7 +856,13 @@ int esp8266_disconnect_server(uint8_t id)
     char str_mode[22];
     sprintf(str_mode, "AT+CIPCLOSE=%d\r\n", id);
     
-    return esp8266_send_ok(str_mode);
+    int ret = esp8266_send_ok(str_mode);
+    if (id < ESP_MAX_CONNECT_NUM)
+    {
+        xQueueReset(xTcpQueue[id]);
+        g_tcp_lost[id] = FALSE;
+    }
+    return ret;
 }
 
 /**
@@ -732,17 +893,27 @@ int esp8266_close(uint16_t port)
 }
 
 /**
- * @brief get tcp data
+ * @brief get tcp data of link, after a drop queued data is discarded and 
+ *        loss is reported once so consumer resets its stream
+ * @param id - link id
  * @param data - tcp data
  * @param len - data length
  * @param xBlockTime - timeout time
  */
-int esp8266_recv(uint8_t *id, uint8_t *data, uint16_t *len, TickType_t xBlockTime)
+int esp8266_recv(uint8_t id, uint8_t *data, uint16_t *len, 
+                 TickType_t xBlockTime)
 {
+    assert_param(id < ESP_MAX_CONNECT_NUM);
+    if (g_tcp_lost[id])
+    {
+        g_tcp_lost[id] = FALSE;
+        xQueueReset(xTcpQueue[id]);
+        return -ESP_ERR_LOST;
+    }
+
     tcp_node node;
-    if (xQueueReceive(xTcpQueue, &node, xBlockTime))
+    if (xQueueReceive(xTcpQueue[id], &node, xBlockTime))
     {
-        *id = node.id;
         for (int i = 0; i < node.size; ++i)
         {
             data[i] = node.data[i];
@@ -756,6 +927,15 @@ int esp8266_recv(uint8_t *id, uint8_t *data, uint16_t *len, TickType_t xBlockTim
     }
 }
 
+/**
+ * @brief get count of tcp data dropped by full receive queue
+ * @return drop count
+ */
+uint32_t esp8266_tcp_drops(void)
+{
+    return g_tcp_drops;
+}
+
 /**
  * @brief prepare send tcp data
  * @param chl - connected channel
@@ -796,16 +976,6 @@ static void refresh_driver(void)
     {
         g_driver.ap_disconnect = esp8266_ap_disconnect;
     }
-    
-    if (NULL == g_driver.server_connect)
-    {
-        g_driver.server_connect = esp8266_server_connect;
-    }
-
-    if (NULL == g_driver.server_disconnect)
-    {
-        g_driver.server_disconnect = esp8266_server_disconnect;
-    }
 }
 
 /**
@@ -816,8 +986,6 @@ void esp8266_attach(const esp8266_driver *driver)
 {
     g_driver.ap_connect = driver->ap_connect;
     g_driver.ap_disconnect = driver->ap_disconnect;
-    g_driver.server_connect = driver->server_connect;
-    g_driver.server_disconnect = driver->server_disconnect;
     refresh_driver();
 }
 
@@ -841,3 +1009,88 @@ void esp8266_shutdown(void)
     }
 }
 
+/* baudrates probed by link bring up, fastest first */
+static const uint32_t esp_rates[] = {Baudrate_921600, Baudrate_460800, 
+                                     Baudrate_230400};
+
+/**
+ * @brief ask esp8266 to switch baudrate, not saved to flash
+ * @param baudrate - new baudrate
+ * @return TRUE: module acked
+ */
+static bool esp8266_set_rate(uint32_t baudrate)
+{
+    char cmd[36];
+    sprintf(cmd, "AT+UART_CUR=%d,8,1,0,0\r\n", baudrate);
+    return (ESP_ERR_OK == esp8266_send_ok(cmd));
+}
+
+/**
+ * @brief link validation round trip, version response carries several 
+ *        lines of text
+ * @return TRUE: valid response received
+ */
+static bool esp8266_test_rate(void)
+{
+    return (ESP_ERR_OK == esp8266_send_ok("AT+GMR\r\n"));
+}
+
+static linkbaud g_link = 
+{
+    "esp8266", NULL, esp_rates, sizeof(esp_rates) / sizeof(esp_rates[0]),
+    esp8266_set_rate, esp8266_test_rate, Baudrate_115200, 
+    sizeof(esp_rates) / sizeof(esp_rates[0])
+};
+
+/**
+ * @brief switch link to fastest reliable baudrate
+ * @return 0 means success, otherwise link lost
+ */
+int esp8266_negotiate_baud(void)
+{
+    assert_param(NULL != g_serial);
+    g_link.port = g_serial;
+    return (0 != linkbaud_negotiate(&g_link)) ? ESP_ERR_OK : -ESP_ERR_FAIL;
+}
+
+/**
+ * @brief check link receive errors and fall back to slower baudrate
+ * @return 0 means link is usable, otherwise link lost
+ */
+int esp8266_check_link(void)
+{
+    if (NULL == g_link.port)
+    {
+        return ESP_ERR_OK;
+    }
+    return linkbaud_check(&g_link) ? ESP_ERR_OK : -ESP_ERR_FAIL;
+}
+
+/**
+ * @brief netif send, data follows send prompt
+ * @param id - link id
+ * @param data - data to send
+ * @param length - data length
+ */
+static int esp8266_netif_send(uint8_t id, const uint8_t *data, 
+                              uint16_t length)
+{
+    int ret = esp8266_prepare_send(id, length);
+    if (ESP_ERR_OK == ret)
+    {
+        ret = esp8266_write((const char *)data, length);
+    }
+
+    return ret;
+}
+
+/* esp8266 socket interface */
+const netif esp8266_netif = 
+{
+    "esp8266",
+    esp8266_connect_server,
+    esp8266_netif_send,
+    esp8266_recv,
+    esp8266_disconnect_server,
+    esp8266_check_link,
+};
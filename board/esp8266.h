@@ -9,6 +9,7 @@
   #define _ESP8266_H_
 
 #include "types.h"
+#include "netif.h"
 
 BEGIN_DECLS
 
@@ -19,6 +20,7 @@ BEGIN_DECLS
 #define ESP_ERR_NOT_FOUND         3
 #define ESP_ERR_FAIL              4
 #define ESP_ERR_ALREADY           5
+#define ESP_ERR_LOST              6
 
 typedef enum
 {
@@ -43,14 +45,23 @@ typedef enum
 }esp8266_ecn;
 
 
+/* ap found by scan */
+typedef struct
+{
+    uint8_t bssid[6];
+    int8_t rssi;
+    uint8_t channel;
+}esp8266_ap;
+
 typedef struct
 {
     void (*ap_connect)(void);
     void (*ap_disconnect)(void);
-    void (*server_connect)(uint8_t id);
-    void (*server_disconnect)(uint8_t id);
 }esp8266_driver;
 
+/* esp8266 socket interface */
+extern const netif esp8266_netif;
+
 /* esp8266 interface */
 bool esp8266_init(void);
 int esp8266_send_ok(const char *cmd);
@@ -58,7 +69,10 @@ int esp8266_setmode(esp8266_mode mode);
 int esp8266_create_server(void);
 int esp8266_close_server(void);
 esp8266_mode esp8266_getmode(void);
-int esp8266_connect_ap(const char *ssid, const char *pwd, TickType_t time);
+int esp8266_connect_ap(const char *ssid, const char *pwd, 
+                       const uint8_t *bssid, TickType_t time);
+int esp8266_disconnect_ap(void);
+int esp8266_scan(const char *ssid, esp8266_ap *aps, uint8_t max);
 int esp8266_set_softap(const char *ssid, const char *pwd, uint8_t chl, 
                        esp8266_ecn ecn);
 int esp8266_set_apaddr(const char *ip, const char *gateway, const char *netmask);
@@ -69,11 +83,15 @@ int esp8266_listen(uint16_t port);
 int esp8266_close(uint16_t port);
 int esp8266_prepare_send(uint8_t id, uint16_t length);
 int esp8266_set_tcp_timeout(uint16_t timeout);
-int esp8266_recv(uint8_t *id, uint8_t *data, uint16_t *len, TickType_t xBlockTime);
+int esp8266_recv(uint8_t id, uint8_t *data, uint16_t *len, 
+                 TickType_t xBlockTime);
+uint32_t esp8266_tcp_drops(void);
 int esp8266_write(const char *data, uint32_t length);
 void esp8266_attach(const esp8266_driver *driver);
 void esp8266_detach(void);
 void esp8266_shutdown(void);
+int esp8266_negotiate_baud(void);
+int esp8266_check_link(void);
 
 END_DECLS
 
@@ -6,27 +6,111 @@
 * See the COPYING file for the terms of usage and distribution.
 */
 #include <string.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
 #include "flash.h"
+#include "flash_map.h"
+#include "kvstore.h"
 #include "assert.h"
 #include "trace.h"
 #include "stm32f10x_cfg.h"
 
-/* 0x800F400, 1K */
-#define FLASH_ADDR   0x800F400
+/* settings in kv store */
+#define KEY_AP        0
+#define KEY_BSSID     1
+
+/* legacy configuration page */
+#define LEGACY_ADDR   FLASH_CONFIG_ADDR
 #define SSID_OFFSET   8
 #define PWD_OFFSET    40
 
+#define SSID_SIZE     32
+#define PWD_SIZE      32
+
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[flash]"
 
+/* flash controller is shared by ota, outbox and kv store writers in
+ * several tasks, one program or erase runs at a time */
+static SemaphoreHandle_t xFlashMutex = NULL;
+static StaticSemaphore_t xFlashMutexBuffer;
+
+/* ssid and password are kept in one record so they update together */
+static char g_ap[SSID_SIZE + PWD_SIZE];
+
+/**
+ * @brief erase flash page
+ * @param addr - page address
+ */
+void flash_erase(uint32_t addr)
+{
+    assert_param(NULL != xFlashMutex);
+    xSemaphoreTake(xFlashMutex, portMAX_DELAY);
+    FLASH_ErasePage(addr);
+    xSemaphoreGive(xFlashMutex);
+}
+
+/**
+ * @brief program erased flash, halfword aligned
+ * @param addr - start address
+ * @param data - data to write
+ * @param len - data length
+ */
+void flash_program(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    assert_param(NULL != xFlashMutex);
+    xSemaphoreTake(xFlashMutex, portMAX_DELAY);
+    FLASH_Write(addr, (uint8_t *)data, len);
+    xSemaphoreGive(xFlashMutex);
+}
+
+/**
+ * @brief move settings of legacy configuration page to kv store
+ */
+static void migrate_legacy(void)
+{
+    char ssid[SSID_SIZE];
+    char pwd[PWD_SIZE];
+    if (0 != strncmp((const char *)LEGACY_ADDR, "INIT", 4))
+    {
+        return ;
+    }
+
+    FLASH_Read(LEGACY_ADDR + SSID_OFFSET, (uint8_t *)ssid, SSID_SIZE);
+    FLASH_Read(LEGACY_ADDR + PWD_OFFSET, (uint8_t *)pwd, PWD_SIZE);
+    ssid[SSID_SIZE - 1] = '\0';
+    pwd[PWD_SIZE - 1] = '\0';
+    TRACE("migrate legacy configuration\r\n");
+    flash_set_ssid_pwd(ssid, pwd);
+    flash_erase(LEGACY_ADDR);
+}
+
+/**
+ * @brief initialize configuration storage
+ * @return init status
+ */
+bool flash_init(void)
+{
+    xFlashMutex = xSemaphoreCreateMutexStatic(&xFlashMutexBuffer);
+    if (!kv_init())
+    {
+        return FALSE;
+    }
+
+    if (!kv_exists(KEY_AP))
+    {
+        migrate_legacy();
+    }
+
+    return TRUE;
+}
+
 /**
  * @brief check system init status
  */
 bool flash_first_start(void)
 {
-    uint8_t buf[8];
-    FLASH_Read(FLASH_ADDR, buf, 8);
-    return (0 != strncmp((const char *)buf, "INIT", 4));
+    return !kv_exists(KEY_AP);
 }
 
 /**
@@ -36,8 +120,12 @@ bool flash_first_start(void)
  */
 void flash_get_ssid_pwd(char *ssid, char *pwd)
 {
-    FLASH_Read(FLASH_ADDR + SSID_OFFSET, (uint8_t *)ssid, 32);
-    FLASH_Read(FLASH_ADDR + PWD_OFFSET, (uint8_t *)pwd, 32);
+    memset(g_ap, 0, sizeof(g_ap));
+    kv_get(KEY_AP, g_ap, sizeof(g_ap));
+    strncpy(ssid, g_ap, SSID_SIZE);
+    ssid[SSID_SIZE - 1] = '\0';
+    strncpy(pwd, g_ap + strlen(g_ap) + 1, PWD_SIZE);
+    pwd[PWD_SIZE - 1] = '\0';
     TRACE("get ssid(%s), pwd(%s)\r\n", ssid, pwd);
 }
 
@@ -48,10 +136,23 @@ void flash_get_ssid_pwd(char *ssid, char *pwd)
  */
 void flash_set_ssid_pwd(const char *ssid, const char *pwd)
 {
-    FLASH_ErasePage(FLASH_ADDR);
-    FLASH_Write(FLASH_ADDR, "INIT", 4);
-    FLASH_Write(FLASH_ADDR + SSID_OFFSET, (uint8_t *)ssid, strlen(ssid) + 1);
-    FLASH_Write(FLASH_ADDR + PWD_OFFSET, (uint8_t *)pwd, strlen(pwd) + 1);
+    uint32_t ssid_len = strlen(ssid);
+    uint32_t pwd_len = strlen(pwd);
+    if (ssid_len > SSID_SIZE - 1)
+    {
+        ssid_len = SSID_SIZE - 1;
+    }
+    if (pwd_len > PWD_SIZE - 1)
+    {
+        pwd_len = PWD_SIZE - 1;
+    }
+    memcpy(g_ap, ssid, ssid_len);
+    g_ap[ssid_len] = '\0';
+    memcpy(g_ap + ssid_len + 1, pwd, pwd_len);
+    g_ap[ssid_len + 1 + pwd_len] = '\0';
+    kv_set(KEY_AP, g_ap, ssid_len + pwd_len + 2);
+    /* cached ap belongs to old network */
+    kv_delete(KEY_BSSID);
     TRACE("update ssid(%s), pwd(%s)\r\n", ssid, pwd);
 }
 
@@ -60,5 +161,38 @@ void flash_set_ssid_pwd(const char *ssid, const char *pwd)
  */
 void flash_restore(void)
 {
-    FLASH_ErasePage(FLASH_ADDR);
-}
\ No newline at end of file
+    kv_delete(KEY_AP);
+    kv_delete(KEY_BSSID);
+}
+
+/**
+ * @brief get bssid and channel of last good ap
+ * @param bssid - ap bssid, 6 bytes
+ * @param channel - ap channel
+ * @return FALSE if no ap is cached
+ */
+bool flash_get_bssid(uint8_t *bssid, uint8_t *channel)
+{
+    uint8_t ap[7];
+    if (sizeof(ap) != kv_get(KEY_BSSID, ap, sizeof(ap)))
+    {
+        return FALSE;
+    }
+
+    memcpy(bssid, ap, 6);
+    *channel = ap[6];
+    return TRUE;
+}
+
+/**
+ * @brief cache bssid and channel of good ap, same ap is not written again
+ * @param bssid - ap bssid, 6 bytes
+ * @param channel - ap channel
+ */
+void flash_set_bssid(const uint8_t *bssid, uint8_t channel)
+{
+    uint8_t ap[7];
+    memcpy(ap, bssid, 6);
+    ap[6] = channel;
+    kv_set(KEY_BSSID, ap, sizeof(ap));
+}
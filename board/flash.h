@@ -10,10 +10,15 @@
 
 #include "types.h"
 
+bool flash_init(void);
+void flash_erase(uint32_t addr);
+void flash_program(uint32_t addr, const uint8_t *data, uint32_t len);
 bool flash_first_start(void);
 void flash_restore(void);
 void flash_get_ssid_pwd(char *ssid, char *pwd);
 void flash_set_ssid_pwd(const char *ssid, const char *pwd);
+bool flash_get_bssid(uint8_t *bssid, uint8_t *channel);
+void flash_set_bssid(const uint8_t *bssid, uint8_t channel);
 
 
 #endif
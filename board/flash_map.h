@@ -0,0 +1,45 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _FLASH_MAP_H_
+  #define _FLASH_MAP_H_
+
+/* stm32f103x8, 64K flash with 1K pages
+ *
+ * 0x08000000 - 0x08000FFF  bootloader
+ * 0x08001000 - 0x0800B7FF  application
+ * 0x0800B800 - 0x0800DBFF  ota staging, delta patch only
+ * 0x0800DC00 - 0x0800DFFF  install scratch, page being rebuilt
+ * 0x0800E000 - 0x0800E3FF  ota state
+ * 0x0800E400 - 0x0800F3FF  mqtt outbox, 4 pages
+ * 0x0800F400 - 0x0800F7FF  legacy configuration, migrated to kv store
+ * 0x0800F800 - 0x0800FFFF  kv store, 2 pages
+ *
+ * application image must fit in FLASH_APP_SIZE, see board/app.icf
+ */
+#define FLASH_PAGE_SIZE        (0x400)
+
+#define FLASH_BOOT_ADDR        (0x08000000)
+
+#define FLASH_APP_ADDR         (0x08001000)
+#define FLASH_APP_SIZE         (0xA800)
+
+#define FLASH_STAGING_ADDR     (0x0800B800)
+#define FLASH_STAGING_SIZE     (0x2400)
+#define FLASH_SCRATCH_ADDR     (0x0800DC00)
+#define FLASH_OTA_ADDR         (0x0800E000)
+
+#define FLASH_OUTBOX_ADDR      (0x0800E400)
+#define FLASH_OUTBOX_PAGES     (4)
+
+#define FLASH_CONFIG_ADDR      (0x0800F400)
+
+#define FLASH_KV_ADDR          (0x0800F800)
+#define FLASH_KV_PAGES         (2)
+
+
+#endif /* _FLASH_MAP_H_ */
@@ -0,0 +1,43 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+/* generated by tools/mkassets.py, do not edit */
+#include "http_assets.h"
+
+/* setting.html, 370 bytes */
+static const uint8_t asset_0[271] =
+{
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x8d, 0x90,
+    0xb1, 0x4a, 0xc5, 0x30, 0x14, 0x86, 0xf7, 0x3e, 0x45, 0xc8, 0x2e, 0xd9,
+    0x25, 0x09, 0xdc, 0x37, 0xb8, 0x6f, 0x20, 0x69, 0x73, 0xee, 0x6d, 0xa0,
+    0x4d, 0x42, 0x7b, 0xda, 0x7a, 0x47, 0x41, 0xc4, 0x41, 0x45, 0x5c, 0x04,
+    0x07, 0x71, 0x71, 0x12, 0x6f, 0x47, 0x07, 0x51, 0x9f, 0xa6, 0xb6, 0x8f,
+    0x61, 0xd2, 0x5e, 0x9c, 0x1c, 0x5c, 0x72, 0xf8, 0xe1, 0xff, 0x4e, 0xce,
+    0xff, 0xf3, 0x1c, 0xcb, 0x42, 0x26, 0x3c, 0x07, 0xa5, 0x25, 0x2f, 0x01,
+    0x15, 0xb1, 0xaa, 0x04, 0x41, 0x5b, 0x03, 0x9d, 0x77, 0x15, 0x52, 0x92,
+    0x39, 0x8b, 0x60, 0x51, 0xd0, 0xce, 0x68, 0xcc, 0x85, 0x86, 0xd6, 0x64,
+    0x70, 0x34, 0x0b, 0x2a, 0x39, 0x9b, 0xc9, 0x84, 0xa7, 0x4e, 0xef, 0x64,
+    0x92, 0x70, 0x2f, 0xa7, 0xfe, 0x6d, 0xda, 0x7f, 0x8e, 0x1f, 0xfb, 0xf1,
+    0xfd, 0x72, 0x7c, 0xe9, 0xa7, 0xaf, 0xc7, 0xef, 0x9b, 0xe7, 0xf1, 0xe1,
+    0x7c, 0xb5, 0x0e, 0xcf, 0x70, 0x7b, 0x3d, 0xbc, 0xde, 0x0f, 0x77, 0x57,
+    0x43, 0x7f, 0x31, 0x3e, 0x9d, 0x71, 0xe6, 0x23, 0xb4, 0x71, 0x55, 0x49,
+    0x54, 0x86, 0xc6, 0x59, 0x41, 0x59, 0x0d, 0x88, 0xc6, 0x6e, 0x29, 0x09,
+    0xe7, 0xe4, 0x4e, 0x0b, 0xba, 0x85, 0x70, 0x06, 0xaa, 0x2a, 0x4c, 0x41,
+    0x4f, 0x6a, 0x28, 0x36, 0x54, 0x26, 0x84, 0xac, 0xd6, 0xcb, 0xb6, 0x63,
+    0x9e, 0x56, 0x51, 0x73, 0x63, 0x7d, 0x83, 0x04, 0x77, 0x3e, 0xdc, 0x8f,
+    0x70, 0x1a, 0xa0, 0x25, 0x8b, 0xf2, 0x71, 0xce, 0xcc, 0xc1, 0x1a, 0xd0,
+    0xf9, 0xff, 0x7f, 0xa0, 0xbe, 0xd3, 0xbf, 0xe4, 0x5f, 0xee, 0xba, 0x49,
+    0x4b, 0x13, 0xfc, 0xad, 0x2a, 0x9a, 0x20, 0x97, 0xe8, 0x81, 0xe0, 0x2c,
+    0xa6, 0x8a, 0xe9, 0xd8, 0xd2, 0x4d, 0xa8, 0x2a, 0x76, 0xfd, 0x03, 0x00,
+    0x0a, 0xda, 0x43, 0x72, 0x01, 0x00, 0x00,
+};
+
+const http_asset http_assets[] =
+{
+    {"/", "text/html; charset=utf-8", "\"dfe197b3\"", asset_0, sizeof(asset_0)},
+    {NULL, NULL, NULL, NULL, 0},
+};
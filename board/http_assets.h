@@ -0,0 +1,30 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _HTTP_ASSETS_H_
+  #define _HTTP_ASSETS_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* gzip compressed page in flash, made by tools/mkassets.py */
+typedef struct
+{
+    const char *url;
+    const char *type;
+    const char *etag;
+    const uint8_t *data;
+    uint16_t len;
+}http_asset;
+
+/* table ends with NULL url */
+extern const http_asset http_assets[];
+
+END_DECLS
+
+#endif /* _HTTP_ASSETS_H_ */
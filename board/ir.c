@@ -8,64 +8,234 @@
 #include "ir.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "timers.h"
 #include "trace.h"
+#include "assert.h"
 #include "pinconfig.h"
 #include "global.h"
+#include "config.h"
 #include "stm32f10x_cfg.h"
 #include "led_motor.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[ir]"
 
-#define MAX_OFF_COUNT    (10)
+#define IR_PIN_NAME      "IR_IN"
+#define IR_HOLD_TIME     (CONFIG_IR_HOLD_MS / portTICK_PERIOD_MS)
+#define IR_HOUR          (3600000 / portTICK_PERIOD_MS)
+#define IR_MAX_LISTENERS (4)
+
+/* sensor output is low while somebody stands in front */
+static uint8_t g_group = 0;
+static uint8_t g_pin = 0;
+static bool g_present = FALSE;
+/* edge handling queued to timer task, later edges fold into it */
+static volatile bool g_pending = FALSE;
+/* edge lost on full timer queue, timers sync level again */
+static volatile uint16_t g_missed = 0;
+static uint16_t g_missed_done = 0;
+
+static ir_event_cb g_listeners[IR_MAX_LISTENERS];
+
+/* presence count of current and last hour */
+static uint16_t g_traffic = 0;
+static uint16_t g_traffic_last = 0;
+
+static TimerHandle_t xHoldTimer = NULL;
+static StaticTimer_t xHoldTimerBuffer;
+static StaticTimer_t xHourTimerBuffer;
 
 /**
- * @brief motor control task
- * @param pvParameter - parameters pass to task
+ * @brief notify presence change to leds and listeners
+ * @param present - somebody in front of machine
  */
-static void vIRCtl(void *pvParameters)
+static void notify(bool present)
 {
-    uint8_t count = 0;
-    bool led_off = TRUE;
-    for (;;)
+    g_present = present;
+    if (present)
+    {
+        TRACE("human detected, turn on leds\r\n");
+        g_traffic ++;
+        led_motor_all_on();
+    }
+    else
     {
-        if (is_pinset("IR_IN"))
+        TRACE("human leaved, turn off leds\r\n");
+        led_motor_all_off();
+    }
+
+    for (int i = 0; i < IR_MAX_LISTENERS; ++i)
+    {
+        if (NULL != g_listeners[i])
         {
-            /* no human */
-            count ++;
-            if (count > MAX_OFF_COUNT)
-            {
-                count = MAX_OFF_COUNT;
-                if (!led_off)
-                {
-                    led_off = TRUE;
-                    TRACE("human leaved, turn off leds\r\n");
-                    led_motor_all_off();
-                }
-            }
+            g_listeners[i](present);
         }
-        else
+    }
+}
+
+/**
+ * @brief handle sensor edge in timer task, presence is reported at once,
+ *        absence only after it lasted hold time
+ * @param pvParameter1 - unused
+ * @param ulParameter2 - unused
+ */
+static void ir_edge(void *pvParameter1, uint32_t ulParameter2)
+{
+    g_pending = FALSE;
+    if (0 == GPIO_ReadPin((GPIO_Group)g_group, g_pin))
+    {
+        xTimerStop(xHoldTimer, 0);
+        if (!g_present)
+        {
+            notify(TRUE);
+        }
+    }
+    else if (g_present)
+    {
+        xTimerReset(xHoldTimer, 0);
+    }
+}
+
+/**
+ * @brief handle sensor level again if an edge was lost
+ * @return TRUE if level was handled
+ */
+static bool sync_missed(void)
+{
+    uint16_t missed = g_missed;
+    if (missed == g_missed_done)
+    {
+        return FALSE;
+    }
+
+    TRACE("missed edges: %d\r\n", (uint16_t)(missed - g_missed_done));
+    g_missed_done = missed;
+    ir_edge(NULL, 0);
+    return TRUE;
+}
+
+/**
+ * @brief ir sensor edge interrupt handler
+ */
+void EXTI2_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    EXTI_ClrPending(g_pin);
+    if (!g_pending)
+    {
+        g_pending = TRUE;
+        if (pdPASS != xTimerPendFunctionCallFromISR(ir_edge, NULL, 0, 
+                                                    &xHigherPriorityTaskWoken))
         {
-            count = 0;
-            if (led_off)
-            {
-                led_off = FALSE;
-                TRACE("human detected, turn on leds\r\n");
-                led_motor_all_on();
-            }
+            /* next edge or timer retries */
+            g_pending = FALSE;
+            g_missed ++;
         }
-        
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
+    /* check if there is any higher priority task need to wakeup */
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
 
 /**
- * @brief initialize motor control
+ * @brief hold timer callback, nobody came back in hold time
+ * @param xTimer - timer handle
+ */
+static void vIRHold(TimerHandle_t xTimer)
+{
+    if (sync_missed())
+    {
+        return;
+    }
+
+    if (g_present && (0 != GPIO_ReadPin((GPIO_Group)g_group, g_pin)))
+    {
+        notify(FALSE);
+    }
+}
+
+/**
+ * @brief hour timer callback, roll foot traffic counter
+ * @param xTimer - timer handle
+ */
+static void vIRHour(TimerHandle_t xTimer)
+{
+    sync_missed();
+    g_traffic_last = g_traffic;
+    g_traffic = 0;
+}
+
+/**
+ * @brief initialize ir presence detect
  */
 void ir_init(void)
 {
     TRACE("initialize ir...\r\n");
+    get_pininfo(IR_PIN_NAME, &g_group, &g_pin);
+
+    xHoldTimer = xTimerCreateStatic("IRHold", IR_HOLD_TIME, pdFALSE, NULL, 
+                                    vIRHold, &xHoldTimerBuffer);
+    TimerHandle_t xHourTimer = xTimerCreateStatic("IRHour", IR_HOUR, pdTRUE,
+                                                  NULL, vIRHour, 
+                                                  &xHourTimerBuffer);
+    assert_param((NULL != xHoldTimer) && (NULL != xHourTimer));
+    xTimerStart(xHourTimer, 0);
 
-    xTaskCreate(vIRCtl, "IRCtl", IR_STACK_SIZE, 
-                NULL, IR_PRIORITY, NULL);
-}
\ No newline at end of file
+    /* both edges, level is read again in timer task */
+    EXTI_ClrPending(g_pin);
+    GPIO_EXTIConfig((GPIO_Group)g_group, g_pin);
+    EXTI_SetTrigger(g_pin, (Trigger_Edge)(Trigger_Rising | Trigger_Falling));
+    NVIC_Config nvicConfig = {EXTI2_IRQChannel, EXTI2_PRIORITY, 0, TRUE};
+    NVIC_Init(&nvicConfig);
+    EXTI_EnableLine_INT(g_pin, TRUE);
+
+    /* somebody may already stand in front, init task may wait */
+    g_pending = TRUE;
+    if (pdPASS != xTimerPendFunctionCall(ir_edge, NULL, 0, portMAX_DELAY))
+    {
+        g_pending = FALSE;
+        g_missed ++;
+    }
+}
+
+/**
+ * @brief register presence listener, it runs in timer task and must not
+ *        block
+ * @param cb - presence callback
+ * @return TRUE if registered
+ */
+bool ir_register(ir_event_cb cb)
+{
+    assert_param(NULL != cb);
+    bool ret = FALSE;
+    taskENTER_CRITICAL();
+    for (int i = 0; i < IR_MAX_LISTENERS; ++i)
+    {
+        if (NULL == g_listeners[i])
+        {
+            g_listeners[i] = cb;
+            ret = TRUE;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return ret;
+}
+
+/**
+ * @brief check presence
+ * @return TRUE if somebody is in front of machine
+ */
+bool ir_present(void)
+{
+    return g_present;
+}
+
+/**
+ * @brief get foot traffic
+ * @return presence count of last full hour
+ */
+uint16_t ir_traffic(void)
+{
+    return g_traffic_last;
+}
@@ -10,7 +10,16 @@
 
 #include "types.h"
 
+BEGIN_DECLS
+
+/* presence change, TRUE when somebody walks up */
+typedef void (*ir_event_cb)(bool present);
+
 void ir_init(void);
+bool ir_register(ir_event_cb cb);
+bool ir_present(void);
+uint16_t ir_traffic(void);
 
+END_DECLS
 
-#endif
\ No newline at end of file
+#endif /* _IR_H_ */
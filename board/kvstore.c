@@ -0,0 +1,429 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "kvstore.h"
+#include "flash_map.h"
+#include "flash.h"
+#include "crc32.h"
+#include "stm32f10x_cfg.h"
+#include "trace.h"
+#include "assert.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[kv]"
+
+/* updates are appended to active page, when it is full live values are
+ * copied to next page of ring, so erase wear spreads over all pages
+ *
+ * page:   magic | seq | record | record | ...
+ * record: key | len | tag | data, 0xff padded to word | crc32
+ *
+ * crc covers header word and data, torn record fails crc and is skipped
+ */
+#define PAGE_MAGIC          (0x564b)
+#define PAGE_HEAD_SIZE      (4)
+#define OFFSET_SEQ          (2)
+
+#define TAG_SET             (0x5356)
+#define TAG_DELETE          (0x4544)
+#define WORD_FREE           (0xffffffff)
+
+#define RECORD_HEADER(key, len, tag) ((key) | ((len) << 8) | ((uint32_t)(tag) << 16))
+#define RECORD_KEY(header)  ((header) & 0xff)
+#define RECORD_LEN(header)  (((header) >> 8) & 0xff)
+#define RECORD_TAG(header)  ((header) >> 16)
+
+/* values cached in ram, reads never touch flash */
+typedef struct
+{
+    uint8_t offset;
+    uint8_t len;
+    bool valid;
+}kv_index;
+
+static kv_index g_index[KV_MAX_KEY];
+static uint8_t g_cache[KV_CACHE_SIZE];
+static uint8_t g_cache_used = 0;
+
+/* active page and next free record address */
+static uint8_t g_page = 0;
+static uint16_t g_seq = 0;
+static uint32_t g_write = 0;
+
+static SemaphoreHandle_t xKvMutex = NULL;
+static StaticSemaphore_t xKvMutexBuffer;
+
+/**
+ * @brief get page start address
+ * @param page - page index
+ * @return page address
+ */
+static __INLINE uint32_t page_addr(uint8_t page)
+{
+    return FLASH_KV_ADDR + page * FLASH_PAGE_SIZE;
+}
+
+/**
+ * @brief get record size in flash
+ * @param len - value length
+ * @return record size
+ */
+static __INLINE uint32_t record_size(uint8_t len)
+{
+    return 4 + ((len + 3) & ~0x03) + 4;
+}
+
+/**
+ * @brief read word from flash
+ * @param addr - word address
+ * @return word
+ */
+static __INLINE uint32_t read_word(uint32_t addr)
+{
+    return *(volatile const uint32_t *)addr;
+}
+
+/**
+ * @brief program word to flash
+ * @param addr - word address
+ * @param val - word value
+ */
+static void write_word(uint32_t addr, uint32_t val)
+{
+    flash_program(addr, (uint8_t *)&val, 4);
+}
+
+/**
+ * @brief calculate record crc
+ * @param header - record header
+ * @param data - record value
+ * @param len - value length
+ * @return crc value
+ */
+static uint32_t record_crc(uint32_t header, const uint8_t *data, uint8_t len)
+{
+    crc32_ctx ctx;
+    uint32_t pad = WORD_FREE;
+    crc32_init(&ctx);
+    crc32_update(&ctx, &header, 4);
+    crc32_update(&ctx, data, len);
+    crc32_update(&ctx, &pad, (4 - (len & 0x03)) & 0x03);
+    return crc32_final(&ctx);
+}
+
+/**
+ * @brief write record, crc is written last
+ * @param addr - record address
+ * @param header - record header
+ * @param data - record value
+ */
+static void write_record(uint32_t addr, uint32_t header, const uint8_t *data)
+{
+    uint8_t len = RECORD_LEN(header);
+    uint32_t crc = record_crc(header, data, len);
+    write_word(addr, header);
+    addr += 4;
+    while (len >= 4)
+    {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        write_word(addr, word);
+        data += 4;
+        addr += 4;
+        len -= 4;
+    }
+    if (len > 0)
+    {
+        uint32_t word = WORD_FREE;
+        memcpy(&word, data, len);
+        write_word(addr, word);
+        addr += 4;
+    }
+    write_word(addr, crc);
+}
+
+/**
+ * @brief remove value from cache
+ * @param key - value key
+ */
+static void cache_remove(uint8_t key)
+{
+    kv_index *index = &g_index[key];
+    if (!index->valid)
+    {
+        return ;
+    }
+
+    memmove(g_cache + index->offset, g_cache + index->offset + index->len,
+            g_cache_used - index->offset - index->len);
+    for (uint8_t i = 0; i < KV_MAX_KEY; ++i)
+    {
+        if (g_index[i].valid && (g_index[i].offset > index->offset))
+        {
+            g_index[i].offset -= index->len;
+        }
+    }
+    g_cache_used -= index->len;
+    index->valid = FALSE;
+}
+
+/**
+ * @brief put value to cache
+ * @param key - value key
+ * @param data - value
+ * @param len - value length
+ */
+static void cache_put(uint8_t key, const uint8_t *data, uint8_t len)
+{
+    cache_remove(key);
+    assert_param(g_cache_used + len <= KV_CACHE_SIZE);
+    memcpy(g_cache + g_cache_used, data, len);
+    g_index[key].offset = g_cache_used;
+    g_index[key].len = len;
+    g_index[key].valid = TRUE;
+    g_cache_used += len;
+}
+
+/**
+ * @brief erase page and write header with next sequence
+ * @param page - page index
+ */
+static void format_page(uint8_t page)
+{
+    uint32_t addr = page_addr(page);
+    flash_erase(addr);
+    g_page = page;
+    g_write = addr + PAGE_HEAD_SIZE;
+}
+
+/**
+ * @brief make page valid, written after page content
+ * @param page - page index
+ */
+static void commit_page(uint8_t page)
+{
+    uint32_t addr = page_addr(page);
+    g_seq ++;
+    uint16_t val = g_seq;
+    flash_program(addr + OFFSET_SEQ, (uint8_t *)&val, 2);
+    val = PAGE_MAGIC;
+    flash_program(addr, (uint8_t *)&val, 2);
+}
+
+/**
+ * @brief copy live values to next page, old page stays valid until new
+ *        page is committed
+ */
+static void collect_garbage(void)
+{
+    uint8_t page = (g_page + 1) % FLASH_KV_PAGES;
+    TRACE("collect garbage to page %d\r\n", page);
+    format_page(page);
+    for (uint8_t key = 0; key < KV_MAX_KEY; ++key)
+    {
+        if (g_index[key].valid)
+        {
+            uint8_t len = g_index[key].len;
+            write_record(g_write, RECORD_HEADER(key, len, TAG_SET),
+                         g_cache + g_index[key].offset);
+            g_write += record_size(len);
+        }
+    }
+    commit_page(page);
+}
+
+/**
+ * @brief load values of active page to cache
+ */
+static void load_page(void)
+{
+    uint32_t end = page_addr(g_page) + FLASH_PAGE_SIZE;
+    uint32_t addr = page_addr(g_page) + PAGE_HEAD_SIZE;
+    while (addr + 8 <= end)
+    {
+        uint32_t header = read_word(addr);
+        if (WORD_FREE == header)
+        {
+            break;
+        }
+
+        uint8_t len = RECORD_LEN(header);
+        uint32_t size = record_size(len);
+        if (addr + size > end)
+        {
+            /* broken header, no more space in this page */
+            addr = end;
+            break;
+        }
+
+        uint8_t key = RECORD_KEY(header);
+        const uint8_t *data = (const uint8_t *)(addr + 4);
+        if ((key < KV_MAX_KEY) &&
+            (read_word(addr + size - 4) == record_crc(header, data, len)))
+        {
+            if (TAG_SET == RECORD_TAG(header))
+            {
+                cache_put(key, data, len);
+            }
+            else if (TAG_DELETE == RECORD_TAG(header))
+            {
+                cache_remove(key);
+            }
+        }
+        addr += size;
+    }
+    g_write = addr;
+}
+
+/**
+ * @brief initialize kv store, find newest page and load values
+ * @return init status
+ */
+bool kv_init(void)
+{
+    TRACE("initialize kv store...\r\n");
+    xKvMutex = xSemaphoreCreateMutexStatic(&xKvMutexBuffer);
+    if (NULL == xKvMutex)
+    {
+        return FALSE;
+    }
+
+    bool found = FALSE;
+    for (uint8_t i = 0; i < FLASH_KV_PAGES; ++i)
+    {
+        uint32_t addr = page_addr(i);
+        if (PAGE_MAGIC == *(volatile const uint16_t *)addr)
+        {
+            uint16_t seq = *(volatile const uint16_t *)(addr + OFFSET_SEQ);
+            if (!found || ((int16_t)(seq - g_seq) > 0))
+            {
+                g_seq = seq;
+                g_page = i;
+                found = TRUE;
+            }
+        }
+    }
+
+    if (found)
+    {
+        load_page();
+    }
+    else
+    {
+        format_page(0);
+        commit_page(0);
+    }
+    TRACE("page %d, seq %d, used %d\r\n", g_page, g_seq, g_cache_used);
+
+    return TRUE;
+}
+
+/**
+ * @brief get value
+ * @param key - value key
+ * @param value - value output
+ * @param size - output size
+ * @return value length, 0 if key not exists
+ */
+uint8_t kv_get(uint8_t key, void *value, uint8_t size)
+{
+    assert_param(key < KV_MAX_KEY);
+    assert_param(NULL != value);
+    uint8_t len = 0;
+    xSemaphoreTake(xKvMutex, portMAX_DELAY);
+    if (g_index[key].valid)
+    {
+        len = (g_index[key].len > size) ? size : g_index[key].len;
+        memcpy(value, g_cache + g_index[key].offset, len);
+    }
+    xSemaphoreGive(xKvMutex);
+
+    return len;
+}
+
+/**
+ * @brief append record, collect garbage when page is full
+ * @param header - record header
+ * @param data - record value
+ */
+static void append(uint32_t header, const uint8_t *data)
+{
+    uint32_t size = record_size(RECORD_LEN(header));
+    if (g_write + size > page_addr(g_page) + FLASH_PAGE_SIZE)
+    {
+        collect_garbage();
+    }
+    write_record(g_write, header, data);
+    g_write += size;
+}
+
+/**
+ * @brief set value, same value is not written again
+ * @param key - value key
+ * @param value - value
+ * @param len - value length
+ * @return set status, FALSE if cache is full
+ */
+bool kv_set(uint8_t key, const void *value, uint8_t len)
+{
+    assert_param(key < KV_MAX_KEY);
+    assert_param(NULL != value);
+    bool ret = TRUE;
+    xSemaphoreTake(xKvMutex, portMAX_DELAY);
+    kv_index *index = &g_index[key];
+    uint8_t old = index->valid ? index->len : 0;
+    if (index->valid && (len == index->len) &&
+        (0 == memcmp(g_cache + index->offset, value, len)))
+    {
+        /* nothing changed */
+    }
+    else if (g_cache_used - old + len > KV_CACHE_SIZE)
+    {
+        TRACE("no space for key %d\r\n", key);
+        ret = FALSE;
+    }
+    else
+    {
+        append(RECORD_HEADER(key, len, TAG_SET), (const uint8_t *)value);
+        cache_put(key, (const uint8_t *)value, len);
+    }
+    xSemaphoreGive(xKvMutex);
+
+    return ret;
+}
+
+/**
+ * @brief delete value
+ * @param key - value key
+ * @return delete status
+ */
+bool kv_delete(uint8_t key)
+{
+    assert_param(key < KV_MAX_KEY);
+    xSemaphoreTake(xKvMutex, portMAX_DELAY);
+    if (g_index[key].valid)
+    {
+        cache_remove(key);
+        append(RECORD_HEADER(key, 0, TAG_DELETE), NULL);
+    }
+    xSemaphoreGive(xKvMutex);
+
+    return TRUE;
+}
+
+/**
+ * @brief check if key exists
+ * @param key - value key
+ */
+bool kv_exists(uint8_t key)
+{
+    assert_param(key < KV_MAX_KEY);
+    return g_index[key].valid;
+}
@@ -0,0 +1,27 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _KVSTORE_H_
+  #define _KVSTORE_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* key range and total size of all values */
+#define KV_MAX_KEY      (16)
+#define KV_CACHE_SIZE   (192)
+
+bool kv_init(void);
+uint8_t kv_get(uint8_t key, void *value, uint8_t size);
+bool kv_set(uint8_t key, const void *value, uint8_t len);
+bool kv_delete(uint8_t key);
+bool kv_exists(uint8_t key);
+
+END_DECLS
+
+#endif /* _KVSTORE_H_ */
@@ -10,11 +10,14 @@
 #include "trace.h"
 #include "cm3_core.h"
 #include "pinconfig.h"
+#include "config.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[led_motor]"
 
-#define LED_NUM 10
+#if CONFIG_LED_NUM > 16
+#error "led status is 16 bits"
+#endif
 
 /* led status */
 static uint16_t led_status = 0;
@@ -84,7 +87,7 @@ void led_motor_init(void)
  */
 void led_motor_turn_on(uint8_t num)
 {
-    assert_param(num < LED_NUM);
+    assert_param(num < CONFIG_LED_NUM);
     TRACE("turn on led: %d\r\n", num);
     led_status |= (1 << num);
     hc595_senddata(led_status);
@@ -96,7 +99,7 @@ void led_motor_turn_on(uint8_t num)
  */
 void led_motor_turn_off(uint8_t num)
 {
-    assert_param(num < LED_NUM);
+    assert_param(num < CONFIG_LED_NUM);
     TRACE("turn off led: %d\r\n", num);
     led_status &= ~(1 << num);
     hc595_senddata(led_status);
@@ -9,6 +9,7 @@
 #include "led_net.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "timers.h"
 #include "assert.h"
 #include "trace.h"
 #include "pinconfig.h"
@@ -17,6 +18,10 @@
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[led_net]"
 
+#define LED_PERIOD    (300 / portTICK_PERIOD_MS)
+
+static StaticTimer_t xLedTimerBuffer;
+
 typedef struct
 {
     const char *name;
@@ -31,32 +36,27 @@ static led_status leds[] =
 };
 
 /**
- * @brief led control task
- * @param pvParameters - task parameters
+ * @brief led control timer callback
+ * @param xTimer - timer handle
  */
-static void vLed(void *pvParameters)
+static void vLed(TimerHandle_t xTimer)
 {
-    for (;;)
+    for (int i = 0; i < sizeof(leds) / sizeof(leds[0]); ++i)
     {
-        for (int i = 0; i < sizeof(leds) / sizeof(leds[0]); ++i)
+        switch (leds[i].action)
         {
-            switch (leds[i].action)
-            {
-            case on:
-                pin_set(leds[i].name);
-                break;
-            case off:
-                pin_reset(leds[i].name);
-                break;
-            case flash:
-                pin_toggle(leds[i].name);
-                break;
-            default:
-                break;
-            }
-            
+        case on:
+            pin_set(leds[i].name);
+            break;
+        case off:
+            pin_reset(leds[i].name);
+            break;
+        case flash:
+            pin_toggle(leds[i].name);
+            break;
+        default:
+            break;
         }
-        vTaskDelay(300 / portTICK_PERIOD_MS);
     }
 }
 
@@ -72,7 +72,10 @@ void led_net_init(void)
         pin_reset(leds[i].name);
     }
     
-    xTaskCreate(vLed, "led", LED_STACK_SIZE, NULL, LED_PRIORITY, NULL);
+    TimerHandle_t xTimer = xTimerCreateStatic("led", LED_PERIOD, pdTRUE, NULL, 
+                                              vLed, &xLedTimerBuffer);
+    assert_param(NULL != xTimer);
+    xTimerStart(xTimer, 0);
 }
 
 /**
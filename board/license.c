@@ -7,6 +7,7 @@
 */
 #include "FreeRTOS.h"
 #include "task.h"
+#include "timers.h"
 #include "global.h"
 #include "trace.h"
 #include "serial.h"
@@ -17,30 +18,22 @@
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[license]"
 
-uint32_t g_count = 0;
+/* license valid time */
+#define LICENSE_TIME    (3600UL * 24 * 1000 / portTICK_PERIOD_MS)
+
+static StaticTimer_t xLicenseTimerBuffer;
 
 /**
- * @brief license check task
- * @param pvParameter - task parameter
+ * @brief license expired timer callback
+ * @param xTimer - timer handle
  */
-static void vLicense(void *pvParameters)
+static void vLicense(TimerHandle_t xTimer)
 {
-    for (;;)
-    {
-        g_count++;
-        if (g_count >= 3600 * 24)
-        {
-            /* license expired */
-            /* shutdown network task */
-            esp8266_shutdown();
-            m26_shutdown();
-            TRACE("license expired!\r\n");
-            break;
-        }
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-    }
-
-    vTaskDelete(NULL);
+    /* license expired */
+    /* shutdown network task */
+    esp8266_shutdown();
+    m26_shutdown();
+    TRACE("license expired!\r\n");
 }
 
 /**
@@ -49,8 +42,11 @@ static void vLicense(void *pvParameters)
 void license_init(void)
 {
     TRACE("initialise license system...\r\n");
-    xTaskCreate(vLicense, "license", LICENSE_STACK_SIZE, NULL, 
-                LICENSE_PRIORITY, NULL);
+    TimerHandle_t xTimer = xTimerCreateStatic("license", LICENSE_TIME, pdFALSE, 
+                                              NULL, vLicense, 
+                                              &xLicenseTimerBuffer);
+    assert_param(NULL != xTimer);
+    xTimerStart(xTimer, 0);
 }
 
 
@@ -0,0 +1,195 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "linkbaud.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "trace.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[linkbaud]"
+
+/* round trips to validate a baudrate */
+#define VALIDATE_COUNT      (5)
+/* module needs some time to switch baudrate after ack */
+#define SWITCH_DELAY        (50 / portTICK_PERIOD_MS)
+/* max baudrate error in permille */
+#define MAX_RATE_ERROR      (20)
+/* receive errors tolerated between two checks */
+#define MAX_LINK_ERRORS     (3)
+
+/**
+ * @brief get total receive errors of link
+ * @param link - link
+ * @return error count
+ */
+static uint32_t link_errors(linkbaud *link)
+{
+    serial_errors errors;
+    serial_get_errors(link->port, &errors);
+    return errors.overrun + errors.frame + errors.noise;
+}
+
+/**
+ * @brief get baudrate of index
+ * @param link - link
+ * @param index - rate index
+ * @return baudrate
+ */
+static uint32_t rate_of(const linkbaud *link, uint8_t index)
+{
+    return (index < link->rate_count) ? link->rates[index] : link->base;
+}
+
+/**
+ * @brief switch host side serial port to baudrate
+ * @param link - link
+ * @param baudrate - baudrate
+ * @return TRUE: usart can generate baudrate FALSE: error is too large
+ */
+static bool switch_host(linkbaud *link, uint32_t baudrate)
+{
+    serial_set_baudrate(link->port, baudrate);
+    serial_reconfig(link->port);
+    uint32_t actual = serial_get_baudrate(link->port);
+    uint32_t diff = (actual > baudrate) ? (actual - baudrate) : 
+                                          (baudrate - actual);
+    return (diff * 1000 / baudrate) <= MAX_RATE_ERROR;
+}
+
+/**
+ * @brief validate link at current baudrate
+ * @param link - link
+ * @return TRUE: link works without receive errors
+ */
+static bool validate(linkbaud *link)
+{
+    serial_clear_errors(link->port);
+    for (int i = 0; i < VALIDATE_COUNT; ++i)
+    {
+        if (!link->test())
+        {
+            return FALSE;
+        }
+    }
+
+    return (0 == link_errors(link));
+}
+
+/**
+ * @brief move module and host to baudrate
+ * @param link - link
+ * @param index - rate index
+ * @return TRUE: link validated at new baudrate
+ */
+static bool move_to(linkbaud *link, uint8_t index)
+{
+    uint32_t baudrate = rate_of(link, index);
+    if (!link->set_rate(baudrate))
+    {
+        return FALSE;
+    }
+    vTaskDelay(SWITCH_DELAY);
+    if (!switch_host(link, baudrate))
+    {
+        TRACE("%s: %d not reachable with usart clock\r\n", link->name, 
+              baudrate);
+        return FALSE;
+    }
+
+    return validate(link);
+}
+
+/**
+ * @brief restore previous baudrate after a failed switch
+ * @param link - link
+ * @param index - rate index to restore
+ * @return TRUE: link validated at restored baudrate
+ */
+static bool restore(linkbaud *link, uint8_t index)
+{
+    uint32_t baudrate = rate_of(link, index);
+    /* module may be at new baudrate, try to send it back */
+    link->set_rate(baudrate);
+    vTaskDelay(SWITCH_DELAY);
+    switch_host(link, baudrate);
+    return validate(link);
+}
+
+/**
+ * @brief probe candidate baudrates from fastest and switch to the first 
+ *        one which passes validation, link must work at base baudrate
+ * @param link - link
+ * @return baudrate in use, 0 if link is lost
+ */
+uint32_t linkbaud_negotiate(linkbaud *link)
+{
+    assert_param(NULL != link);
+    assert_param((NULL != link->set_rate) && (NULL != link->test));
+    
+    link->current = link->rate_count;
+    for (uint8_t i = 0; i < link->rate_count; ++i)
+    {
+        if (link->rates[i] <= link->base)
+        {
+            break;
+        }
+        
+        TRACE("%s: try %d\r\n", link->name, link->rates[i]);
+        if (move_to(link, i))
+        {
+            link->current = i;
+            break;
+        }
+
+        TRACE("%s: %d failed\r\n", link->name, link->rates[i]);
+        if (!restore(link, link->rate_count))
+        {
+            TRACE("%s: link lost\r\n", link->name);
+            return 0;
+        }
+    }
+
+    TRACE("%s: baudrate %d\r\n", link->name, rate_of(link, link->current));
+    serial_clear_errors(link->port);
+    return rate_of(link, link->current);
+}
+
+/**
+ * @brief check receive errors since last check, step down to next slower
+ *        baudrate when link is unreliable, call from link owner task
+ * @param link - link
+ * @return TRUE: link is usable FALSE: link lost
+ */
+bool linkbaud_check(linkbaud *link)
+{
+    assert_param(NULL != link);
+    uint32_t errors = link_errors(link);
+    if ((errors <= MAX_LINK_ERRORS) || (link->current >= link->rate_count))
+    {
+        serial_clear_errors(link->port);
+        return TRUE;
+    }
+
+    uint32_t baudrate = rate_of(link, link->current);
+    TRACE("%s: %d errors at %d, fall back\r\n", link->name, errors, baudrate);
+    uint8_t next = link->current + 1;
+    if ((next < link->rate_count) && (link->rates[next] <= link->base))
+    {
+        next = link->rate_count;
+    }
+
+    if (move_to(link, next) || restore(link, next))
+    {
+        link->current = next;
+        serial_clear_errors(link->port);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
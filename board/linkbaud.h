@@ -0,0 +1,40 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _LINKBAUD_H_
+  #define _LINKBAUD_H_
+
+#include "types.h"
+#include "serial.h"
+
+BEGIN_DECLS
+
+/* modem link description */
+typedef struct
+{
+    const char *name;
+    serial *port;
+    /* candidate baudrates, fastest first */
+    const uint32_t *rates;
+    uint8_t rate_count;
+    /* ask module to switch baudrate, acked at current baudrate */
+    bool (*set_rate)(uint32_t baudrate);
+    /* one validation round trip */
+    bool (*test)(void);
+    /* baudrate module starts with */
+    uint32_t base;
+    /* current rate index, rate_count means base rate */
+    uint8_t current;
+}linkbaud;
+
+uint32_t linkbaud_negotiate(linkbaud *link);
+bool linkbaud_check(linkbaud *link);
+
+END_DECLS
+
+#endif /* _LINKBAUD_H_ */
+
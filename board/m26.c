@@ -15,14 +15,12 @@
 #include "global.h"
 #include "trace.h"
 #include "pinconfig.h"
-#include "dbgserial.h"
+#include "linkbaud.h"
+#include "netif.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE "[m26]"
 
-#define _PRINT_DETAIL 
-
-
 /* mqtt driver */
 static m26_driver g_driver;
 
@@ -62,24 +60,26 @@ static struct
 typedef enum
 {
     mode_at,
-    mode_tcp_head,
     mode_tcp_data,
 }work_mode;
 
 static work_mode g_curmode = mode_at;
+/* socket and remaining length of data in receive */
+static uint8_t g_tcp_id = 0;
+static uint16_t g_tcp_size = 0;
 
 /* serial handle */
 static serial *g_serial = NULL;
 
 /* recive queue */
 static xQueueHandle xStatusQueue = NULL;
-static xQueueHandle xTcpQueue = NULL;
+static xQueueHandle xTcpQueue[M26_MAX_SOCKET_NUM];
 static xQueueHandle xAtQueue = NULL;
 static xQueueHandle xSyncQueue = NULL;
 
 #define M26_MAX_NODE_NUM              (6)
 #define M26_MAX_MSG_SIZE_PER_LINE     (64)
-#define M26_MAX_CONNECT_NUM           (5)
+#define M26_MAX_TCP_NODE_NUM          (3)
 
 typedef struct
 {
@@ -87,6 +87,22 @@ typedef struct
     char data[M26_MAX_MSG_SIZE_PER_LINE];
 }tcp_node;
 
+/* task and queue storage */
+static StackType_t xM26Stack[M26_STACK_SIZE];
+static StaticTask_t xM26TaskBuffer;
+static uint8_t ucStatusStorage[M26_MAX_NODE_NUM * sizeof(uint8_t)];
+static StaticQueue_t xStatusQueueBuffer;
+static uint8_t ucAtStorage[M26_MAX_NODE_NUM * M26_MAX_MSG_SIZE_PER_LINE];
+static StaticQueue_t xAtQueueBuffer;
+static uint8_t ucTcpStorage[M26_MAX_SOCKET_NUM]
+                           [M26_MAX_TCP_NODE_NUM * sizeof(tcp_node)];
+static StaticQueue_t xTcpQueueBuffer[M26_MAX_SOCKET_NUM];
+/* data of socket was dropped since last receive */
+static volatile bool g_tcp_lost[M26_MAX_SOCKET_NUM];
+static uint32_t g_tcp_drops = 0;
+static uint8_t ucSyncStorage[1];
+static StaticQueue_t xSyncQueueBuffer;
+
 /* timeout time(ms) */
 #define DEFAULT_TIMEOUT      (3000 / portTICK_PERIOD_MS)
 
@@ -107,20 +123,6 @@ static void m26_gprs_attach(uint8_t code)
     UNUSED(code);
 }
 
-/**
- * @brief m26 server connect callback
- */
-static void m26_server_connect(void)
-{
-}
-
-/**
- * @brief m26 server disconnect callback
- */
-static void m26_server_disconnect(void)
-{
-}
-
 /**
  * @brief initialize esp8266 default driver
  */
@@ -128,8 +130,6 @@ static void init_m26_driver(void)
 {
     g_driver.net_register = m26_net_register;
     g_driver.gprs_attach = m26_gprs_attach;
-    g_driver.server_connect = m26_server_connect;
-    g_driver.server_disconnect = m26_server_disconnect;
 }
 
 /**
@@ -146,16 +146,6 @@ static void refresh_driver(void)
     {
         g_driver.gprs_attach = m26_gprs_attach;
     }
-
-    if (NULL == g_driver.server_connect)
-    {
-        g_driver.server_connect = m26_server_connect;
-    }
-
-    if (NULL == g_driver.server_disconnect)
-    {
-        g_driver.server_disconnect = m26_server_disconnect;
-    }
 }
 
 /**
@@ -167,8 +157,6 @@ void m26_attach(const m26_driver *driver)
     assert_param(NULL != driver);
     g_driver.net_register = driver->net_register;
     g_driver.gprs_attach = driver->gprs_attach;
-    g_driver.server_connect = driver->server_connect;
-    g_driver.server_disconnect = driver->server_disconnect;
     refresh_driver();
 }
 
@@ -219,29 +207,104 @@ static bool try_process_status(const char *data, uint8_t len)
 }
 
 /**
- * @brief process server connect
+ * @brief parse socket id from data
+ * @param data - data to parse
+ * @param id - socket id
+ * @return socket message after id, NULL if data has no socket id
+ */
+static const char *parse_id(const char *data, uint8_t *id)
+{
+    if ((data[0] < '0') || (data[0] > '9') || (',' != data[1]))
+    {
+        return NULL;
+    }
+
+    *id = data[0] - '0';
+    data += 2;
+    while (' ' == *data)
+    {
+        data++;
+    }
+
+    return data;
+}
+
+/**
+ * @brief process server connect, socket messages are "<id>, <message>" in 
+ *        multiple connection mode
  * @param data - data to process
  * @param len - data length
  */
 static bool try_process_server_connect(const char *data, uint8_t len)
 {
-    if (0 == strncmp(data, "CONNECT OK", len - 2))
+    uint8_t id = 0;
+    uint8_t status = 0;
+    const char *pdata = parse_id(data, &id);
+    if (NULL == pdata)
     {
-        g_driver.server_connect();
-        return TRUE;
+        if (0 == strncmp(data, "+PDP DEACT", 10))
+        {
+            /* gprs context lost, all sockets are closed */
+            for (id = 0; id < M26_MAX_SOCKET_NUM; ++id)
+            {
+                netif_notify(&m26_netif, id, NETIF_DISCONNECTED);
+            }
+            return TRUE;
+        }
+        return FALSE;
     }
-    else if (0 == strncmp(data, "CLOSED", len - 2))
+
+    if (0 == strncmp(pdata, "CONNECT OK", 10))
     {
-        g_driver.server_disconnect();
-        return TRUE;
+        netif_notify(&m26_netif, id, NETIF_CONNECTED);
     }
-    else if (0 == strncmp(data, "+PDP DEACT", len - 2))
+    else if ((0 == strncmp(pdata, "CLOSED", 6)) ||
+             (0 == strncmp(pdata, "CONNECT FAIL", 12)))
     {
-        g_driver.server_disconnect();
-        return TRUE;
+        netif_notify(&m26_netif, id, NETIF_DISCONNECTED);
+    }
+    else if (0 == strncmp(pdata, "CLOSE OK", 8))
+    {
+        status = M26_ERR_OK;
+        xQueueSend(xStatusQueue, &status, 0);
+    }
+    else if (0 == strncmp(pdata, "ALREADY CONNECT", 15))
+    {
+        status = M26_ERR_ALREADY;
+        xQueueSend(xStatusQueue, &status, 0);
+    }
+    else
+    {
+        return FALSE;
     }
 
-    return FALSE;
+    return TRUE;
+}
+
+/**
+ * @brief parse registration status, unsolicited result is "<stat>" and 
+ *        query response is "<n>,<stat>"
+ * @param data - data after "+CREG:" or "+CGREG:"
+ * @return registration status
+ */
+static uint8_t parse_reg_stat(const char *data)
+{
+    uint8_t fields[2] = {0, 0};
+    uint8_t count = 0;
+    while (('\r' != *data) && ('\0' != *data) && (count < 2))
+    {
+        if ((*data >= '0') && (*data <= '9'))
+        {
+            fields[count] = fields[count] * 10 + (*data - '0');
+        }
+        else if (',' == *data)
+        {
+            count ++;
+        }
+        data ++;
+    }
+
+    return (count > 0) ? fields[1] : fields[0];
 }
 
 /**
@@ -253,12 +316,10 @@ static bool try_process_net_register(const char *data, uint8_t len)
 {
     if (0 == strncmp(data, "+CREG:", 6))
     {
-        if ((1 == data[6]) || (5 == data[6]))
-        {
-            TRACE("net registered: %d\r\n", data[6]);
-            g_driver.net_register(data[6]);
-            return TRUE;
-        }
+        uint8_t stat = parse_reg_stat(data + 6);
+        TRACE("net register: %d\r\n", stat);
+        g_driver.net_register(stat);
+        return TRUE;
     }
 
     return FALSE;
@@ -273,12 +334,10 @@ static bool try_process_gprs_attach(const char *data, uint8_t len)
 {
     if (0 == strncmp(data, "+CGREG:", 7))
     {
-        if ((1 == data[7]) || (5 == data[7]))
-        {
-            TRACE("gprs attached: %d\r\n", data[7]);
-            g_driver.gprs_attach(data[7]);
-            return TRUE;
-        }
+        uint8_t stat = parse_reg_stat(data + 7);
+        TRACE("gprs attach: %d\r\n", stat);
+        g_driver.gprs_attach(stat);
+        return TRUE;
     }
 
     return FALSE;
@@ -300,8 +359,8 @@ static bool try_process_default(const char *data, uint8_t len)
 /* process functions list */
 static process_func process_funcs[] = 
 {
-    try_process_status,
     try_process_server_connect,
+    try_process_status,
     try_process_net_register,
     try_process_gprs_attach,
     try_process_default,
@@ -326,6 +385,50 @@ static void process_line(const char *data, uint8_t len)
     }
 }
 
+/**
+ * @brief process tcp head " <id>, <length>\r\n"
+ * @param data - head data after "+RECEIVE:"
+ * @param len - data length
+ */
+static void process_tcp_head(const char *data, uint8_t len)
+{
+    uint16_t val = 0;
+    uint8_t id = 0;
+    bool calc_id = TRUE;
+    for (int i = 0; i < len; ++i)
+    {
+        if (' ' == data[i])
+        {
+            continue;
+        }
+        
+        if ((',' == data[i]) && calc_id)
+        {
+            id = val;
+            val = 0;
+            calc_id = FALSE;
+        }
+        else if ((data[i] >= '0') && (data[i] <= '9'))
+        {
+            val *= 10;
+            val += (data[i] - '0');
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (calc_id || (0 == val))
+    {
+        return;
+    }
+
+    g_tcp_id = id;
+    g_tcp_size = val;
+    g_curmode = mode_tcp_data;
+}
+
 /**
  * @brief process at data
  * @param data - node data
@@ -343,18 +446,15 @@ static int process_at_data(const char *data, uint8_t len)
         }
     }
     
-    if (len == 3)
+    if (0 == strncmp(data + len - 2, "\r\n", 2))
     {
-        if (0 == strncmp(data, "IPD", 3))
+        if ((len > 9) && (0 == strncmp(data, "+RECEIVE:", 9)))
         {
-            /* mode changed */
-            g_curmode = mode_tcp_head;
+            /* tcp data follows head line */
+            process_tcp_head(data + 9, len - 9);
             return 1;
         }
-    }
-                
-    if (0 == strncmp(data + len - 2, "\r\n", 2))
-    {
+        
         /* get line data */
         process_line(data, len);
         return 1;
@@ -364,54 +464,30 @@ static int process_at_data(const char *data, uint8_t len)
 }
 
 /**
- * @brief process tcp head
+ * @brief process received tcp data
+ * @param id - socket id
  * @param data - data buffer
  * @param len - data length
- * @param length - tcp data length
  */
-static int process_tcp_head(const char *data, uint8_t len, uint16_t *length)
+static int process_tcp_data(uint8_t id, char *data, uint16_t len)
 {
-    assert_param(NULL != length);
-    uint16_t val = 0;
-    if (':' == data[len - 1])
+    if (id >= M26_MAX_SOCKET_NUM)
     {
-        for (int i = 0; i < len - 1; ++i)
-        {
-            if (':' == data[i])
-            {
-                *length = val;
-                if (0 == *length)
-                {
-                    g_curmode = mode_at;
-                }
-                else
-                {
-                    g_curmode = mode_tcp_data;
-                }
-                return 1;
-            }
-            else
-            {
-                val *= 10;
-                val += (data[i] - '0');
-            }
-        }
+        TRACE("drop data of socket %d\r\n", id);
+        return 0;
     }
-
-    return 0;
-}
-
-/**
- * @brief process received tcp data
- * @param data - data buffer
- * @param len - data length
- */
-static int process_tcp_data(char *data, uint16_t len)
-{
+    
     tcp_node node;
     node.size = len;
-    strncpy(node.data, data, len);
-    xQueueSend(xTcpQueue, &node, 100 / portTICK_PERIOD_MS);
+    memcpy(node.data, data, len);
+    if (!xQueueSend(xTcpQueue[id], &node, 100 / portTICK_PERIOD_MS))
+    {
+        /* consumer is stuck, its stream is broken from here */
+        g_tcp_drops ++;
+        g_tcp_lost[id] = TRUE;
+        TRACE("socket %d drop %d bytes\r\n", id, len);
+    }
+    netif_notify(&m26_netif, id, NETIF_RECEIVED);
     
     return 0;
 }
@@ -426,7 +502,6 @@ static void vM26Response(void *pvParameters)
     char node_data[M26_MAX_MSG_SIZE_PER_LINE];
     uint8_t node_size = 0;
     char *pData = node_data;
-    uint16_t tcp_size = 0;
     char data;
     TickType_t xDelay = 50 / portTICK_PERIOD_MS;
     for (;;)
@@ -434,20 +509,13 @@ static void vM26Response(void *pvParameters)
         if (serial_getchar(pserial, &data, portMAX_DELAY))
         {
             g_curmode = mode_at;
-            tcp_size = 0;
             node_size = 0;
             pData = node_data;
             /* receive data */
             *pData++ = data;
             node_size ++;
-#ifdef _PRINT_DETAIL
-            dbg_putchar(data);
-#endif
             while (serial_getchar(pserial, &data, xDelay))
             {
-#ifdef _PRINT_DETAIL
-                dbg_putchar(data);
-#endif
                 /* receive data */
                 *pData++ = data;
                 node_size ++;
@@ -460,19 +528,11 @@ static void vM26Response(void *pvParameters)
                         node_size = 0;
                     }
                     break;
-                case mode_tcp_head:
-                    if (process_tcp_head(node_data, node_size,
-                                         &tcp_size) > 0)
-                    {
-                        pData = node_data;
-                        node_size = 0;
-                    }
-                    break;
                 case mode_tcp_data:
-                    tcp_size --;
-                    if (0 == tcp_size)
+                    g_tcp_size --;
+                    if (0 == g_tcp_size)
                     {
-                        process_tcp_data(node_data, node_size);
+                        process_tcp_data(g_tcp_id, node_data, node_size);
                         pData = node_data;
                         node_size = 0;
                         /* reset mode */
@@ -482,7 +542,8 @@ static void vM26Response(void *pvParameters)
                     {
                         if (node_size >= M26_MAX_MSG_SIZE_PER_LINE)
                         {
-                            process_tcp_data(node_data, node_size);
+                            process_tcp_data(g_tcp_id, node_data, 
+                                             node_size);
                             pData = node_data;
                             node_size = 0;
                         }
@@ -517,16 +578,22 @@ bool m26_init(void)
     }
     serial_open(g_serial);
 
-    xStatusQueue = xQueueCreate(M26_MAX_NODE_NUM, M26_MAX_NODE_NUM);
-    xAtQueue = xQueueCreate(M26_MAX_NODE_NUM, M26_MAX_MSG_SIZE_PER_LINE);
-    xTcpQueue = xQueueCreate(M26_MAX_NODE_NUM * 2, 
-                             sizeof(tcp_node) / sizeof(char));
-    xSyncQueue = xQueueCreate(1, 1);
+    xStatusQueue = xQueueCreateStatic(M26_MAX_NODE_NUM, sizeof(uint8_t),
+                                      ucStatusStorage, &xStatusQueueBuffer);
+    xAtQueue = xQueueCreateStatic(M26_MAX_NODE_NUM, M26_MAX_MSG_SIZE_PER_LINE,
+                                  ucAtStorage, &xAtQueueBuffer);
+    for (int i = 0; i < M26_MAX_SOCKET_NUM; ++i)
+    {
+        xTcpQueue[i] = xQueueCreateStatic(M26_MAX_TCP_NODE_NUM, 
+                                          sizeof(tcp_node) / sizeof(char),
+                                          ucTcpStorage[i], 
+                                          &xTcpQueueBuffer[i]);
+    }
+    xSyncQueue = xQueueCreateStatic(1, 1, ucSyncStorage, &xSyncQueueBuffer);
 
     if ((NULL == xStatusQueue) || 
         (NULL == xAtQueue) || 
-        (NULL == xTcpQueue) || 
-        (NULL == xStatusQueue))
+        (NULL == xSyncQueue))
     {
         TRACE("initialize failed, can't create queue\'COM2\'\r\n");
         serial_release(g_serial);
@@ -534,8 +601,9 @@ bool m26_init(void)
         return FALSE;
     }
     
-    xTaskCreate(vM26Response, "M26Response", M26_STACK_SIZE, 
-            g_serial, M26_PRIORITY, &task_m26);
+    task_m26 = xTaskCreateStatic(vM26Response, "M26Response", M26_STACK_SIZE, 
+                                 g_serial, M26_PRIORITY, xM26Stack, 
+                                 &xM26TaskBuffer);
      
     return TRUE;
 }
@@ -650,32 +718,39 @@ uint8_t m26_pin_status(TickType_t time)
 }
 
 /**
- * @brief connect remote server
+ * @brief connect remote server, connect result is reported by driver
+ * @param id - socket id
  * @param mode - connect mode
  * @param ip - remote ip address
  * @param port - remote port
  * @param time - timeout time
  */
-int m26_connect(const char *mode, const char *ip, const char *port,
-        TickType_t time)
+int m26_connect(uint8_t id, const char *mode, const char *ip, uint16_t port,
+                TickType_t time)
 {
     assert_param(NULL != g_serial);
+    assert_param(id < M26_MAX_SOCKET_NUM);
 
     char str_mode[64];
-    sprintf(str_mode, "AT+QIOPEN=\"%s\",\"%s\",\"%s\"\r\n", mode, ip, port);
+    sprintf(str_mode, "AT+QIOPEN=%d,\"%s\",\"%s\",\"%d\"\r\n", id, mode, 
+            ip, port);
+    xQueueReset(xTcpQueue[id]);
+    g_tcp_lost[id] = FALSE;
     
     return m26_send_ok(str_mode, time);
 }
 
 /**
  * @brief prepare send tcp data
+ * @param id - socket id
  * @param length - send length
  * @param time - timeout time
  */
-int m26_prepare_send(uint16_t length, TickType_t time)
+int m26_prepare_send(uint8_t id, uint16_t length, TickType_t time)
 {
-    char str_mode[20];
-    sprintf(str_mode, "AT+QISEND=%d\r\n", length);
+    assert_param(id < M26_MAX_SOCKET_NUM);
+    char str_mode[24];
+    sprintf(str_mode, "AT+QISEND=%d,%d\r\n", id, length);
     
     return m26_send_ok(str_mode, time);
 }
@@ -708,18 +783,27 @@ int m26_write(const char *data, uint32_t length, TickType_t time)
 }
 
 /**
- * @brief get tcp data
+ * @brief get tcp data of socket, after a drop queued data is discarded 
+ *        and loss is reported once so consumer resets its stream
+ * @param id - socket id
  * @param data - tcp data
  * @param len - data length
  * @param xBlockTime - timeout time
  */
-int m26_recv(uint8_t *data, uint16_t *len, TickType_t xBlockTime)
+int m26_recv(uint8_t id, uint8_t *data, uint16_t *len, TickType_t xBlockTime)
 {
-    assert_param(NULL != xTcpQueue);
+    assert_param(id < M26_MAX_SOCKET_NUM);
+    assert_param(NULL != xTcpQueue[id]);
+    if (g_tcp_lost[id])
+    {
+        g_tcp_lost[id] = FALSE;
+        xQueueReset(xTcpQueue[id]);
+        return -M26_ERR_LOST;
+    }
     
     tcp_node node;
 
-    if (xQueueReceive(xTcpQueue, &node, xBlockTime))
+    if (xQueueReceive(xTcpQueue[id], &node, xBlockTime))
     {
         for (int i = 0; i < node.size; ++i)
         {
@@ -734,16 +818,30 @@ int m26_recv(uint8_t *data, uint16_t *len, TickType_t xBlockTime)
     }
 }
 
+/**
+ * @brief get count of tcp data dropped by full receive queue
+ * @return drop count
+ */
+uint32_t m26_tcp_drops(void)
+{
+    return g_tcp_drops;
+}
+
 /**
  * @brief disconnect tcp,udp,ssl connection
+ * @param id - socket id
  * @param time - timeout time
  */
-int m26_disconnect(TickType_t time)
+int m26_disconnect(uint8_t id, TickType_t time)
 {
+    assert_param(id < M26_MAX_SOCKET_NUM);
     char str_mode[22];
-    sprintf(str_mode, "AT+QICLOSE\r\n");
+    sprintf(str_mode, "AT+QICLOSE=%d\r\n", id);
     
-    return m26_send_ok(str_mode, time);
+    int ret = m26_send_ok(str_mode, time);
+    xQueueReset(xTcpQueue[id]);
+    g_tcp_lost[id] = FALSE;
+    return ret;
 }
 
 /**
@@ -758,5 +856,109 @@ void m26_shutdown(void)
     }
 }
 
+/* baudrates probed by link bring up, fastest first */
+static const uint32_t m26_rates[] = {Baudrate_460800, Baudrate_230400};
 
+/**
+ * @brief ask m26 to switch baudrate, not saved to profile
+ * @param baudrate - new baudrate
+ * @return TRUE: module acked
+ */
+static bool m26_set_rate(uint32_t baudrate)
+{
+    char cmd[24];
+    sprintf(cmd, "AT+IPR=%d\r\n", baudrate);
+    return (M26_ERR_OK == m26_send_ok(cmd, DEFAULT_TIMEOUT));
+}
 
+/**
+ * @brief link validation round trip, identification response carries 
+ *        several lines of text
+ * @return TRUE: valid response received
+ */
+static bool m26_test_rate(void)
+{
+    return (M26_ERR_OK == m26_send_ok("ATI\r\n", DEFAULT_TIMEOUT));
+}
+
+static linkbaud g_link = 
+{
+    "m26", NULL, m26_rates, sizeof(m26_rates) / sizeof(m26_rates[0]),
+    m26_set_rate, m26_test_rate, Baudrate_115200, 
+    sizeof(m26_rates) / sizeof(m26_rates[0])
+};
+
+/**
+ * @brief switch link to fastest reliable baudrate
+ * @return 0 means success, otherwise link lost
+ */
+int m26_negotiate_baud(void)
+{
+    assert_param(NULL != g_serial);
+    g_link.port = g_serial;
+    return (0 != linkbaud_negotiate(&g_link)) ? M26_ERR_OK : -M26_ERR_FAIL;
+}
+
+/**
+ * @brief check link receive errors and fall back to slower baudrate
+ * @return 0 means link is usable, otherwise link lost
+ */
+int m26_check_link(void)
+{
+    if (NULL == g_link.port)
+    {
+        return M26_ERR_OK;
+    }
+    return linkbaud_check(&g_link) ? M26_ERR_OK : -M26_ERR_FAIL;
+}
+
+/**
+ * @brief netif connect
+ * @param id - socket id
+ * @param mode - connect mode
+ * @param ip - remote ip address
+ * @param port - remote port
+ */
+static int m26_netif_connect(uint8_t id, const char *mode, const char *ip, 
+                             uint16_t port)
+{
+    return m26_connect(id, mode, ip, port, DEFAULT_TIMEOUT);
+}
+
+/**
+ * @brief netif send, data follows send prompt
+ * @param id - socket id
+ * @param data - data to send
+ * @param length - data length
+ */
+static int m26_netif_send(uint8_t id, const uint8_t *data, uint16_t length)
+{
+    int ret = m26_prepare_send(id, length, DEFAULT_TIMEOUT);
+    if (M26_ERR_OK == ret)
+    {
+        ret = m26_write((const char *)data, length, 
+                        1000 / portTICK_PERIOD_MS);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief netif close
+ * @param id - socket id
+ */
+static int m26_netif_close(uint8_t id)
+{
+    return m26_disconnect(id, DEFAULT_TIMEOUT);
+}
+
+/* m26 socket interface */
+const netif m26_netif = 
+{
+    "m26",
+    m26_netif_connect,
+    m26_netif_send,
+    m26_recv,
+    m26_netif_close,
+    m26_check_link,
+};
@@ -9,6 +9,7 @@
   #define _M26_H_
 
 #include "types.h"
+#include "netif.h"
 
 BEGIN_DECLS
 
@@ -18,6 +19,15 @@ BEGIN_DECLS
 #define M26_ERR_NOT_FOUND         3
 #define M26_ERR_FAIL              4
 #define M26_ERR_ALREADY           5
+#define M26_ERR_LOST              6
+
+/* network registration status */
+#define M26_REG_NONE            0
+#define M26_REG_HOME            1
+#define M26_REG_SEARCHING       2
+#define M26_REG_DENIED          3
+#define M26_REG_UNKNOWN         4
+#define M26_REG_ROAMING         5
 
 /* pin code status definition */
 #define M26_PIN_READY           0
@@ -29,28 +39,35 @@ BEGIN_DECLS
 #define M26_SIM_PUK2            6
 #define M26_SIM_UNKNOWN         7
 
+/* sockets in multiple connection mode, socket id 0 ~ num - 1 */
+#define M26_MAX_SOCKET_NUM      4
+
 typedef struct
 {
     void (*net_register)(uint8_t code);
     void (*gprs_attach)(uint8_t code);
-    void (*server_connect)(void);
-    void (*server_disconnect)(void);
 }m26_driver;
 
+/* m26 socket interface */
+extern const netif m26_netif;
+
 /* m26 interface */
 bool m26_init(void);
 int m26_send_ok(const char *cmd, TickType_t time);
 uint8_t m26_pin_status(TickType_t time);
 void m26_attach(const m26_driver *driver);
 void m26_detach(void);
-int m26_connect(const char *mode, const char *ip, const char *port,
-        TickType_t time);
-int m26_disconnect(TickType_t time);
-int m26_prepare_send(uint16_t length, TickType_t time);
+int m26_connect(uint8_t id, const char *mode, const char *ip, uint16_t port,
+                TickType_t time);
+int m26_disconnect(uint8_t id, TickType_t time);
+int m26_prepare_send(uint8_t id, uint16_t length, TickType_t time);
 int m26_write(const char *data, uint32_t length, TickType_t time);
-int m26_recv(uint8_t *data, uint16_t *len, TickType_t xBlockTime);
+int m26_recv(uint8_t id, uint8_t *data, uint16_t *len, TickType_t xBlockTime);
+uint32_t m26_tcp_drops(void);
 int m26_sync(void);
 void m26_shutdown(void);
+int m26_negotiate_baud(void);
+int m26_check_link(void);
 
 END_DECLS
 
@@ -0,0 +1,139 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "mempool.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "trace.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[mempool]"
+
+/* registered pools */
+static mempool *g_pools = NULL;
+
+/**
+ * @brief initialize pool, free blocks are linked through their first word
+ * @param pool - pool to initialize
+ * @param name - pool name
+ * @param storage - pool storage, word aligned, defined by MEMPOOL_STORAGE
+ * @param size - block size
+ * @param count - block count
+ */
+void mempool_init(mempool *pool, const char *name, void *storage, 
+                  uint16_t size, uint16_t count)
+{
+    assert_param(NULL != pool);
+    assert_param(NULL != storage);
+    assert_param(0 == ((uint32_t)storage & 0x03));
+    assert_param(count > 0);
+
+    uint16_t words = MEMPOOL_BLOCK_WORDS(size);
+    uint32_t *block = storage;
+    
+    pool->name = name;
+    pool->size = words * sizeof(uint32_t);
+    pool->count = count;
+    pool->used = 0;
+    pool->max_used = 0;
+    pool->fail = 0;
+    pool->free = NULL;
+    for (int i = count - 1; i >= 0; --i)
+    {
+        *(void **)(block + i * words) = pool->free;
+        pool->free = block + i * words;
+    }
+
+    taskENTER_CRITICAL();
+    pool->next = g_pools;
+    g_pools = pool;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief allocate block from pool
+ * @param pool - pool to allocate from
+ * @return block address, NULL if pool is empty
+ */
+void *mempool_alloc(mempool *pool)
+{
+    assert_param(NULL != pool);
+    void *block = NULL;
+    
+    taskENTER_CRITICAL();
+    block = pool->free;
+    if (NULL != block)
+    {
+        pool->free = *(void **)block;
+        pool->used ++;
+        if (pool->used > pool->max_used)
+        {
+            pool->max_used = pool->used;
+        }
+    }
+    else
+    {
+        pool->fail ++;
+    }
+    taskEXIT_CRITICAL();
+
+    if (NULL == block)
+    {
+        TRACE("pool %s exhausted\r\n", pool->name);
+    }
+    
+    return block;
+}
+
+/**
+ * @brief return block to pool
+ * @param pool - pool block belongs to
+ * @param block - block to free
+ */
+void mempool_free(mempool *pool, void *block)
+{
+    assert_param(NULL != pool);
+    if (NULL == block)
+    {
+        return ;
+    }
+
+    taskENTER_CRITICAL();
+    assert_param(pool->used > 0);
+    *(void **)block = pool->free;
+    pool->free = block;
+    pool->used --;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief get statistics of all registered pools
+ * @param stats - statistics output
+ * @param max - max statistics count
+ * @return statistics count
+ */
+uint8_t mempool_get_stats(mempool_stats *stats, uint8_t max)
+{
+    uint8_t count = 0;
+    
+    taskENTER_CRITICAL();
+    for (mempool *pool = g_pools; (NULL != pool) && (count < max); 
+         pool = pool->next)
+    {
+        stats[count].name = pool->name;
+        stats[count].size = pool->size;
+        stats[count].count = pool->count;
+        stats[count].used = pool->used;
+        stats[count].max_used = pool->max_used;
+        stats[count].fail = pool->fail;
+        count ++;
+    }
+    taskEXIT_CRITICAL();
+
+    return count;
+}
+
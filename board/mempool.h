@@ -0,0 +1,56 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _MEMPOOL_H_
+  #define _MEMPOOL_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* fixed size block pool */
+typedef struct _mempool_t
+{
+    const char *name;
+    void *free;
+    uint16_t size;
+    uint16_t count;
+    uint16_t used;
+    uint16_t max_used;
+    uint16_t fail;
+    struct _mempool_t *next;
+}mempool;
+
+/* pool statistics */
+typedef struct
+{
+    const char *name;
+    uint16_t size;
+    uint16_t count;
+    uint16_t used;
+    uint16_t max_used;
+    uint16_t fail;
+}mempool_stats;
+
+/* block size rounded up to word size */
+#define MEMPOOL_BLOCK_WORDS(size)  (((size) + sizeof(uint32_t) - 1) / \
+                                    sizeof(uint32_t))
+
+/* define pool storage with count blocks of size bytes */
+#define MEMPOOL_STORAGE(name, size, count) \
+            static uint32_t name[MEMPOOL_BLOCK_WORDS(size) * (count)]
+
+void mempool_init(mempool *pool, const char *name, void *storage, 
+                  uint16_t size, uint16_t count);
+void *mempool_alloc(mempool *pool);
+void mempool_free(mempool *pool, void *block);
+uint8_t mempool_get_stats(mempool_stats *stats, uint8_t max);
+
+END_DECLS
+
+#endif /* _MEMPOOL_H_ */
+
@@ -9,6 +9,7 @@
 #include "FreeRTOS.h"
 #include "queue.h"
 #include "task.h"
+#include "timers.h"
 #include "assert.h"
 #include "trace.h"
 #include "global.h"
@@ -28,35 +29,42 @@
 uint8_t g_cur_mode = MODE_SAT;
 
 #define SWITCH_COUNT    (5)
+#define MONITOR_PERIOD  (1000 / portTICK_PERIOD_MS)
 
+static uint8_t g_press_count = 0;
+static StaticTimer_t xMonitorTimerBuffer;
 
 /**
- * @brief monitor button
+ * @brief monitor button timer callback
+ * @param xTimer - timer handle
  */
-static void vModeMonitor(void *pvParameters)
+static void vModeMonitor(TimerHandle_t xTimer)
 {
-    uint8_t count = 0;
-    for (;;)
+    if (is_pinset("MODE_SET"))
     {
-        if (is_pinset("MODE_SET"))
-        {
-            count = 0;
-        }
-        else
-        {
-            count ++;
-        }
-        
-        if (count > SWITCH_COUNT)
+        g_press_count = 0;
+    }
+    else
+    {
+        g_press_count ++;
+    }
+    
+    if (g_press_count > SWITCH_COUNT)
+    {
+        if (MODE_AP != g_cur_mode)
         {
-            if (MODE_AP != g_cur_mode)
+            /* erasing flash blocks timer task, connect task restores 
+             * credentials and resets */
+            if (wifi_restore())
+            {
+                xTimerStop(xTimer, 0);
+            }
+            else
             {
-                flash_restore();
-                vTaskDelay(1000 / portTICK_PERIOD_MS);
-                SCB_SystemReset();
+                TRACE("network is not running, nothing to restore\r\n");
+                g_press_count = 0;
             }
         }
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
 }
 
@@ -73,8 +81,11 @@ void modeswitch_init(void)
     {
         g_cur_mode = MODE_SAT;
     }
-    xTaskCreate(vModeMonitor, "ModeMonitor", MODESWITCH_STACK_SIZE, 
-                NULL, MODESWITCH_PRIORITY, NULL);
+    TimerHandle_t xTimer = xTimerCreateStatic("ModeMonitor", MONITOR_PERIOD, 
+                                              pdTRUE, NULL, vModeMonitor,
+                                              &xMonitorTimerBuffer);
+    assert_param(NULL != xTimer);
+    xTimerStart(xTimer, 0);
 }
 
 
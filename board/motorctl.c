@@ -5,6 +5,7 @@
 *
 * See the COPYING file for the terms of usage and distribution.
 */
+#include <string.h>
 #include "motorctl.h"
 #include "FreeRTOS.h"
 #include "task.h"
@@ -15,6 +16,7 @@
 #include "global.h"
 #include "stm32f10x_cfg.h"
 #include "wifi.h"
+#include "config.h"
 
 
 
@@ -23,20 +25,59 @@
 
 //#define USE_DETECT
 
-#define MOTOR_NUM   10
+#if CONFIG_MOTOR_NUM > 255
+#error "motor number is 8 bits"
+#endif
+
+#if CONFIG_MOTOR_EXPANDER
+/* 74hc595 chain: row bits first, then column bits, first byte shifted out
+ * ends in last chip. 74hc165 chain: first byte read holds motor 0 - 7 */
+#define MOTOR_SPI           SPI1
+#define MOTOR_LATCH_NAME    "MOT_LATCH"
+#define MOTOR_LOAD_NAME     "MOT_LOAD"
+#define MOTOR_DRIVE_SIZE    ((CONFIG_MOTOR_ROWS + CONFIG_MOTOR_COLS + 7) / 8)
+static uint8_t g_drive[MOTOR_DRIVE_SIZE];
 
+/* motor task drives while network task reads status */
+static xSemaphoreHandle xMotorSpi = NULL;
+static StaticSemaphore_t xMotorSpiBuffer;
+#else
+#if (CONFIG_MOTOR_ROWS > 4) || (CONFIG_MOTOR_COLS > 4) || \
+    (CONFIG_MOTOR_NUM > 10)
+#error "board pins drive 4 x 4 motors and detect 10, use expander"
+#endif
 const char *motor_left[] = {"CON_L1", "CON_L2", "CON_L3", "CON_L4"};
 const char *motor_right[] = {"CON_R1", "CON_R2", "CON_R3", "CON_R4"};
 const char *motor_dect[] = {"CH1_DET", "CH2_DET", "CH3_DET", "CH4_DET",
 "CH5_DET", "CH6_DET", "CH7_DET", "CH8_DET", "CH9_DET", "CH10_DET"};
+
+/* drive pins are resolved once, name lookup is too slow */
+typedef struct
+{
+    uint8_t group;
+    uint8_t pin;
+}motor_pin;
+
+static motor_pin g_rows[CONFIG_MOTOR_ROWS];
+static motor_pin g_cols[CONFIG_MOTOR_COLS];
+/* detect inputs, ports are read once a scan */
+static pin_gather g_detect;
+#endif
 #define MOTOR_DET_PIN_NAME  "MOT_DET"
 
 /* motor control message queue */
 static xQueueHandle xMotorQueue = NULL;
 #define MOTOR_MSG_NUM      (10)
+static uint8_t ucMotorStorage[MOTOR_MSG_NUM];
+static StaticQueue_t xMotorQueueBuffer;
+
+/* task storage */
+static StackType_t xMotorStack[MOTOR_STACK_SIZE];
+static StaticTask_t xMotorTaskBuffer;
 
 #ifdef USE_DETECT
 static xSemaphoreHandle xMotorWorking = NULL;
+static StaticSemaphore_t xMotorWorkingBuffer;
 #endif
 
 #define MOTOR_UP_TIME      (500 / portTICK_PERIOD_MS)
@@ -58,27 +99,160 @@ void EXTI3_IRQHandler(void)
 }
 #endif
 
+#if CONFIG_MOTOR_EXPANDER
 /**
- * @brief start motor
- * @param left - left bridge
- * @param right - right bridge
+ * @brief pulse chain control pin low
+ * @param name - pin name
  */
-static __INLINE void start_motor(uint8_t left, uint8_t right)
+static void pulse_low(const char *name)
 {
-    pin_set(motor_left[left]);
-    pin_set(motor_right[right]);
+    pin_reset(name);
+    pin_set(name);
 }
 
 /**
- * @brief start motor
- * @param left - left bridge
- * @param right - right bridge
+ * @brief shift drive bits out and latch them
+ */
+static void write_drive(void)
+{
+    for (int i = MOTOR_DRIVE_SIZE - 1; i >= 0; --i)
+    {
+        SPI_WriteReadDataSync(MOTOR_SPI, g_drive[i]);
+    }
+    /* 595 latches on rising edge */
+    pulse_low(MOTOR_LATCH_NAME);
+}
+
+/**
+ * @brief set motor drive lines
+ * @param row - matrix row
+ * @param col - matrix column
+ * @param on - drive level
+ */
+static void drive_motor(uint8_t row, uint8_t col, bool on)
+{
+    uint8_t bits[2] = {row, CONFIG_MOTOR_ROWS + col};
+    xSemaphoreTake(xMotorSpi, portMAX_DELAY);
+    for (int i = 0; i < 2; ++i)
+    {
+        if (on)
+        {
+            g_drive[bits[i] >> 3] |= (1 << (bits[i] & 0x07));
+        }
+        else
+        {
+            g_drive[bits[i] >> 3] &= ~(1 << (bits[i] & 0x07));
+        }
+    }
+    write_drive();
+    xSemaphoreGive(xMotorSpi);
+}
+
+/**
+ * @brief read detect inputs
+ * @param status - detect bitmap, MOTOR_STATUS_SIZE bytes
+ */
+static void read_detect(uint8_t *status)
+{
+    xSemaphoreTake(xMotorSpi, portMAX_DELAY);
+    /* 165 samples inputs while load is low */
+    pulse_low(MOTOR_LOAD_NAME);
+    for (int i = 0; i < MOTOR_STATUS_SIZE; ++i)
+    {
+        status[i] = (uint8_t)SPI_WriteReadDataSync(MOTOR_SPI, 0xff);
+    }
+    xSemaphoreGive(xMotorSpi);
+}
+
+/**
+ * @brief initialize shift register chains, all drive lines set
+ */
+static void init_drive(void)
+{
+    SPI_Config config;
+    SPI_StructInit(&config);
+    /* mode 0, 4.5MHz keeps long chains within 74hc timing */
+    config.clock = SPI_Clk_Divided_16;
+    config.polarity = SPI_Polarity_Low;
+    SPI_Setup(MOTOR_SPI, &config);
+    SPI_Enable(MOTOR_SPI, TRUE);
+
+    pin_set(MOTOR_LATCH_NAME);
+    pin_set(MOTOR_LOAD_NAME);
+    xMotorSpi = xSemaphoreCreateMutexStatic(&xMotorSpiBuffer);
+    for (int i = 0; i < MOTOR_DRIVE_SIZE; ++i)
+    {
+        g_drive[i] = 0xff;
+    }
+    write_drive();
+}
+#else
+/**
+ * @brief resolve pin names
+ * @param names - pin names
+ * @param pins - resolved pins
+ * @param count - pin count
  */
-static __INLINE void stop_motor(uint8_t left, uint8_t right)
+static void resolve_pins(const char **names, motor_pin *pins, uint8_t count)
 {
-    pin_reset(motor_left[left]);
-    pin_reset(motor_right[right]);
+    for (int i = 0; i < count; ++i)
+    {
+        get_pininfo(names[i], &pins[i].group, &pins[i].pin);
+    }
 }
+
+/**
+ * @brief set motor drive lines
+ * @param row - matrix row
+ * @param col - matrix column
+ * @param on - drive level
+ */
+static void drive_motor(uint8_t row, uint8_t col, bool on)
+{
+    if (on)
+    {
+        GPIO_SetPin((GPIO_Group)g_rows[row].group, g_rows[row].pin);
+        GPIO_SetPin((GPIO_Group)g_cols[col].group, g_cols[col].pin);
+    }
+    else
+    {
+        GPIO_ResetPin((GPIO_Group)g_rows[row].group, g_rows[row].pin);
+        GPIO_ResetPin((GPIO_Group)g_cols[col].group, g_cols[col].pin);
+    }
+}
+
+/**
+ * @brief read detect inputs, every port is read once
+ * @param status - detect bitmap, MOTOR_STATUS_SIZE bytes
+ */
+static void read_detect(uint8_t *status)
+{
+    uint32_t bits = pin_gather_read(&g_detect);
+    for (int i = 0; i < MOTOR_STATUS_SIZE; ++i)
+    {
+        status[i] = (uint8_t)(bits >> (i << 3));
+    }
+}
+
+/**
+ * @brief resolve pins, all drive lines set
+ */
+static void init_drive(void)
+{
+    resolve_pins(motor_left, g_rows, CONFIG_MOTOR_ROWS);
+    resolve_pins(motor_right, g_cols, CONFIG_MOTOR_COLS);
+    pin_gather_init(&g_detect, motor_dect, CONFIG_MOTOR_NUM);
+    for (int i = 0; i < CONFIG_MOTOR_ROWS; ++i)
+    {
+        GPIO_SetPin((GPIO_Group)g_rows[i].group, g_rows[i].pin);
+    }
+    for (int i = 0; i < CONFIG_MOTOR_COLS; ++i)
+    {
+        GPIO_SetPin((GPIO_Group)g_cols[i].group, g_cols[i].pin);
+    }
+}
+#endif
+
 /**
  * @brief motor control task
  * @param pvParameter - parameters pass to task
@@ -86,15 +260,15 @@ static __INLINE void stop_motor(uint8_t left, uint8_t right)
 static void vMotorCtl(void *pvParameters)
 {
     uint8_t num = 0;
-    uint8_t left = 0, right = 0;
+    uint8_t row = 0, col = 0;
     for (;;)
     {
         if (xQueueReceive(xMotorQueue, &num, portMAX_DELAY))
         {
-            left = (num >> 2);
-            right = num - (left << 2);
+            row = num / CONFIG_MOTOR_COLS;
+            col = num % CONFIG_MOTOR_COLS;
             TRACE("start motor: %d\r\n", num);
-            start_motor(left, right);
+            drive_motor(row, col, TRUE);
             
 #ifdef USE_DETECT
             /* wait motor working */
@@ -112,7 +286,7 @@ static void vMotorCtl(void *pvParameters)
 #endif
             
             TRACE("stop motor: %d\r\n", num);
-            stop_motor(left, right);
+            drive_motor(row, col, FALSE);
             wifi_update_motor_status();
             vTaskDelay(100 / portTICK_PERIOD_MS);
         }
@@ -124,20 +298,16 @@ static void vMotorCtl(void *pvParameters)
  */
 void motor_init(void)
 {
-    int i = 0;
     TRACE("initialize motor...\r\n");
-    for (; i < sizeof(motor_left) / sizeof(char *); ++i)
-    {
-        pin_set(motor_left[i]);
-        pin_set(motor_right[i]);
-    }
+    init_drive();
     
-    xMotorQueue = xQueueCreate(MOTOR_MSG_NUM, 1);
+    xMotorQueue = xQueueCreateStatic(MOTOR_MSG_NUM, 1, ucMotorStorage, 
+                                     &xMotorQueueBuffer);
 #ifdef USE_DETECT
-    xMotorWorking = xSemaphoreCreateBinary();
+    xMotorWorking = xSemaphoreCreateBinaryStatic(&xMotorWorkingBuffer);
 #endif
-    xTaskCreate(vMotorCtl, "MotorCtl", MOTOR_STACK_SIZE, 
-                NULL, MOTOR_PRIORITY, NULL);
+    xTaskCreateStatic(vMotorCtl, "MotorCtl", MOTOR_STACK_SIZE, 
+                      NULL, MOTOR_PRIORITY, xMotorStack, &xMotorTaskBuffer);
     
 #ifdef USE_DETECT
     /* set pin interrupt */
@@ -158,7 +328,7 @@ void motor_init(void)
  */
 void motor_start(uint8_t num)
 {
-    assert_param(num < MOTOR_NUM);
+    assert_param(num < CONFIG_MOTOR_NUM);
     xQueueSend(xMotorQueue, &num, MOTOR_WAIT_TIME);
 }
 
@@ -169,26 +339,24 @@ void motor_start(uint8_t num)
  */
 bool motor_isopen(uint8_t num)
 {
-    assert_param(num < MOTOR_NUM);
+    assert_param(num < CONFIG_MOTOR_NUM);
+    uint8_t status[MOTOR_STATUS_SIZE];
+    motor_getstatus(status);
 
-    return is_pinset(motor_dect[num]);
+    return (0 != (status[num >> 3] & (1 << (num & 0x07))));
 }
 
 /**
  * @brief get motor status
- * @return motor status
+ * @param status - status bitmap, MOTOR_STATUS_SIZE bytes, bit n is motor n
  */
-uint16_t motor_getstatus(void)
+void motor_getstatus(uint8_t *status)
 {
-    uint16_t status = 0xffff;
-    for (int i = 0; i < MOTOR_NUM; ++i)
-    {
-        if (!is_pinset(motor_dect[i]))
-        {
-            status &= ~(1 << i);
-        }
-    }
-
-    return status;
+    assert_param(NULL != status);
+    memset(status, 0, MOTOR_STATUS_SIZE);
+    read_detect(status);
+#if CONFIG_MOTOR_NUM & 0x07
+    /* unfitted positions in last byte */
+    status[MOTOR_STATUS_SIZE - 1] &= (1 << (CONFIG_MOTOR_NUM & 0x07)) - 1;
+#endif
 }
-
@@ -9,13 +9,17 @@
   #define _MOTORCTL_H_
 
 #include "types.h"
+#include "config.h"
 
 BEGIN_DECLS
 
+/* status bitmap size, bit n of byte n / 8 is motor n */
+#define MOTOR_STATUS_SIZE  ((CONFIG_MOTOR_NUM + 7) / 8)
+
 void motor_init(void);
 void motor_start(uint8_t num);
 bool motor_isopen(uint8_t num);
-uint16_t motor_getstatus(void);
+void motor_getstatus(uint8_t *status);
 
 END_DECLS
 
@@ -0,0 +1,217 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "netif.h"
+#include "trace.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[netif]"
+
+/* network module in use */
+static const netif *g_netif = NULL;
+
+/* socket event callbacks */
+static netif_event_cb g_listeners[NETIF_MAX_SOCKET_NUM];
+
+/* socket operations are command and response sequences on one serial 
+ * link, run one at a time */
+static SemaphoreHandle_t xLinkMutex = NULL;
+static StaticSemaphore_t xLinkMutexBuffer;
+
+/**
+ * @brief initialize network interface
+ * @return init status
+ */
+bool netif_init(void)
+{
+    xLinkMutex = xSemaphoreCreateMutexStatic(&xLinkMutexBuffer);
+    return (NULL != xLinkMutex);
+}
+
+/**
+ * @brief register network module, socket operations go to this module
+ * @param nif - network module interface
+ */
+void netif_register(const netif *nif)
+{
+    assert_param(NULL != nif);
+    assert_param((NULL != nif->connect) && (NULL != nif->send) &&
+                 (NULL != nif->recv) && (NULL != nif->close));
+    TRACE("register %s\r\n", nif->name);
+    g_netif = nif;
+}
+
+/**
+ * @brief get network module in use
+ * @return network module interface, NULL if not registered
+ */
+const netif *netif_current(void)
+{
+    return g_netif;
+}
+
+/**
+ * @brief listen socket event
+ * @param id - socket id
+ * @param cb - event callback, NULL to stop listen
+ */
+void netif_listen(uint8_t id, netif_event_cb cb)
+{
+    assert_param(id < NETIF_MAX_SOCKET_NUM);
+    g_listeners[id] = cb;
+}
+
+/**
+ * @brief notify socket event, called by network module, events of module 
+ *        not in use are dropped
+ * @param nif - network module interface
+ * @param id - socket id
+ * @param event - socket event
+ */
+void netif_notify(const netif *nif, uint8_t id, netif_event event)
+{
+    if ((nif == g_netif) && (id < NETIF_MAX_SOCKET_NUM) && 
+        (NULL != g_listeners[id]))
+    {
+        g_listeners[id](id, event);
+    }
+}
+
+/**
+ * @brief connect remote server, connect result is notified by socket event
+ * @param id - socket id
+ * @param mode - connect mode
+ * @param ip - remote ip address
+ * @param port - remote port
+ * @return 0 means success, otherwise error code
+ */
+int netif_connect(uint8_t id, const char *mode, const char *ip, 
+                  uint16_t port)
+{
+    if (NULL == g_netif)
+    {
+        return -NETIF_ERR_FAIL;
+    }
+
+    int ret = -NETIF_ERR_TIMEOUT;
+    if (xSemaphoreTake(xLinkMutex, portMAX_DELAY))
+    {
+        ret = g_netif->connect(id, mode, ip, port);
+        xSemaphoreGive(xLinkMutex);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief send data through socket
+ * @param id - socket id
+ * @param data - data to send
+ * @param length - data length
+ * @return 0 means success, otherwise error code
+ */
+int netif_send(uint8_t id, const uint8_t *data, uint16_t length)
+{
+    if (NULL == g_netif)
+    {
+        return -NETIF_ERR_FAIL;
+    }
+
+    int ret = -NETIF_ERR_TIMEOUT;
+    if (xSemaphoreTake(xLinkMutex, portMAX_DELAY))
+    {
+        ret = g_netif->send(id, data, length);
+        xSemaphoreGive(xLinkMutex);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief receive data from socket
+ * @param id - socket id
+ * @param data - receive buffer
+ * @param len - received length
+ * @param xBlockTime - timeout time
+ * @return 0 means success, otherwise error code
+ */
+int netif_recv(uint8_t id, uint8_t *data, uint16_t *len, 
+               TickType_t xBlockTime)
+{
+    if (NULL == g_netif)
+    {
+        vTaskDelay(xBlockTime);
+        return -NETIF_ERR_TIMEOUT;
+    }
+
+    return g_netif->recv(id, data, len, xBlockTime);
+}
+
+/**
+ * @brief close socket
+ * @param id - socket id
+ * @return 0 means success, otherwise error code
+ */
+int netif_close(uint8_t id)
+{
+    if (NULL == g_netif)
+    {
+        return -NETIF_ERR_FAIL;
+    }
+
+    int ret = -NETIF_ERR_TIMEOUT;
+    if (xSemaphoreTake(xLinkMutex, portMAX_DELAY))
+    {
+        ret = g_netif->close(id);
+        xSemaphoreGive(xLinkMutex);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief run network module link maintenance
+ * @return 0 means link is usable, otherwise error code
+ */
+int netif_check(void)
+{
+    if ((NULL == g_netif) || (NULL == g_netif->check))
+    {
+        return NETIF_ERR_OK;
+    }
+
+    int ret = -NETIF_ERR_TIMEOUT;
+    if (xSemaphoreTake(xLinkMutex, portMAX_DELAY))
+    {
+        ret = g_netif->check();
+        xSemaphoreGive(xLinkMutex);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief get exclusive use of network module for module commands outside 
+ *        socket interface
+ * @param xBlockTime - timeout time
+ * @return lock status
+ */
+bool netif_lock(TickType_t xBlockTime)
+{
+    return (pdTRUE == xSemaphoreTake(xLinkMutex, xBlockTime));
+}
+
+/**
+ * @brief release network module
+ */
+void netif_unlock(void)
+{
+    xSemaphoreGive(xLinkMutex);
+}
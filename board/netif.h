@@ -0,0 +1,68 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _NETIF_H_
+  #define _NETIF_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* netif error message, same as network module error code */
+#define NETIF_ERR_OK              0
+#define NETIF_ERR_TIMEOUT         1
+#define NETIF_ERR_FAIL            4
+/* received data was dropped, stream of socket is broken */
+#define NETIF_ERR_LOST            6
+
+/* max socket id + 1 of all network modules */
+#define NETIF_MAX_SOCKET_NUM      5
+
+/* socket event */
+typedef enum
+{
+    NETIF_CONNECTED,
+    NETIF_DISCONNECTED,
+    NETIF_RECEIVED,
+}netif_event;
+
+/* socket event callback */
+typedef void (*netif_event_cb)(uint8_t id, netif_event event);
+
+/* socket interface implemented by network module, return 0 means 
+ * success, otherwise negative error code */
+typedef struct
+{
+    const char *name;
+    int (*connect)(uint8_t id, const char *mode, const char *ip, 
+                   uint16_t port);
+    int (*send)(uint8_t id, const uint8_t *data, uint16_t length);
+    int (*recv)(uint8_t id, uint8_t *data, uint16_t *len, 
+                TickType_t xBlockTime);
+    int (*close)(uint8_t id);
+    /* link maintenance, called periodically, can be NULL */
+    int (*check)(void);
+}netif;
+
+bool netif_init(void);
+void netif_register(const netif *nif);
+const netif *netif_current(void);
+void netif_listen(uint8_t id, netif_event_cb cb);
+void netif_notify(const netif *nif, uint8_t id, netif_event event);
+int netif_connect(uint8_t id, const char *mode, const char *ip, 
+                  uint16_t port);
+int netif_send(uint8_t id, const uint8_t *data, uint16_t length);
+int netif_recv(uint8_t id, uint8_t *data, uint16_t *len, 
+               TickType_t xBlockTime);
+int netif_close(uint8_t id);
+int netif_check(void);
+bool netif_lock(TickType_t xBlockTime);
+void netif_unlock(void);
+
+END_DECLS
+
+#endif /* _NETIF_H_ */
@@ -0,0 +1,325 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "ota.h"
+#include "crc32.h"
+#include "delta.h"
+#include "flash.h"
+#include "stm32f10x_cfg.h"
+#include "trace.h"
+#include "assert.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[ota]"
+
+/* delta patch is written to staging area as it arrives, every finished 
+ * page is recorded in state page so download resumes after link loss or
+ * reboot, bootloader rebuilds application area from verified patch */
+static uint32_t g_size = 0;
+static uint32_t g_crc = 0;
+static volatile uint32_t g_offset = 0;
+static volatile bool g_active = FALSE;
+
+/**
+ * @brief read halfword from ota state page
+ * @param offset - halfword offset
+ * @return halfword
+ */
+static __INLINE uint16_t state_half(uint32_t offset)
+{
+    return *(volatile const uint16_t *)(FLASH_OTA_ADDR + offset);
+}
+
+/**
+ * @brief read word from ota state page
+ * @param offset - word offset
+ * @return word
+ */
+static __INLINE uint32_t state_word(uint32_t offset)
+{
+    return *(volatile const uint32_t *)(FLASH_OTA_ADDR + offset);
+}
+
+/**
+ * @brief set flag in ota state page
+ * @param offset - flag offset
+ */
+static void state_set(uint32_t offset)
+{
+    uint16_t flag = OTA_FLAG_SET;
+    flash_program(FLASH_OTA_ADDR + offset, (uint8_t *)&flag, 2);
+}
+
+/**
+ * @brief get resume offset from received pages
+ * @return resume offset
+ */
+static uint32_t received_offset(void)
+{
+    uint32_t offset = 0;
+    for (uint8_t i = 0; i < OTA_STAGING_PAGES; ++i)
+    {
+        if (OTA_FLAG_SET != state_half(OTA_OFFSET_RECEIVED + i * 2))
+        {
+            break;
+        }
+        offset += FLASH_PAGE_SIZE;
+    }
+
+    return (offset > g_size) ? g_size : offset;
+}
+
+/**
+ * @brief feed rebuilt page content into crc
+ * @param arg - crc context
+ * @param data - page content
+ * @param len - content length
+ */
+static void page_crc(void *arg, const uint8_t *data, uint32_t len)
+{
+    crc32_update((crc32_ctx *)arg, data, len);
+}
+
+/**
+ * @brief check staged patch rebuilds every page of new image exactly once
+ *        from running image, the same way bootloader applies it
+ * @return error code
+ */
+static int verify_patch(void)
+{
+    const uint8_t *patch = (const uint8_t *)FLASH_STAGING_ADDR;
+    delta_header header;
+    if (!delta_header_get(patch, g_size, &header))
+    {
+        return -OTA_ERR_FORMAT;
+    }
+
+    if (header.old_crc != crc32_calc((const void *)FLASH_APP_ADDR, 
+                                     header.old_size))
+    {
+        /* patch is made for another image */
+        return -OTA_ERR_BASE;
+    }
+
+    uint32_t written[DELTA_BITMAP_WORDS] = {0};
+    uint32_t offset = DELTA_HEADER_SIZE;
+    for (uint16_t i = 0; i < header.pages; ++i)
+    {
+        delta_seg seg;
+        crc32_ctx ctx;
+        crc32_init(&ctx);
+        offset = delta_segment(patch, g_size, offset, &header, written, &seg,
+                               page_crc, &ctx);
+        if ((0 == offset) || 
+            (0 != (written[seg.page >> 5] & (1UL << (seg.page & 0x1f)))) ||
+            (crc32_final(&ctx) != seg.crc))
+        {
+            return -OTA_ERR_FORMAT;
+        }
+        written[seg.page >> 5] |= (1UL << (seg.page & 0x1f));
+    }
+
+    return (offset == g_size) ? OTA_ERR_OK : -OTA_ERR_FORMAT;
+}
+
+/**
+ * @brief initialize ota, pick up unfinished download
+ */
+void ota_init(void)
+{
+    if (OTA_MAGIC != state_half(OTA_OFFSET_MAGIC))
+    {
+        return ;
+    }
+
+    if (OTA_FLAG_SET == state_half(OTA_OFFSET_INSTALLED))
+    {
+        TRACE("firmware updated, patch size: %d, crc: 0x%08x\r\n",
+              state_word(OTA_OFFSET_SIZE), state_word(OTA_OFFSET_CRC));
+    }
+    else if (OTA_FLAG_CLEAR == state_half(OTA_OFFSET_READY))
+    {
+        g_size = state_word(OTA_OFFSET_SIZE);
+        g_crc = state_word(OTA_OFFSET_CRC);
+        g_offset = received_offset();
+        g_active = TRUE;
+        TRACE("download interrupted at %d/%d\r\n", g_offset, g_size);
+    }
+}
+
+/**
+ * @brief start patch download, same patch resumes from last finished page
+ * @param size - patch size
+ * @param crc - patch crc32
+ * @return error code
+ */
+int ota_begin(uint32_t size, uint32_t crc)
+{
+    if ((0 == size) || (size > FLASH_STAGING_SIZE))
+    {
+        return -OTA_ERR_SIZE;
+    }
+
+    if ((OTA_MAGIC == state_half(OTA_OFFSET_MAGIC)) &&
+        (OTA_FLAG_CLEAR == state_half(OTA_OFFSET_READY)) &&
+        (size == state_word(OTA_OFFSET_SIZE)) &&
+        (crc == state_word(OTA_OFFSET_CRC)))
+    {
+        g_size = size;
+        g_crc = crc;
+        g_offset = received_offset();
+        g_active = TRUE;
+        TRACE("resume download at %d/%d\r\n", g_offset, g_size);
+        return OTA_ERR_OK;
+    }
+
+    flash_erase(FLASH_OTA_ADDR);
+    flash_program(FLASH_OTA_ADDR + OTA_OFFSET_SIZE, (uint8_t *)&size, 4);
+    flash_program(FLASH_OTA_ADDR + OTA_OFFSET_CRC, (uint8_t *)&crc, 4);
+    /* magic last, torn state page is not a valid download */
+    uint16_t magic = OTA_MAGIC;
+    flash_program(FLASH_OTA_ADDR + OTA_OFFSET_MAGIC, (uint8_t *)&magic, 2);
+    g_size = size;
+    g_crc = crc;
+    g_offset = 0;
+    g_active = TRUE;
+    TRACE("start download, size: %d, crc: 0x%08x\r\n", size, crc);
+
+    return OTA_ERR_OK;
+}
+
+/**
+ * @brief check if download is in progress
+ */
+bool ota_active(void)
+{
+    return g_active;
+}
+
+/**
+ * @brief get offset of next expected chunk
+ * @return patch offset
+ */
+uint32_t ota_offset(void)
+{
+    return g_offset;
+}
+
+/**
+ * @brief write patch chunk to staging area, chunks must arrive in order
+ *        and only last chunk may have odd length
+ * @param offset - chunk offset in patch
+ * @param data - chunk data
+ * @param len - chunk length
+ * @return error code
+ */
+int ota_write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    assert_param(NULL != data);
+    if (!g_active)
+    {
+        return -OTA_ERR_STATE;
+    }
+
+    if (offset != g_offset)
+    {
+        return -OTA_ERR_OFFSET;
+    }
+
+    if ((offset + len > g_size) ||
+        ((0 != (len & 0x01)) && (offset + len != g_size)))
+    {
+        return -OTA_ERR_SIZE;
+    }
+
+    while (len > 0)
+    {
+        uint32_t page = g_offset / FLASH_PAGE_SIZE;
+        uint32_t pos = g_offset % FLASH_PAGE_SIZE;
+        uint32_t size = FLASH_PAGE_SIZE - pos;
+        if (size > len)
+        {
+            size = len;
+        }
+
+        if (0 == pos)
+        {
+            flash_erase(FLASH_STAGING_ADDR + page * FLASH_PAGE_SIZE);
+        }
+        flash_program(FLASH_STAGING_ADDR + g_offset, (uint8_t *)data, size);
+        g_offset += size;
+        data += size;
+        len -= size;
+
+        if ((0 == (g_offset % FLASH_PAGE_SIZE)) || (g_offset == g_size))
+        {
+            state_set(OTA_OFFSET_RECEIVED + page * 2);
+        }
+    }
+
+    return OTA_ERR_OK;
+}
+
+/**
+ * @brief verify staged patch and hand it over to bootloader
+ * @return error code
+ */
+int ota_finish(void)
+{
+    if (!g_active)
+    {
+        return -OTA_ERR_STATE;
+    }
+
+    if (g_offset != g_size)
+    {
+        return -OTA_ERR_SIZE;
+    }
+
+    /* verify what is actually in flash, page by page */
+    crc32_ctx ctx;
+    crc32_init(&ctx);
+    for (uint32_t offset = 0; offset < g_size; offset += FLASH_PAGE_SIZE)
+    {
+        uint32_t size = g_size - offset;
+        if (size > FLASH_PAGE_SIZE)
+        {
+            size = FLASH_PAGE_SIZE;
+        }
+        crc32_update(&ctx, (const void *)(FLASH_STAGING_ADDR + offset), size);
+    }
+
+    if (crc32_final(&ctx) != g_crc)
+    {
+        TRACE("patch crc error: 0x%08x\r\n", crc32_final(&ctx));
+        ota_abort();
+        return -OTA_ERR_CRC;
+    }
+
+    int ret = verify_patch();
+    if (OTA_ERR_OK != ret)
+    {
+        TRACE("patch error: %d\r\n", ret);
+        ota_abort();
+        return ret;
+    }
+
+    state_set(OTA_OFFSET_READY);
+    g_active = FALSE;
+    TRACE("patch ready, install on reboot\r\n");
+    return OTA_ERR_OK;
+}
+
+/**
+ * @brief drop download
+ */
+void ota_abort(void)
+{
+    flash_erase(FLASH_OTA_ADDR);
+    g_active = FALSE;
+    g_offset = 0;
+}
@@ -0,0 +1,59 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _OTA_H_
+  #define _OTA_H_
+
+#include "types.h"
+#include "flash_map.h"
+
+BEGIN_DECLS
+
+/* ota state page, shared with bootloader, every flag is a halfword 
+ * programmed from 0xffff to 0x0000
+ *
+ * magic | size | crc | ready | installed | received[] | buffered[] | done[]
+ *
+ * size and crc belong to staged patch, received counts staging pages, 
+ * buffered and done are per application page rebuilt by bootloader
+ */
+#define OTA_MAGIC             (0x4f54)
+#define OTA_STAGING_PAGES     (FLASH_STAGING_SIZE / FLASH_PAGE_SIZE)
+#define OTA_APP_PAGES         (FLASH_APP_SIZE / FLASH_PAGE_SIZE)
+
+#define OTA_OFFSET_MAGIC      (0)
+#define OTA_OFFSET_SIZE       (4)
+#define OTA_OFFSET_CRC        (8)
+#define OTA_OFFSET_READY      (12)
+#define OTA_OFFSET_INSTALLED  (14)
+#define OTA_OFFSET_RECEIVED   (16)
+#define OTA_OFFSET_BUFFERED   (OTA_OFFSET_RECEIVED + OTA_STAGING_PAGES * 2)
+#define OTA_OFFSET_DONE       (OTA_OFFSET_BUFFERED + OTA_APP_PAGES * 2)
+
+#define OTA_FLAG_SET          (0x0000)
+#define OTA_FLAG_CLEAR        (0xffff)
+
+/* error code */
+#define OTA_ERR_OK            0
+#define OTA_ERR_STATE         1
+#define OTA_ERR_SIZE          2
+#define OTA_ERR_OFFSET        3
+#define OTA_ERR_CRC           4
+#define OTA_ERR_BASE          5
+#define OTA_ERR_FORMAT        6
+
+void ota_init(void);
+int ota_begin(uint32_t size, uint32_t crc);
+bool ota_active(void);
+uint32_t ota_offset(void);
+int ota_write(uint32_t offset, const uint8_t *data, uint32_t len);
+int ota_finish(void);
+void ota_abort(void);
+
+END_DECLS
+
+#endif /* _OTA_H_ */
@@ -0,0 +1,471 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "outbox.h"
+#include "flash_map.h"
+#include "flash.h"
+#include "stm32f10x_cfg.h"
+#include "trace.h"
+#include "assert.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[outbox]"
+
+/* outbox is a log of records appended to a ring of flash pages, pages are
+ * reused in ring order so erase wear spreads over all pages
+ *
+ * page:   magic | seq | record | record | ...
+ * record: len | id | commit | sent | done | data
+ *
+ * record states are separate halfwords programmed from 0xffff to 0x0000,
+ * a record is pending when it is committed and not done
+ */
+#define PAGE_MAGIC          (0x4f42)
+#define PAGE_HEAD_SIZE      (4)
+#define RECORD_HEAD_SIZE    (10)
+
+#define OFFSET_SEQ          (2)
+#define OFFSET_LEN          (0)
+#define OFFSET_ID           (2)
+#define OFFSET_COMMIT       (4)
+#define OFFSET_SENT         (6)
+#define OFFSET_DONE         (8)
+
+#define HALFWORD_FREE       (0xffff)
+#define HALFWORD_SET        (0x0000)
+
+/* oldest page in use and page being written */
+static uint8_t g_head = 0;
+static uint8_t g_tail = 0;
+static uint16_t g_seq = 0;
+/* next free record address */
+static uint32_t g_write = 0;
+/* next record to send */
+static uint32_t g_cursor = 0;
+static uint16_t g_last_id = 0;
+static uint32_t g_dropped = 0;
+
+static SemaphoreHandle_t xOutboxMutex = NULL;
+static StaticSemaphore_t xOutboxMutexBuffer;
+
+/**
+ * @brief get page start address
+ * @param page - page index
+ * @return page address
+ */
+static __INLINE uint32_t page_addr(uint8_t page)
+{
+    return FLASH_OUTBOX_ADDR + page * FLASH_PAGE_SIZE;
+}
+
+/**
+ * @brief get page of address, end of page belongs to page
+ * @param addr - address after page header
+ * @return page index
+ */
+static __INLINE uint8_t page_of(uint32_t addr)
+{
+    return (addr - 1 - FLASH_OUTBOX_ADDR) / FLASH_PAGE_SIZE;
+}
+
+/**
+ * @brief read halfword from flash
+ * @param addr - halfword address
+ * @return halfword
+ */
+static __INLINE uint16_t read_half(uint32_t addr)
+{
+    return *(volatile const uint16_t *)addr;
+}
+
+/**
+ * @brief program halfword to flash
+ * @param addr - halfword address
+ * @param val - halfword value
+ */
+static void write_half(uint32_t addr, uint16_t val)
+{
+    flash_program(addr, (uint8_t *)&val, 2);
+}
+
+/**
+ * @brief get record size in flash
+ * @param len - data length
+ * @return record size
+ */
+static __INLINE uint32_t record_size(uint16_t len)
+{
+    return RECORD_HEAD_SIZE + ((len + 1) & ~0x01);
+}
+
+/**
+ * @brief check if record is waiting for ack
+ * @param addr - record address
+ */
+static __INLINE bool record_pending(uint32_t addr)
+{
+    return (HALFWORD_SET == read_half(addr + OFFSET_COMMIT)) &&
+           (HALFWORD_FREE == read_half(addr + OFFSET_DONE));
+}
+
+/**
+ * @brief find record at or after address, crossing to next used page
+ * @param addr - search address
+ * @return record address, 0 if end of log
+ */
+static uint32_t record_seek(uint32_t addr)
+{
+    uint8_t page = page_of(addr);
+    for (;;)
+    {
+        uint32_t end = page_addr(page) + FLASH_PAGE_SIZE;
+        if (addr + RECORD_HEAD_SIZE <= end)
+        {
+            uint16_t len = read_half(addr + OFFSET_LEN);
+            if ((HALFWORD_FREE != len) && (addr + record_size(len) <= end))
+            {
+                return addr;
+            }
+        }
+
+        if (page == g_tail)
+        {
+            return 0;
+        }
+        page = (page + 1) % FLASH_OUTBOX_PAGES;
+        addr = page_addr(page) + PAGE_HEAD_SIZE;
+    }
+}
+
+/**
+ * @brief get next record
+ * @param addr - current record address
+ * @return next record address, 0 if end of log
+ */
+static __INLINE uint32_t record_next(uint32_t addr)
+{
+    return record_seek(addr + record_size(read_half(addr + OFFSET_LEN)));
+}
+
+/**
+ * @brief count pending records in page
+ * @param page - page index
+ * @return pending record count
+ */
+static uint16_t page_pending(uint8_t page)
+{
+    uint16_t count = 0;
+    uint32_t addr = record_seek(page_addr(page) + PAGE_HEAD_SIZE);
+    while ((0 != addr) && (page_of(addr) == page))
+    {
+        if (record_pending(addr))
+        {
+            count ++;
+        }
+        addr = record_next(addr);
+    }
+
+    return count;
+}
+
+/**
+ * @brief erase page and write header with next sequence
+ * @param page - page index
+ */
+static void open_page(uint8_t page)
+{
+    uint32_t addr = page_addr(page);
+    g_seq ++;
+    flash_erase(addr);
+    /* magic last, torn header is not a valid page */
+    write_half(addr + OFFSET_SEQ, g_seq);
+    write_half(addr, PAGE_MAGIC);
+    g_tail = page;
+    g_write = addr + PAGE_HEAD_SIZE;
+}
+
+/**
+ * @brief stop using oldest page
+ */
+static void release_head(void)
+{
+    assert_param(g_head != g_tail);
+    uint8_t old = g_head;
+    g_head = (g_head + 1) % FLASH_OUTBOX_PAGES;
+    if (page_of(g_cursor) == old)
+    {
+        g_cursor = page_addr(g_head) + PAGE_HEAD_SIZE;
+    }
+}
+
+/**
+ * @brief release oldest pages without pending records
+ */
+static void release_consumed(void)
+{
+    while ((g_head != g_tail) && (0 == page_pending(g_head)))
+    {
+        release_head();
+    }
+}
+
+/**
+ * @brief rebuild outbox state from flash
+ */
+static void scan(void)
+{
+    bool found = FALSE;
+    for (uint8_t i = 0; i < FLASH_OUTBOX_PAGES; ++i)
+    {
+        uint32_t addr = page_addr(i);
+        if (PAGE_MAGIC == read_half(addr))
+        {
+            uint16_t seq = read_half(addr + OFFSET_SEQ);
+            if (!found || ((int16_t)(seq - g_seq) > 0))
+            {
+                g_seq = seq;
+                g_tail = i;
+                found = TRUE;
+            }
+        }
+    }
+
+    if (!found)
+    {
+        open_page(0);
+        g_head = 0;
+        g_cursor = g_write;
+        return ;
+    }
+
+    /* walk back along sequence to oldest page */
+    g_head = g_tail;
+    uint16_t seq = g_seq;
+    for (uint8_t i = 1; i < FLASH_OUTBOX_PAGES; ++i)
+    {
+        uint8_t prev = (g_head + FLASH_OUTBOX_PAGES - 1) % FLASH_OUTBOX_PAGES;
+        seq --;
+        if ((PAGE_MAGIC != read_half(page_addr(prev))) ||
+            (seq != read_half(page_addr(prev) + OFFSET_SEQ)))
+        {
+            break;
+        }
+        g_head = prev;
+    }
+
+    /* find write position in tail page */
+    uint32_t end = page_addr(g_tail) + FLASH_PAGE_SIZE;
+    g_write = page_addr(g_tail) + PAGE_HEAD_SIZE;
+    while ((g_write + RECORD_HEAD_SIZE <= end) &&
+           (HALFWORD_FREE != read_half(g_write + OFFSET_LEN)))
+    {
+        g_write += record_size(read_half(g_write + OFFSET_LEN));
+    }
+    if (g_write > end)
+    {
+        g_write = end;
+    }
+
+    /* packet id continues after last stored record */
+    uint32_t addr = record_seek(page_addr(g_head) + PAGE_HEAD_SIZE);
+    while (0 != addr)
+    {
+        g_last_id = read_half(addr + OFFSET_ID);
+        addr = record_next(addr);
+    }
+
+    g_cursor = page_addr(g_head) + PAGE_HEAD_SIZE;
+    release_consumed();
+}
+
+/**
+ * @brief initialize outbox
+ */
+bool outbox_init(void)
+{
+    TRACE("initialize outbox...\r\n");
+    xOutboxMutex = xSemaphoreCreateMutexStatic(&xOutboxMutexBuffer);
+    if (NULL == xOutboxMutex)
+    {
+        return FALSE;
+    }
+
+    scan();
+    TRACE("pending: %d, last id: %d\r\n", outbox_pending(), g_last_id);
+    return TRUE;
+}
+
+/**
+ * @brief append message to outbox, oldest page is dropped when full
+ * @param id - packet id
+ * @param data - message data
+ * @param len - message length
+ * @return append status
+ */
+bool outbox_append(uint16_t id, const uint8_t *data, uint8_t len)
+{
+    assert_param(NULL != data);
+    assert_param(record_size(len) <= FLASH_PAGE_SIZE - PAGE_HEAD_SIZE);
+
+    xSemaphoreTake(xOutboxMutex, portMAX_DELAY);
+    uint32_t size = record_size(len);
+    if (g_write + size > page_addr(g_tail) + FLASH_PAGE_SIZE)
+    {
+        uint8_t next = (g_tail + 1) % FLASH_OUTBOX_PAGES;
+        if (next == g_head)
+        {
+            uint16_t lost = page_pending(g_head);
+            g_dropped += lost;
+            TRACE("outbox full, drop %d, total %d\r\n", lost, g_dropped);
+            release_head();
+        }
+        open_page(next);
+    }
+
+    uint32_t addr = g_write;
+    write_half(addr + OFFSET_LEN, len);
+    write_half(addr + OFFSET_ID, id);
+    flash_program(addr + RECORD_HEAD_SIZE, (uint8_t *)data, len);
+    /* commit last, torn record is skipped after reboot */
+    write_half(addr + OFFSET_COMMIT, HALFWORD_SET);
+    g_write += size;
+    g_last_id = id;
+    xSemaphoreGive(xOutboxMutex);
+
+    return TRUE;
+}
+
+/**
+ * @brief get next pending message to send, message longer than output
+ *        buffer can never be sent and is dropped
+ * @param data - message output
+ * @param size - output buffer size
+ * @param dup - message was sent before
+ * @return message length, at most size, 0 if nothing to send
+ */
+uint8_t outbox_next(uint8_t *data, uint8_t size, bool *dup)
+{
+    assert_param(NULL != data);
+    assert_param(NULL != dup);
+    uint8_t len = 0;
+
+    xSemaphoreTake(xOutboxMutex, portMAX_DELAY);
+    uint32_t addr = record_seek(g_cursor);
+    while ((0 != addr) && 
+           (!record_pending(addr) || (read_half(addr + OFFSET_LEN) > size)))
+    {
+        if (record_pending(addr))
+        {
+            /* written by a build with larger messages */
+            write_half(addr + OFFSET_DONE, HALFWORD_SET);
+            g_dropped ++;
+            TRACE("drop oversized message %d\r\n", 
+                  read_half(addr + OFFSET_ID));
+        }
+        addr = record_next(addr);
+    }
+
+    if (0 != addr)
+    {
+        len = (uint8_t)read_half(addr + OFFSET_LEN);
+        FLASH_Read(addr + RECORD_HEAD_SIZE, data, len);
+        *dup = (HALFWORD_SET == read_half(addr + OFFSET_SENT));
+        if (!*dup)
+        {
+            write_half(addr + OFFSET_SENT, HALFWORD_SET);
+        }
+        g_cursor = addr + record_size(len);
+    }
+    else
+    {
+        g_cursor = g_write;
+    }
+    xSemaphoreGive(xOutboxMutex);
+
+    return len;
+}
+
+/**
+ * @brief message acknowledged by server
+ * @param id - packet id
+ */
+void outbox_ack(uint16_t id)
+{
+    xSemaphoreTake(xOutboxMutex, portMAX_DELAY);
+    uint32_t addr = record_seek(page_addr(g_head) + PAGE_HEAD_SIZE);
+    while (0 != addr)
+    {
+        if ((id == read_half(addr + OFFSET_ID)) && record_pending(addr))
+        {
+            write_half(addr + OFFSET_DONE, HALFWORD_SET);
+            break;
+        }
+        addr = record_next(addr);
+    }
+    release_consumed();
+    xSemaphoreGive(xOutboxMutex);
+}
+
+/**
+ * @brief send pending messages again from oldest, used on new session
+ */
+void outbox_rewind(void)
+{
+    xSemaphoreTake(xOutboxMutex, portMAX_DELAY);
+    g_cursor = page_addr(g_head) + PAGE_HEAD_SIZE;
+    xSemaphoreGive(xOutboxMutex);
+}
+
+/**
+ * @brief drop all messages
+ */
+void outbox_clear(void)
+{
+    xSemaphoreTake(xOutboxMutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < FLASH_OUTBOX_PAGES; ++i)
+    {
+        flash_erase(page_addr(i));
+    }
+    open_page(0);
+    g_head = 0;
+    g_cursor = g_write;
+    xSemaphoreGive(xOutboxMutex);
+}
+
+/**
+ * @brief get pending message count
+ * @return pending message count
+ */
+uint16_t outbox_pending(void)
+{
+    uint16_t count = 0;
+    xSemaphoreTake(xOutboxMutex, portMAX_DELAY);
+    uint8_t page = g_head;
+    for (;;)
+    {
+        count += page_pending(page);
+        if (page == g_tail)
+        {
+            break;
+        }
+        page = (page + 1) % FLASH_OUTBOX_PAGES;
+    }
+    xSemaphoreGive(xOutboxMutex);
+
+    return count;
+}
+
+/**
+ * @brief get packet id of last stored message
+ * @return packet id
+ */
+uint16_t outbox_last_id(void)
+{
+    return g_last_id;
+}
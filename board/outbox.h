@@ -0,0 +1,26 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _OUTBOX_H_
+  #define _OUTBOX_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+bool outbox_init(void);
+bool outbox_append(uint16_t id, const uint8_t *data, uint8_t len);
+uint8_t outbox_next(uint8_t *data, uint8_t size, bool *dup);
+void outbox_ack(uint16_t id);
+void outbox_rewind(void);
+void outbox_clear(void);
+uint16_t outbox_pending(void);
+uint16_t outbox_last_id(void);
+
+END_DECLS
+
+#endif /* _OUTBOX_H_ */
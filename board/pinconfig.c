@@ -8,6 +8,7 @@
 #include <string.h>
 #include "pinconfig.h"
 #include "stm32f10x_cfg.h"
+#include "config.h"
 
 
 /* pin configure structure */
@@ -37,6 +38,13 @@ typedef struct
 /* pin arrays */
 PIN_CONFIG pins[] = 
 {
+#if CONFIG_MOTOR_EXPANDER
+    {"MOT_LOAD", GPIOA, 1, GPIO_Speed_2MHz, GPIO_Mode_Out_PP},
+    {"MOT_LATCH", GPIOA, 4, GPIO_Speed_2MHz, GPIO_Mode_Out_PP},
+    {"MOT_SCK", GPIOA, 5, GPIO_Speed_50MHz, GPIO_Mode_AF_PP},
+    {"MOT_MISO", GPIOA, 6, GPIO_Speed_2MHz, GPIO_Mode_IN_FLOATING},
+    {"MOT_MOSI", GPIOA, 7, GPIO_Speed_50MHz, GPIO_Mode_AF_PP},
+#else
     {"CON_L1", GPIOC, 9, GPIO_Speed_2MHz, GPIO_Mode_Out_PP},
     {"CON_L2", GPIOC, 8, GPIO_Speed_2MHz, GPIO_Mode_Out_PP},
     {"CON_L3", GPIOC, 7, GPIO_Speed_2MHz, GPIO_Mode_Out_PP},
@@ -55,6 +63,7 @@ PIN_CONFIG pins[] =
     {"CH8_DET", GPIOC, 5, GPIO_Speed_2MHz, GPIO_Mode_IN_FLOATING},
     {"CH9_DET", GPIOB, 0, GPIO_Speed_2MHz, GPIO_Mode_IN_FLOATING},
     {"CH10_DET", GPIOB, 1, GPIO_Speed_2MHz, GPIO_Mode_IN_FLOATING},
+#endif
     {"MOT_DET", GPIOC, 3, GPIO_Speed_2MHz, GPIO_Mode_IPD},
     {"DEBUG_TX", GPIOA, 9, GPIO_Speed_50MHz, GPIO_Mode_AF_PP},
     {"DEBUG_RX", GPIOA, 10, GPIO_Speed_2MHz, GPIO_Mode_IN_FLOATING},
@@ -86,8 +95,12 @@ PIN_CLOCK pin_clocks[] =
     {APB2, RCC_APB2_RESET_IOPB, RCC_APB2_ENABLE_IOPB},
     {APB2, RCC_APB2_RESET_IOPC, RCC_APB2_ENABLE_IOPC},
     {APB2, RCC_APB2_RESET_USART1, RCC_APB2_ENABLE_USART1},
+#if CONFIG_MOTOR_EXPANDER
+    {APB2, RCC_APB2_RESET_SPI1, RCC_APB2_ENABLE_SPI1},
+#endif
     {APB1, RCC_APB1_RESET_USART2, RCC_APB1_ENABLE_USART2},
     {APB1, RCC_APB1_RESET_USART3, RCC_APB1_ENABLE_USART3},
+    {APB1, RCC_APB1_RESET_TIM2, RCC_APB1_ENABLE_TIM2},
 };
 
 /**
@@ -217,3 +230,94 @@ void get_pininfo(const char *name, uint8_t *group, uint8_t *num)
     }
 }
 
+
+/**
+ * @brief build gather table, pin n of names becomes bit n
+ * @param gather - gather table
+ * @param names - pin names
+ * @param count - pin count
+ */
+void pin_gather_init(pin_gather *gather, const char * const *names,
+                     uint8_t count)
+{
+    assert_param(NULL != gather);
+    assert_param(count <= PIN_GATHER_MAX_PINS);
+    pin_run *run = NULL;
+    gather->ports = 0;
+    gather->run_num = 0;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        const PIN_CONFIG *config = get_pinconfig(names[i]);
+        assert_param(config != NULL);
+        uint8_t group = config->group;
+        uint8_t pin = config->config.pin;
+        if ((NULL != run) && (run->group == group) &&
+            (pin - run->pin == i - run->bit))
+        {
+            /* extends current run */
+            run->mask = (run->mask << 1) | 0x01;
+            continue;
+        }
+
+        assert_param(gather->run_num < PIN_GATHER_MAX_RUNS);
+        run = &gather->runs[gather->run_num++];
+        run->group = group;
+        run->pin = pin;
+        run->bit = i;
+        run->mask = 0x01;
+        gather->ports |= (1 << group);
+    }
+}
+
+/**
+ * @brief read input data register of ports once
+ * @param ports - ports to read, bit n is port n
+ * @param snapshot - port values, PIN_GROUP_NUM entries
+ */
+void pin_snapshot(uint8_t ports, uint16_t *snapshot)
+{
+    assert_param(NULL != snapshot);
+    for (uint8_t group = 0; group < PIN_GROUP_NUM; ++group)
+    {
+        if (0 != (ports & (1 << group)))
+        {
+            snapshot[group] = GPIO_ReadDataGroup((GPIO_Group)group);
+        }
+    }
+}
+
+/**
+ * @brief extract gathered pins from port snapshot
+ * @param gather - gather table
+ * @param snapshot - port values taken with gather ports
+ * @return pin bits, bit n is pin n
+ */
+uint32_t pin_gather_extract(const pin_gather *gather,
+                            const uint16_t *snapshot)
+{
+    assert_param(NULL != gather);
+    assert_param(NULL != snapshot);
+    uint32_t bits = 0;
+    const pin_run *run = gather->runs;
+    for (uint8_t i = 0; i < gather->run_num; ++i, ++run)
+    {
+        bits |= (uint32_t)((snapshot[run->group] >> run->pin) & run->mask)
+                << run->bit;
+    }
+
+    return bits;
+}
+
+/**
+ * @brief read gathered pins, one register read per port
+ * @param gather - gather table
+ * @return pin bits, bit n is pin n
+ */
+uint32_t pin_gather_read(const pin_gather *gather)
+{
+    assert_param(NULL != gather);
+    uint16_t snapshot[PIN_GROUP_NUM];
+    pin_snapshot(gather->ports, snapshot);
+
+    return pin_gather_extract(gather, snapshot);
+}
@@ -12,12 +12,39 @@
 
 BEGIN_DECLS
 
+/* gather table, pins are read as port snapshots and packed into bits */
+#define PIN_GATHER_MAX_RUNS   (8)
+#define PIN_GATHER_MAX_PINS   (32)
+#define PIN_GROUP_NUM         (7)     /* GPIOA - GPIOG */
+
+/* adjacent pins of one port that land on adjacent bits */
+typedef struct
+{
+    uint8_t group;
+    uint8_t pin;
+    uint8_t bit;
+    uint16_t mask;
+}pin_run;
+
+typedef struct
+{
+    uint8_t ports;
+    uint8_t run_num;
+    pin_run runs[PIN_GATHER_MAX_RUNS];
+}pin_gather;
+
 void pin_init(void);
 void pin_set(const char *name);
 void pin_reset(const char *name);
 void pin_toggle(const char *name);
 bool is_pinset(const char *name);
 void get_pininfo(const char *name, uint8_t *group, uint8_t *num);
+void pin_gather_init(pin_gather *gather, const char * const *names,
+                     uint8_t count);
+void pin_snapshot(uint8_t ports, uint16_t *snapshot);
+uint32_t pin_gather_extract(const pin_gather *gather,
+                            const uint16_t *snapshot);
+uint32_t pin_gather_read(const pin_gather *gather);
 
 END_DECLS
 
@@ -0,0 +1,54 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "power.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "runstats.h"
+
+/**
+ * Core only enters sleep mode (wfi) in tickless idle, peripherals and 
+ * clocks keep running, so usart receive, exti and timer interrupts wake 
+ * it up within a few cycles. Stop mode is not used: usart can not wake 
+ * the core from stop mode and the first received bytes of a modem frame 
+ * would be lost while hse and pll restart.
+ */
+
+static power_stats g_stats;
+static uint32_t g_sleep_start = 0;
+
+/**
+ * @brief called before core sleeps, interrupts are disabled
+ * @param idle - expected idle ticks
+ */
+void power_pre_sleep(unsigned long idle)
+{
+    g_stats.count ++;
+    g_stats.idle += idle;
+    g_sleep_start = runstats_timer_value();
+}
+
+/**
+ * @brief called after core wakes up, interrupts are still disabled
+ * @param idle - expected idle ticks
+ */
+void power_post_sleep(unsigned long idle)
+{
+    g_stats.time += (runstats_timer_value() - g_sleep_start);
+}
+
+/**
+ * @brief get sleep residency statistics
+ * @param stats - statistics output
+ */
+void power_get_stats(power_stats *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = g_stats;
+    taskEXIT_CRITICAL();
+}
+
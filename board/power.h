@@ -0,0 +1,30 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _POWER_H_
+  #define _POWER_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* sleep residency statistics */
+typedef struct
+{
+    uint32_t count;      /* sleep times */
+    uint32_t time;       /* total sleep time, in runtime statistics counts */
+    uint32_t idle;       /* total expected idle ticks */
+}power_stats;
+
+void power_pre_sleep(unsigned long idle);
+void power_post_sleep(unsigned long idle);
+void power_get_stats(power_stats *stats);
+
+END_DECLS
+
+#endif /* _POWER_H_ */
+
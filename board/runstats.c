@@ -0,0 +1,285 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "runstats.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include "trace.h"
+#include "global.h"
+#include "stm32f10x_cfg.h"
+#include "wifi.h"
+#include "power.h"
+#include "mempool.h"
+#include "sysinit.h"
+#include "ir.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[runstats]"
+
+/* statistics counter frequency, 10 times of tick rate */
+#define RUNSTATS_TIMER_HZ       (10000)
+/* statistics collect period */
+#define RUNSTATS_PERIOD         (60000 / portTICK_PERIOD_MS)
+#define RUNSTATS_MAX_TASKS      (16)
+/* max payload in one publish message */
+#define RUNSTATS_MSG_LEN        (90)
+#define RUNSTATS_MAX_POOLS      (4)
+
+/* high 16 bits of statistics counter */
+static volatile uint16_t g_timer_high = 0;
+
+/* task status buffer */
+static TaskStatus_t g_status[RUNSTATS_MAX_TASKS];
+/* last snapshot */
+static task_stats g_stats[RUNSTATS_MAX_TASKS];
+static uint8_t g_stats_count = 0;
+/* task run time of last period */
+static TaskHandle_t g_last_task[RUNSTATS_MAX_TASKS];
+static uint32_t g_last_runtime[RUNSTATS_MAX_TASKS];
+static uint32_t g_last_total = 0;
+/* sleep residency of last period */
+static uint32_t g_last_sleep = 0;
+static uint32_t g_last_wakeups = 0;
+static uint16_t g_sleep = 0;
+static uint32_t g_wakeups = 0;
+
+static StaticTimer_t xRunStatsTimerBuffer;
+
+/**
+ * @brief timer2 interrupt handler, extend counter to 32 bits
+ */
+void TIM2_IRQHandler(void)
+{
+    if (TIM_IsFlagOn(TIM2, TIM_FLAG_UPDATE))
+    {
+        TIM_ClearFlag(TIM2, TIM_FLAG_UPDATE);
+        g_timer_high ++;
+    }
+}
+
+/**
+ * @brief initialize statistics timer, called by kernel when scheduler
+ *        start
+ */
+void runstats_timer_init(void)
+{
+    uint16_t prescaler = TIM_GetClock(TIM2) / RUNSTATS_TIMER_HZ - 1;
+    TIM_Setup(TIM2, prescaler, 0xffff);
+    TIM_EnableInt(TIM2, TIM_IT_UPDATE, TRUE);
+    NVIC_Config nvicConfig = {TIM2_IRQChannel, TIM2_PRIORITY, 0, TRUE};
+    NVIC_Init(&nvicConfig);
+    TIM_Enable(TIM2, TRUE);
+}
+
+/**
+ * @brief get statistics counter value
+ * @return counter value
+ */
+unsigned long runstats_timer_value(void)
+{
+    uint16_t high = 0;
+    uint16_t low = 0;
+    do
+    {
+        high = g_timer_high;
+        low = TIM_GetCounter(TIM2);
+    } while (high != g_timer_high);
+
+    /* overflow happened but interrupt not served yet, e.g. in critical
+       section */
+    if (TIM_IsFlagOn(TIM2, TIM_FLAG_UPDATE) && (low < 0x8000))
+    {
+        high ++;
+    }
+
+    return ((uint32_t)high << 16) | low;
+}
+
+/**
+ * @brief get last run time of task
+ * @param handle - task handle
+ * @return last run time
+ */
+static uint32_t last_runtime(TaskHandle_t handle)
+{
+    for (int i = 0; i < RUNSTATS_MAX_TASKS; ++i)
+    {
+        if (g_last_task[i] == handle)
+        {
+            return g_last_runtime[i];
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief collect task statistics
+ */
+static void collect_stats(void)
+{
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(g_status, RUNSTATS_MAX_TASKS, 
+                                             &total);
+    if (0 == count)
+    {
+        TRACE("too many tasks to collect\r\n");
+        return ;
+    }
+
+    uint32_t period = total - g_last_total;
+    g_last_total = total;
+    if (0 == period)
+    {
+        period = 1;
+    }
+
+    power_stats power;
+    power_get_stats(&power);
+    g_sleep = (uint16_t)((uint64_t)(power.time - g_last_sleep) * 1000 / 
+                         period);
+    g_wakeups = power.count - g_last_wakeups;
+    g_last_sleep = power.time;
+    g_last_wakeups = power.count;
+    
+    for (UBaseType_t i = 0; i < count; ++i)
+    {
+        uint32_t runtime = g_status[i].ulRunTimeCounter - 
+                           last_runtime(g_status[i].xHandle);
+        g_stats[i].name = g_status[i].pcTaskName;
+        g_stats[i].cpu = (uint16_t)((uint64_t)runtime * 1000 / period);
+        g_stats[i].stack = g_status[i].usStackHighWaterMark;
+    }
+
+    for (UBaseType_t i = 0; i < RUNSTATS_MAX_TASKS; ++i)
+    {
+        if (i < count)
+        {
+            g_last_task[i] = g_status[i].xHandle;
+            g_last_runtime[i] = g_status[i].ulRunTimeCounter;
+        }
+        else
+        {
+            g_last_task[i] = NULL;
+            g_last_runtime[i] = 0;
+        }
+    }
+
+    g_stats_count = count;
+}
+
+/**
+ * @brief publish statistics snapshot, format:
+ *        "sleep permille/wakeups", "pool name used/max/count fail;", 
+ *        "conn ap auth/transient mqtt auth/transient reconnects 
+ *        last/max(ms) rx drops;", "boot init/link/online(ms);", "ir presence
+ *        count of last hour;", then 
+ *        "name cpu stack;" split into messages
+ */
+static void publish_stats(void)
+{
+    char msg[RUNSTATS_MSG_LEN + 1];
+    int len = 0;
+    mempool_stats pools[RUNSTATS_MAX_POOLS];
+    uint8_t pool_count = mempool_get_stats(pools, RUNSTATS_MAX_POOLS);
+    
+    len = sprintf(msg, "sleep %d/%d;", g_sleep, (int)g_wakeups);
+    for (uint8_t i = 0; i < pool_count; ++i)
+    {
+        if (len + 32 > RUNSTATS_MSG_LEN)
+        {
+            break;
+        }
+        len += sprintf(msg + len, "pool %s %d/%d/%d %d;", pools[i].name, 
+                       pools[i].used, pools[i].max_used, pools[i].count, 
+                       pools[i].fail);
+    }
+    
+    if (!wifi_publish_stats(msg))
+    {
+        return ;
+    }
+
+    conn_stats conn;
+    wifi_get_conn_stats(&conn);
+    sprintf(msg, "conn ap %d/%d mqtt %d/%d %d %d/%d rx %d;", 
+            conn.ap_auth_fail, conn.ap_transient, conn.broker_auth_fail,
+            conn.broker_transient, conn.reconnects, 
+            (int)conn.last_reconnect, (int)conn.max_reconnect, 
+            (int)conn.rx_drops);
+    wifi_publish_stats(msg);
+    sprintf(msg, "boot %d/%d/%d;", (int)sysinit_phase_time(BOOT_INIT),
+            (int)sysinit_phase_time(BOOT_LINK),
+            (int)sysinit_phase_time(BOOT_ONLINE));
+    wifi_publish_stats(msg);
+    sprintf(msg, "ir %d;", ir_traffic());
+    wifi_publish_stats(msg);
+    len = 0;
+
+    for (uint8_t i = 0; i < g_stats_count; ++i)
+    {
+        /* name + two numbers and separators */
+        if (len + configMAX_TASK_NAME_LEN + 12 > RUNSTATS_MSG_LEN)
+        {
+            wifi_publish_stats(msg);
+            len = 0;
+        }
+        len += sprintf(msg + len, "%s %d %d;", g_stats[i].name, 
+                       g_stats[i].cpu, g_stats[i].stack);
+    }
+
+    if (len > 0)
+    {
+        wifi_publish_stats(msg);
+    }
+}
+
+/**
+ * @brief statistics timer callback
+ * @param xTimer - timer handle
+ */
+static void vRunStats(TimerHandle_t xTimer)
+{
+    vTaskSuspendAll();
+    collect_stats();
+    xTaskResumeAll();
+    publish_stats();
+}
+
+/**
+ * @brief get last statistics snapshot
+ * @param stats - task statistics output
+ * @param max - max task statistics count
+ * @return task statistics count
+ */
+uint8_t runstats_get(task_stats *stats, uint8_t max)
+{
+    uint8_t count = 0;
+    vTaskSuspendAll();
+    count = (g_stats_count < max) ? g_stats_count : max;
+    memcpy(stats, g_stats, count * sizeof(task_stats));
+    xTaskResumeAll();
+
+    return count;
+}
+
+/**
+ * @brief initialize runtime statistics
+ */
+void runstats_init(void)
+{
+    TRACE("initialize runtime statistics...\r\n");
+    TimerHandle_t xTimer = xTimerCreateStatic("runstats", RUNSTATS_PERIOD, 
+                                              pdTRUE, NULL, vRunStats,
+                                              &xRunStatsTimerBuffer);
+    assert_param(NULL != xTimer);
+    xTimerStart(xTimer, 0);
+}
+
@@ -0,0 +1,31 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _RUNSTATS_H_
+  #define _RUNSTATS_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* task statistics */
+typedef struct
+{
+    const char *name;
+    uint16_t cpu;       /* cpu usage in permille during last period */
+    uint16_t stack;     /* stack high water mark in words */
+}task_stats;
+
+void runstats_init(void);
+void runstats_timer_init(void);
+unsigned long runstats_timer_value(void);
+uint8_t runstats_get(task_stats *stats, uint8_t max);
+
+END_DECLS
+
+#endif /* _RUNSTATS_H_ */
+
@@ -12,6 +12,8 @@
 #include "serial.h"
 #include "global.h"
 #include "dbgserial.h"
+#include "mempool.h"
+#include "capture.h"
 
 /* serial handle definition */
 struct _serial_t
@@ -21,12 +23,36 @@ struct _serial_t
     USART_Config config;
 };
 
+/* max receive buffer length */
+#define SERIAL_MAX_RX_LEN    (128)
+
 /* The queue used to hold received characters. */
 static xQueueHandle xRxedChars[Port_Count];
+static StaticQueue_t xRxedQueueBuffer[Port_Count];
+static uint8_t ucRxedStorage[Port_Count][SERIAL_MAX_RX_LEN];
+
+/* receive error statistics */
+static serial_errors xErrors[Port_Count];
+
+/* usart of serial port */
+static const USART_Group xUsart[Port_Count] = {USART1, USART2, USART3};
+
+/* serial handle pool */
+static mempool g_serial_pool;
+MEMPOOL_STORAGE(g_serial_storage, sizeof(serial), Port_Count);
 
 #define SERIAL_NO_BLOCK						((portTickType)0)
 #define SERIAL_TX_BLOCK_TIME				(10 / portTICK_RATE_MS)
 
+/**
+ * @brief initialize serial resource
+ */
+void serial_init(void)
+{
+    mempool_init(&g_serial_pool, "serial", g_serial_storage, sizeof(serial),
+                 Port_Count);
+}
+
 /**
  * @brief get system serial resource
  * @return serial handle
@@ -34,13 +60,13 @@ static xQueueHandle xRxedChars[Port_Count];
 serial *serial_request(Port port)
 {
     assert_param(port < Port_Count);
-    serial *pserial = pvPortMalloc(sizeof(serial) / sizeof(char));
+    serial *pserial = mempool_alloc(&g_serial_pool);
     if (NULL == pserial)
     {
         return NULL;
     }
     pserial->port = port;
-    pserial->rxBufLen = 128;
+    pserial->rxBufLen = SERIAL_MAX_RX_LEN;
     USART_StructInit(&pserial->config);
 
     return pserial;
@@ -52,7 +78,7 @@ serial *serial_request(Port port)
  */
 void serial_release(serial *pserial)
 {
-    vPortFree(pserial);
+    mempool_free(&g_serial_pool, pserial);
 }
 
 /**
@@ -67,8 +93,10 @@ bool serial_open(serial *handle)
     NVIC_Config nvicConfig = {USART1_IRQChannel, USART1_PRIORITY, 0, TRUE};
     
     /* Create the queues used to hold Rx/Tx characters */
-	xRxedChars[handle->port] = xQueueCreate(handle->rxBufLen, 
-                                            (UBaseType_t)sizeof(portCHAR));
+	xRxedChars[handle->port] = xQueueCreateStatic(handle->rxBufLen, 
+                                            (UBaseType_t)sizeof(portCHAR),
+                                            ucRxedStorage[handle->port],
+                                            &xRxedQueueBuffer[handle->port]);
                                              
     if (NULL != xRxedChars[handle->port])
     {
@@ -133,7 +161,7 @@ void serial_close(serial *handle)
         break;
     }
     vQueueDelete(xRxedChars[pserial->port]);
-    vPortFree(handle);
+    mempool_free(&g_serial_pool, handle);
 }
 
 /**
@@ -141,13 +169,81 @@ void serial_close(serial *handle)
  * @param handle: serial handle
  * @param baudrate: baudrate
  */
-void serial_set_baudrate(serial *handle, Baudrate baudrate)
+void serial_set_baudrate(serial *handle, uint32_t baudrate)
 {
     assert_param(handle != NULL);
     serial *pserial = (serial *)handle;
     pserial->config.baudRate = baudrate;
 }
 
+/**
+ * @brief get serial port baudrate actually generated by usart
+ * @param handle: serial handle
+ * @return baudrate
+ */
+uint32_t serial_get_baudrate(serial *handle)
+{
+    assert_param(handle != NULL);
+    return USART_GetBaudrate(xUsart[handle->port]);
+}
+
+/**
+ * @brief apply changed configuration to an opened serial port, pending 
+ *        output is finished and unread input is dropped
+ * @param handle: serial handle
+ */
+void serial_reconfig(serial *handle)
+{
+    assert_param(handle != NULL);
+    USART_Group group = xUsart[handle->port];
+    
+    /* wait last byte out */
+    while(!USART_IsFlagOn(group, USART_FLAG_TC));
+    USART_Enable(group, FALSE);
+    USART_Setup(group, &handle->config);
+    xQueueReset(xRxedChars[handle->port]);
+    USART_Enable(group, TRUE);
+}
+
+/**
+ * @brief get receive error statistics
+ * @param handle: serial handle
+ * @param errors: error statistics output
+ */
+void serial_get_errors(serial *handle, serial_errors *errors)
+{
+    assert_param(handle != NULL);
+    assert_param(errors != NULL);
+    portENTER_CRITICAL();
+    *errors = xErrors[handle->port];
+    portEXIT_CRITICAL();
+}
+
+/**
+ * @brief clear receive error statistics
+ * @param handle: serial handle
+ */
+void serial_clear_errors(serial *handle)
+{
+    assert_param(handle != NULL);
+    portENTER_CRITICAL();
+    xErrors[handle->port].overrun = 0;
+    xErrors[handle->port].frame = 0;
+    xErrors[handle->port].noise = 0;
+    xErrors[handle->port].dropped = 0;
+    portEXIT_CRITICAL();
+}
+
+/**
+ * @brief drop unread input
+ * @param handle: serial handle
+ */
+void serial_flush(serial *handle)
+{
+    assert_param(handle != NULL);
+    xQueueReset(xRxedChars[handle->port]);
+}
+
 /**
  * @brief set serial port parity
  * @param handle: serial handle
@@ -227,6 +323,7 @@ void serial_set_bufferlength(serial *handle, UBaseType_t rxLen,
                             UBaseType_t txLen)
 {
     assert_param(handle != NULL);
+    assert_param(rxLen <= SERIAL_MAX_RX_LEN);
     serial *pserial = (serial *)handle;
     pserial->rxBufLen = rxLen;
 }
@@ -241,7 +338,10 @@ bool serial_getchar(serial *handle, char *data,
     assert_param(handle != NULL);
     serial *pserial = (serial *)handle;
     if(xQueueReceive(xRxedChars[pserial->port], data, xBlockTime))
+    {
+        capture_write(pserial->port, CAPTURE_RX, data, 1);
 		return TRUE;
+    }
 	else
 		return FALSE;
 }
@@ -282,24 +382,38 @@ bool serial_putchar(serial *handle, char data,
 void serial_putstring(serial *handle, const char *string,
                       uint32_t length)
 {
+    assert_param(handle != NULL);
+    capture_write(handle->port, CAPTURE_TX, string, length);
     const char *pNext = string;
     while(length--)
         serial_putchar(handle, *pNext++, SERIAL_NO_BLOCK);
 }
 
 /**
- * @brief usart interrupt handler
+ * @brief usart receive interrupt process
+ * @param group - usart group
+ * @param port - serial port
  */
-void USART1_IRQHandler(void)
+static __INLINE void serial_isr(USART_Group group, Port port)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
     portCHAR cChar;
+    uint16_t status = USART_GetStatus(group);
 	
-    /* The interrupt was caused by the RX not empty. */
-	if(USART_IsFlagOn(USART1, USART_FLAG_RXNE))
+    /* The interrupt was caused by the RX not empty or overrun. */
+	if(status & (USART_FLAG_RXNE | USART_FLAG_ORE))
 	{
-		cChar = USART_ReadData(USART1);
-		xQueueSendFromISR(xRxedChars[0], &cChar, &xHigherPriorityTaskWoken);
+        /* reading data register after status clears error flags */
+		cChar = USART_ReadData(group);
+        if(status & USART_FLAG_ORE)
+            xErrors[port].overrun ++;
+        if(status & USART_FLAG_NE)
+            xErrors[port].noise ++;
+        if(status & USART_FLAG_FE)
+            xErrors[port].frame ++;
+        else if(pdPASS != xQueueSendFromISR(xRxedChars[port], &cChar, 
+                                            &xHigherPriorityTaskWoken))
+            xErrors[port].dropped ++;
 	}	
 	
     /* check if there is any higher priority task need to wakeup */
@@ -309,20 +423,17 @@ void USART1_IRQHandler(void)
 /**
  * @brief usart interrupt handler
  */
-void USART2_IRQHandler(void)
+void USART1_IRQHandler(void)
 {
-    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-    portCHAR cChar;
+    serial_isr(USART1, COM1);
+}
 
-    /* The interrupt was caused by the RX not empty. */
-	if(USART_IsFlagOn(USART2, USART_FLAG_RXNE))
-	{
-		cChar = USART_ReadData(USART2);
-		xQueueSendFromISR(xRxedChars[1], &cChar, &xHigherPriorityTaskWoken);
-	}	
-	
-    /* check if there is any higher priority task need to wakeup */
-	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+/**
+ * @brief usart interrupt handler
+ */
+void USART2_IRQHandler(void)
+{
+    serial_isr(USART2, COM2);
 }
 
 /**
@@ -330,23 +441,5 @@ void USART2_IRQHandler(void)
  */
 void USART3_IRQHandler(void)
 {
-    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-    portCHAR cChar;
-	
-    /* The interrupt was caused by the RX not empty. */
-	if(USART_IsFlagOn(USART3, USART_FLAG_RXNE))
-	{
-		cChar = USART_ReadData(USART3);
-		xQueueSendFromISR(xRxedChars[2], &cChar, &xHigherPriorityTaskWoken);
-	}	
-	
-    /* check if there is any higher priority task need to wakeup */
-	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+    serial_isr(USART3, COM3);
 }
-
-
-
-
-
-
-	
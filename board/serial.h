@@ -59,17 +59,35 @@ typedef enum
 	Baudrate_19200 = 19200,	
 	Baudrate_38400 = 38400,	
 	Baudrate_57600 = 57600,	
-	Baudrate_115200 = 115200
+	Baudrate_115200 = 115200,
+	Baudrate_230400 = 230400,
+	Baudrate_460800 = 460800,
+	Baudrate_921600 = 921600,
 }Baudrate;
 
+/* receive error statistics */
+typedef struct
+{
+    uint32_t overrun;
+    uint32_t frame;
+    uint32_t noise;
+    uint32_t dropped;
+}serial_errors;
+
 typedef struct _serial_t serial;
 
 /* interface */
+void serial_init(void);
 serial *serial_request(Port port);
 void serial_release(serial *pserial);
 bool serial_open(serial *handle);
 void serial_close(serial *handle);
-void serial_set_baudrate(serial *handle, Baudrate baudrate);
+void serial_set_baudrate(serial *handle, uint32_t baudrate);
+uint32_t serial_get_baudrate(serial *handle);
+void serial_reconfig(serial *handle);
+void serial_get_errors(serial *handle, serial_errors *errors);
+void serial_clear_errors(serial *handle);
+void serial_flush(serial *handle);
 void serial_set_parity(serial *handle, Parity parity);
 void serial_set_stopbits(serial *handle, StopBits stopBits);
 void serial_set_databits(serial *handle, DataBits dataBits);
@@ -5,11 +5,16 @@
 *
 * See the COPYING file for the terms of usage and distribution.
 */
+#include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include "FreeRTOS.h"
 #include "task.h"
+#include "queue.h"
 #include "simple_http.h"
+#include "http_assets.h"
 #include "esp8266.h"
+#include "netif.h"
 #include "trace.h"
 #include "global.h"
 #include "dbgserial.h"
@@ -19,9 +24,6 @@
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[http]"
 
-/* default timeout time */
-#define DEFAULT_TIMEOUT      (3000 / portTICK_PERIOD_MS)
-
 /* ap configueation */
 #define AP_NAME              "vendor"
 #define AP_PWD               "12345678"
@@ -34,57 +36,540 @@
 #define AP_NETMASK      "255.255.255.0"
 
 TaskHandle_t xHttpHandle = NULL;
+static StackType_t xHttpStack[HTTP_STACK_SIZE];
+static StaticTask_t xHttpTaskBuffer;
+
+/* request limits */
+#define HTTP_METHOD_SIZE     (8)
+#define HTTP_PATH_SIZE       (16)
+#define HTTP_KEY_SIZE        (8)
+#define HTTP_FIELD_SIZE      (32)
+#define HTTP_LINE_MAX        (255)
+#define HTTP_ETAG_SIZE       (12)
+
+/* body is sent in pieces of one tcp segment */
+#define HTTP_SEND_SIZE       (1460)
+
+/* only request header used, matched in lower case */
+#define HEADER_IF_NONE_MATCH "if-none-match:"
+
+/* idle link is closed after this time */
+#define HTTP_IDLE_TIMEOUT    (10000 / portTICK_PERIOD_MS)
+#define HTTP_POLL_TIME       (1000 / portTICK_PERIOD_MS)
+
+/* socket event */
+typedef struct
+{
+    uint8_t id;
+    uint8_t event;
+}http_event;
 
-/* set page */
-const char set_page[] = "\
+static xQueueHandle xEventQueue = NULL;
+static uint8_t ucEventStorage[NETIF_MAX_SOCKET_NUM * 4 * sizeof(http_event)];
+static StaticQueue_t xEventQueueBuffer;
+
+/* request parse state */
+typedef enum
+{
+    REQ_IDLE,
+    REQ_METHOD,
+    REQ_PATH,
+    REQ_KEY,
+    REQ_VALUE,
+    REQ_VERSION,
+    REQ_HEADER,
+    REQ_DONE,
+}req_state;
+
+/* request is parsed as it arrives, chunks of one link may be split 
+ * anywhere, query values are url decoded into bounded fields */
+typedef struct
+{
+    req_state state;
+    bool bad;
+    uint8_t len;
+    uint8_t line;
+    uint8_t pct;
+    uint8_t hex;
+    /* If-None-Match value, empty if not sent */
+    bool etag_value;
+    char etag[HTTP_ETAG_SIZE];
+    char method[HTTP_METHOD_SIZE];
+    char path[HTTP_PATH_SIZE];
+    char key[HTTP_KEY_SIZE];
+    /* decoded value target, NULL drops unknown keys */
+    char *value;
+    char ssid[HTTP_FIELD_SIZE];
+    char pwd[HTTP_FIELD_SIZE];
+    TickType_t time;
+}http_request;
+
+static http_request g_requests[NETIF_MAX_SOCKET_NUM];
+static uint8_t g_chunk[65];
+static bool g_setting = FALSE;
+static char g_ssid[HTTP_FIELD_SIZE];
+static char g_pwd[HTTP_FIELD_SIZE];
+
+/* setting saved page */
+const char done_page[] = "\
 <!DOCTYPE html><html>\r\n \
 <body>\r\n \
-<p>set AP name and password</p>\r\n \
-<form action=\"/setting\" method=\"get\" target=\"_self\">\r\n \
-  AP Name:<br>\r\n \
-  <input type=\"text\" name=\"apname\">\r\n \
-  <br>\r\n \
-  AP Password:<br>\r\n \
-  <input type=\"text\" name=\"appwd\">\r\n \
-  <br><br>\r\n \
-  <input type=\"submit\" value=\"set\">\r\n \
-</form>\r\n \
+<p>AP saved, machine restarts</p>\r\n \
 </body>\r\n \
 </html>";
 
+static char g_header[192];
+
+/**
+ * @brief get value of hex digit
+ * @param c - hex digit
+ * @return digit value, -1 if not hex digit
+ */
+static int hex_value(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    else if ((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+    else if ((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief append character to bounded string
+ * @param buf - string buffer
+ * @param size - buffer size
+ * @param len - string length
+ * @param c - character
+ * @return FALSE if buffer is full
+ */
+static bool put_char(char *buf, uint8_t size, uint8_t *len, char c)
+{
+    if (*len + 1 >= size)
+    {
+        return FALSE;
+    }
+
+    buf[(*len)++] = c;
+    buf[*len] = '\0';
+    return TRUE;
+}
+
+/**
+ * @brief start new request on link
+ * @param req - request
+ */
+static void request_reset(http_request *req)
+{
+    memset(req, 0, sizeof(http_request));
+    req->state = REQ_METHOD;
+    req->time = xTaskGetTickCount();
+}
+
+/**
+ * @brief select field of query key
+ * @param req - request
+ */
+static void begin_value(http_request *req)
+{
+    req->len = 0;
+    req->pct = 0;
+    if (0 == strcmp(req->key, "apname"))
+    {
+        req->value = req->ssid;
+    }
+    else if (0 == strcmp(req->key, "appwd"))
+    {
+        req->value = req->pwd;
+    }
+    else
+    {
+        req->value = NULL;
+    }
+}
+
+/**
+ * @brief decode query value character
+ * @param req - request
+ * @param c - character
+ */
+static void put_value(http_request *req, char c)
+{
+    if (0 != req->pct)
+    {
+        int val = hex_value(c);
+        if (val < 0)
+        {
+            req->bad = TRUE;
+            req->pct = 0;
+            return ;
+        }
+        req->hex = (req->hex << 4) | val;
+        if (0 != --req->pct)
+        {
+            return ;
+        }
+        c = req->hex;
+    }
+    else if ('%' == c)
+    {
+        req->pct = 2;
+        req->hex = 0;
+        return ;
+    }
+    else if ('+' == c)
+    {
+        c = ' ';
+    }
+
+    if ((NULL != req->value) &&
+        !put_char(req->value, HTTP_FIELD_SIZE, &req->len, c))
+    {
+        req->bad = TRUE;
+    }
+}
+
+/**
+ * @brief parse header character, only If-None-Match is kept
+ * @param req - request
+ * @param c - character, line holds its position
+ */
+static void parse_header(http_request *req, char c)
+{
+    const uint8_t name_len = sizeof(HEADER_IF_NONE_MATCH) - 1;
+    if (req->etag_value)
+    {
+        if ((' ' != c) && !put_char(req->etag, HTTP_ETAG_SIZE, &req->len, c))
+        {
+            /* not one of our tags */
+            req->etag[0] = '\0';
+            req->etag_value = FALSE;
+        }
+    }
+    else if ((req->line < name_len) &&
+             (HEADER_IF_NONE_MATCH[req->line] == tolower(c)))
+    {
+        if (name_len - 1 == req->line)
+        {
+            req->etag_value = TRUE;
+            req->len = 0;
+            req->etag[0] = '\0';
+        }
+    }
+    else if (req->line < name_len)
+    {
+        /* other header, skip rest of line */
+        req->line = HTTP_LINE_MAX;
+    }
+}
+
+/**
+ * @brief parse one request character
+ * @param req - request
+ * @param c - character
+ */
+static void parse_char(http_request *req, char c)
+{
+    if ('\r' == c)
+    {
+        return ;
+    }
+
+    if (('\n' == c) && (req->state < REQ_VERSION))
+    {
+        /* request line without version */
+        req->bad = TRUE;
+        req->state = REQ_VERSION;
+    }
+
+    switch (req->state)
+    {
+    case REQ_METHOD:
+        if (' ' == c)
+        {
+            req->state = REQ_PATH;
+            req->len = 0;
+        }
+        else if (!put_char(req->method, HTTP_METHOD_SIZE, &req->len, c))
+        {
+            req->bad = TRUE;
+        }
+        break;
+    case REQ_PATH:
+        if ('?' == c)
+        {
+            req->state = REQ_KEY;
+            req->len = 0;
+        }
+        else if (' ' == c)
+        {
+            req->state = REQ_VERSION;
+        }
+        else if (!put_char(req->path, HTTP_PATH_SIZE, &req->len, c))
+        {
+            /* unknown path */
+            req->path[0] = '\0';
+        }
+        break;
+    case REQ_KEY:
+        if ('=' == c)
+        {
+            begin_value(req);
+            req->state = REQ_VALUE;
+        }
+        else if (' ' == c)
+        {
+            req->state = REQ_VERSION;
+        }
+        else if ('&' == c)
+        {
+            req->len = 0;
+            req->key[0] = '\0';
+        }
+        else if (!put_char(req->key, HTTP_KEY_SIZE, &req->len, c))
+        {
+            /* unknown key */
+            req->key[0] = '\0';
+        }
+        break;
+    case REQ_VALUE:
+        if ('&' == c)
+        {
+            req->state = REQ_KEY;
+            req->len = 0;
+            req->key[0] = '\0';
+        }
+        else if (' ' == c)
+        {
+            req->state = REQ_VERSION;
+        }
+        else
+        {
+            put_value(req, c);
+        }
+        break;
+    case REQ_VERSION:
+        if ('\n' == c)
+        {
+            req->state = REQ_HEADER;
+            req->line = 0;
+        }
+        break;
+    case REQ_HEADER:
+        /* empty line ends request */
+        if ('\n' == c)
+        {
+            if (0 == req->line)
+            {
+                req->state = REQ_DONE;
+            }
+            req->line = 0;
+            req->etag_value = FALSE;
+        }
+        else
+        {
+            parse_header(req, c);
+            if (req->line < HTTP_LINE_MAX)
+            {
+                req->line ++;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief send response body in module sized pieces
+ * @param id - link id
+ * @param data - body data
+ * @param len - body length
+ * @return 0 means success, otherwise error code
+ */
+static int send_body(uint8_t id, const uint8_t *data, uint32_t len)
+{
+    int ret = NETIF_ERR_OK;
+    while ((len > 0) && (NETIF_ERR_OK == ret))
+    {
+        uint16_t size = (len > HTTP_SEND_SIZE) ? HTTP_SEND_SIZE : len;
+        ret = netif_send(id, data, size);
+        data += size;
+        len -= size;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief send response and close link
+ * @param id - link id
+ * @param status - status line
+ * @param body - response body
+ */
+static void respond(uint8_t id, const char *status, const char *body)
+{
+    uint16_t len = strlen(body);
+    uint16_t head = sprintf(g_header, "HTTP/1.1 %s\r\n"
+                            "Content-Type: text/html\r\n"
+                            "Content-Length: %d\r\n"
+                            "Connection: close\r\n\r\n", status, len);
+    if (NETIF_ERR_OK == netif_send(id, (const uint8_t *)g_header, head))
+    {
+        send_body(id, (const uint8_t *)body, len);
+    }
+    netif_close(id);
+}
+
+/**
+ * @brief send embedded page and close link, page cached by client is 
+ *        answered without body
+ * @param id - link id
+ * @param req - request
+ * @param asset - embedded page
+ */
+static void respond_asset(uint8_t id, const http_request *req, 
+                          const http_asset *asset)
+{
+    uint16_t head = 0;
+    bool cached = (0 == strcmp(req->etag, asset->etag));
+    if (cached)
+    {
+        head = sprintf(g_header, "HTTP/1.1 304 Not Modified\r\n"
+                       "ETag: %s\r\n"
+                       "Connection: close\r\n\r\n", asset->etag);
+    }
+    else
+    {
+        head = sprintf(g_header, "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: %s\r\n"
+                       "Content-Encoding: gzip\r\n"
+                       "Content-Length: %d\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "ETag: %s\r\n"
+                       "Connection: close\r\n\r\n", 
+                       asset->type, asset->len, asset->etag);
+    }
+
+    if ((NETIF_ERR_OK == netif_send(id, (const uint8_t *)g_header, head)) &&
+        !cached)
+    {
+        send_body(id, asset->data, asset->len);
+    }
+    netif_close(id);
+}
+
 /**
- * @brief parse ap name and password from data
- * @param data - data to parse
- * @param name - ap name
- * @param pwd - ap password
+ * @brief find embedded page
+ * @param url - page url
+ * @return embedded page, NULL if not found
  */
-static void parse_name_and_pwd(const char *data, char *name, char *pwd)
+static const http_asset *find_asset(const char *url)
 {
-    const char *pdata = data;
-    uint8_t spec = 0;
-    while('=' != *pdata++);
-    while('&' != *pdata)
+    for (const http_asset *asset = http_assets; NULL != asset->url; ++asset)
     {
-        *name++ = *pdata++;
+        if (0 == strcmp(url, asset->url))
+        {
+            return asset;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief process complete request
+ * @param id - link id
+ * @param req - request
+ */
+static void process_request(uint8_t id, http_request *req)
+{
+    TRACE("%d: %s %s\r\n", id, req->method, req->path);
+    if (req->bad)
+    {
+        respond(id, "400 Bad Request", "");
     }
-    *name = '\0';
-    while('=' != *pdata++);
-    while(' ' != *pdata)
+    else if (0 != strcmp(req->method, "GET"))
     {
-        if ('%' == *pdata)
+        respond(id, "405 Method Not Allowed", "");
+    }
+    else if (0 == strcmp(req->path, "/setting"))
+    {
+        if ('\0' == req->ssid[0])
+        {
+            respond(id, "400 Bad Request", "");
+        }
+        else
         {
-            pdata++;
-            spec = *pdata - '0';
-            spec <<= 4;
-            pdata++;
-            spec += (*pdata - '0');
-            pdata ++;
-            *pwd++ = spec;
-            continue;
+            TRACE("get setting:%s(%s)\r\n", req->ssid, req->pwd);
+            strcpy(g_ssid, req->ssid);
+            strcpy(g_pwd, req->pwd);
+            g_setting = TRUE;
+            respond(id, "200 OK", done_page);
         }
-        *pwd++ = *pdata++;
     }
-    *pwd = '\0';
+    else if (NULL != find_asset(req->path))
+    {
+        respond_asset(id, req, find_asset(req->path));
+    }
+    else
+    {
+        respond(id, "404 Not Found", "");
+    }
+    req->state = REQ_IDLE;
+}
+
+/**
+ * @brief parse received data of link
+ * @param id - link id
+ */
+static void process_link(uint8_t id)
+{
+    http_request *req = &g_requests[id];
+    uint16_t len = 0;
+    int ret = NETIF_ERR_OK;
+    while ((REQ_IDLE != req->state) &&
+           (NETIF_ERR_OK == (ret = netif_recv(id, g_chunk, &len, 0))))
+    {
+        req->time = xTaskGetTickCount();
+        for (uint16_t i = 0; i < len; ++i)
+        {
+            parse_char(req, g_chunk[i]);
+            if (REQ_DONE == req->state)
+            {
+                /* body is not used */
+                process_request(id, req);
+                break;
+            }
+        }
+    }
+
+    if (-NETIF_ERR_LOST == ret)
+    {
+        /* part of request is gone, it cannot be parsed any more */
+        TRACE("%d: request data lost\r\n", id);
+        netif_close(id);
+        req->state = REQ_IDLE;
+    }
+}
+
+/**
+ * @brief http socket event process function
+ * @param id - socket id
+ * @param event - socket event
+ */
+static void http_socket_event(uint8_t id, netif_event event)
+{
+    http_event evt = {id, event};
+    xQueueSend(xEventQueue, &evt, 0);
 }
 
 /**
@@ -92,51 +577,54 @@ static void parse_name_and_pwd(const char *data, char *name, char *pwd)
  */
 static void vHttpd(void *pvParameters)
 {
-    const TickType_t xDelay = 300 / portTICK_PERIOD_MS;
-    uint8_t data[65];
-    uint16_t len;
-    char ssid[32];
-    char pwd[32];
-    uint8_t id = 0;
-    for (;;)
+    http_event evt;
+    while (!g_setting)
     {
-        if (ESP_ERR_OK == esp8266_recv(&id, data, &len, portMAX_DELAY))
+        if (xQueueReceive(xEventQueue, &evt, HTTP_POLL_TIME))
         {
-            if (0 == strncmp((const char *)data, "GET /setting?", 13))
+            switch (evt.event)
             {
-                parse_name_and_pwd((const char *)data, ssid, pwd);
-                while (ESP_ERR_OK == esp8266_recv(&id, data, &len, xDelay));
-                TRACE("get setting:%s(%s)\r\n", ssid, pwd);
-                esp8266_disconnect_server(id);
-                esp8266_close(80);
+            case NETIF_CONNECTED:
+                request_reset(&g_requests[evt.id]);
+                break;
+            case NETIF_RECEIVED:
+                process_link(evt.id);
+                break;
+            case NETIF_DISCONNECTED:
+                g_requests[evt.id].state = REQ_IDLE;
+                break;
+            default:
                 break;
             }
-            else if (0 == strncmp((const char *)data, "GET /", 5))
+        }
+
+        /* pick up data of dropped events and close idle links */
+        for (uint8_t id = 0; id < NETIF_MAX_SOCKET_NUM; ++id)
+        {
+            if (REQ_IDLE == g_requests[id].state)
             {
-                while (ESP_ERR_OK == esp8266_recv(&id, data, &len, xDelay));
-                if (ESP_ERR_OK == esp8266_prepare_send(id, strlen(set_page)))
-                {
-                    esp8266_write(set_page, strlen(set_page));
-                    esp8266_disconnect_server(id);
-                }
+                continue;
             }
-            else
+
+            process_link(id);
+            if ((REQ_IDLE != g_requests[id].state) &&
+                (xTaskGetTickCount() - g_requests[id].time > 
+                 HTTP_IDLE_TIMEOUT))
             {
-                while (ESP_ERR_OK == esp8266_recv(&id, data, &len, xDelay));
+                TRACE("%d: request timeout\r\n", id);
+                netif_close(id);
+                g_requests[id].state = REQ_IDLE;
             }
         }
-        
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
-    
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-    flash_set_ssid_pwd(ssid, pwd);
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+
+    esp8266_close(80);
+    flash_set_ssid_pwd(g_ssid, g_pwd);
     SCB_SystemReset();
-    
+
     vTaskDelete(NULL);
 }
- 
+
 /**
  * @brief pms5003 data process task
  * @param serial handle
@@ -163,14 +651,23 @@ bool http_init(void)
         return FALSE;
     }
     
+    xEventQueue = xQueueCreateStatic(NETIF_MAX_SOCKET_NUM * 4, 
+                                     sizeof(http_event), ucEventStorage, 
+                                     &xEventQueueBuffer);
+    for (uint8_t i = 0; i < NETIF_MAX_SOCKET_NUM; ++i)
+    {
+        netif_listen(i, http_socket_event);
+    }
+    
     err = esp8266_listen(80);
     if (ESP_ERR_OK != err)
     {
         return FALSE;
     }
     
-    xTaskCreate(vHttpd, "httpd", HTTP_STACK_SIZE, NULL, 
-                       HTTP_PRIORITY, &xHttpHandle);
+    xHttpHandle = xTaskCreateStatic(vHttpd, "httpd", HTTP_STACK_SIZE, NULL, 
+                                    HTTP_PRIORITY, xHttpStack, 
+                                    &xHttpTaskBuffer);
     if (NULL == xHttpHandle)
     {
         return FALSE;
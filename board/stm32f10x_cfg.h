@@ -15,6 +15,7 @@
 * library module inclue configure
 ***********************************************************/
 /*********************************************************/
+#define _MODULE_CRC
 #define _MODULE_RCC
 #define _MODULE_FLASH
 #define _MODULE_GPIO
@@ -27,6 +28,7 @@
 #define _MODULE_I2C
 #define _MODULE_EXTI
 #define _MODULE_SIG
+#define _MODULE_TIM
 
 /**********************************************************/
 #ifdef _MODULE_CRC
@@ -81,6 +83,10 @@
   #include "stm32f10x_sig.h"
 #endif
 
+#ifdef _MODULE_TIM
+  #include "stm32f10x_tim.h"
+#endif
+
 
 #endif /* _STM32F10x_CFG_H_ */
 
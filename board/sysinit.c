@@ -0,0 +1,170 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+#include "sysinit.h"
+#include "global.h"
+#include "trace.h"
+#include "assert.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[init]"
+
+/* init task and one worker take ready steps from table, so a step that
+ * blocks on module response does not hold back independent steps */
+static const init_step *g_steps = NULL;
+static uint8_t g_count = 0;
+static uint16_t g_all = 0;
+static uint16_t g_taken = 0;
+static uint16_t g_failed = 0;
+
+static EventGroupHandle_t xInitEvents = NULL;
+static StaticEventGroup_t xInitEventsBuffer;
+
+static StackType_t xWorkerStack[INIT_WORKER_STACK_SIZE];
+static StaticTask_t xWorkerTaskBuffer;
+
+static const char * const phase_names[BOOT_PHASE_NUM] =
+{
+    "init", "link", "online"
+};
+static uint32_t g_phase_time[BOOT_PHASE_NUM];
+
+/**
+ * @brief take next step whose dependencies are done
+ * @param done - done steps
+ * @return step index, -1 if no step is ready
+ */
+static int take_step(uint16_t done)
+{
+    int step = -1;
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < g_count; ++i)
+    {
+        if ((0 == (g_taken & SYSINIT_STEP(i))) &&
+            (g_steps[i].depends == (g_steps[i].depends & done)))
+        {
+            g_taken |= SYSINIT_STEP(i);
+            step = i;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return step;
+}
+
+/**
+ * @brief run ready steps until all steps are done
+ */
+static void run_steps(void)
+{
+    for (;;)
+    {
+        uint16_t done = xEventGroupGetBits(xInitEvents) & g_all;
+        if (g_all == done)
+        {
+            break;
+        }
+
+        int step = take_step(done);
+        if (step < 0)
+        {
+            /* wait for any running step */
+            xEventGroupWaitBits(xInitEvents, g_all & ~done, pdFALSE, pdFALSE,
+                                portMAX_DELAY);
+            continue;
+        }
+
+        TickType_t start = xTaskGetTickCount();
+        bool ok = g_steps[step].init();
+        TRACE("%s %s in %dms\r\n", g_steps[step].name, ok ? "done" : "failed",
+              (xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+        if (!ok)
+        {
+            taskENTER_CRITICAL();
+            g_failed |= SYSINIT_STEP(step);
+            taskEXIT_CRITICAL();
+        }
+        xEventGroupSetBits(xInitEvents, SYSINIT_STEP(step));
+    }
+}
+
+/**
+ * @brief init worker task
+ * @param pvParameters - task parameter
+ */
+static void vInitWorker(void *pvParameters)
+{
+    run_steps();
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief run init steps in dependency order, independent steps run
+ *        concurrently, returns when all steps are done
+ * @param steps - init steps, dependencies refer to table index
+ * @param count - step count
+ * @return TRUE if all steps succeeded
+ */
+bool sysinit_run(const init_step *steps, uint8_t count)
+{
+    assert_param(NULL != steps);
+    assert_param(count <= SYSINIT_MAX_STEPS);
+    g_steps = steps;
+    g_count = count;
+    g_all = (1 << count) - 1;
+    xInitEvents = xEventGroupCreateStatic(&xInitEventsBuffer);
+    xTaskCreateStatic(vInitWorker, "InitWorker", INIT_WORKER_STACK_SIZE,
+                      NULL, INIT_SYSTEM_PRIORITY, xWorkerStack,
+                      &xWorkerTaskBuffer);
+    run_steps();
+    sysinit_mark(BOOT_INIT);
+
+    return (0 == g_failed);
+}
+
+/**
+ * @brief check step result
+ * @param step - step index
+ * @return TRUE if step is done and succeeded
+ */
+bool sysinit_ok(uint8_t step)
+{
+    return (0 != (xEventGroupGetBits(xInitEvents) & SYSINIT_STEP(step))) &&
+           (0 == (g_failed & SYSINIT_STEP(step)));
+}
+
+/**
+ * @brief record first time boot milestone is reached
+ * @param phase - boot milestone
+ */
+void sysinit_mark(boot_phase phase)
+{
+    assert_param(phase < BOOT_PHASE_NUM);
+    if (0 != g_phase_time[phase])
+    {
+        return ;
+    }
+
+    /* scheduler starts right after reset */
+    g_phase_time[phase] = xTaskGetTickCount() * portTICK_PERIOD_MS + 1;
+    TRACE("boot %s at %dms\r\n", phase_names[phase], g_phase_time[phase]);
+}
+
+/**
+ * @brief get time of boot milestone
+ * @param phase - boot milestone
+ * @return time since power on(ms), 0 if not reached
+ */
+uint32_t sysinit_phase_time(boot_phase phase)
+{
+    assert_param(phase < BOOT_PHASE_NUM);
+    return g_phase_time[phase];
+}
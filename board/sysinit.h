@@ -0,0 +1,44 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _SYSINIT_H_
+  #define _SYSINIT_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/* max init steps, one event bit each */
+#define SYSINIT_MAX_STEPS      (16)
+#define SYSINIT_STEP(step)     (1 << (step))
+
+/* init step, runs as soon as all steps in depends are done, failed step
+ * counts as done, dependents check it with sysinit_ok */
+typedef struct
+{
+    const char *name;
+    bool (*init)(void);
+    uint16_t depends;
+}init_step;
+
+/* boot milestones, time since power on is recorded once */
+typedef enum
+{
+    BOOT_INIT,          /* all init steps done */
+    BOOT_LINK,          /* first network link up */
+    BOOT_ONLINE,        /* first mqtt connack */
+    BOOT_PHASE_NUM,
+}boot_phase;
+
+bool sysinit_run(const init_step *steps, uint8_t count);
+bool sysinit_ok(uint8_t step);
+void sysinit_mark(boot_phase phase);
+uint32_t sysinit_phase_time(boot_phase phase);
+
+END_DECLS
+
+#endif /* _SYSINIT_H_ */
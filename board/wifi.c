@@ -7,9 +7,11 @@
 */
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
+#include "timers.h"
 #include "wifi.h"
 #include "esp8266.h"
 #include "m26.h"
@@ -19,99 +21,231 @@
 #include "stm32f10x_cfg.h"
 #include "motorctl.h"
 #include "led_net.h"
-#include "mode.h"
 #include "flash.h"
+#include "netif.h"
+#include "connmgr.h"
+#include "backoff.h"
+#include "crc32.h"
+#include "ota.h"
+#include "sysinit.h"
+#include "config.h"
+#include "ir.h"
+#include "capture.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[wifi]"
 
 #define DEFAULT_TIMEOUT      (3000 / portTICK_PERIOD_MS)
+#define CONNECT_POLL         (1000 / portTICK_PERIOD_MS)
+/* keepalive check period when nothing is due */
+#define KEEPALIVE_POLL       (5000 / portTICK_PERIOD_MS)
+/* broker is dead if pingresp misses this deadline */
+#define PINGRESP_TIMEOUT     (10000 / portTICK_PERIOD_MS)
+/* keepalive negotiated in connect(s), doubled on quiet link */
+#define KEEPALIVE_MIN        (30)
+#define KEEPALIVE_DEFAULT    (60)
+#define KEEPALIVE_MAX        (240)
+/* pings in a row without other traffic before longer keepalive */
+#define KEEPALIVE_QUIET      (5)
+#define MOTOR_STATE_PERIOD   (1800000 / portTICK_PERIOD_MS)
+#define AP_TIMEOUT           (20000 / portTICK_PERIOD_MS)
+/* join with cached bssid, falls back to full join when it fails */
+#define AP_FAST_TIMEOUT      (8000 / portTICK_PERIOD_MS)
+/* socket connect and connack timeout */
+#define BROKER_TIMEOUT       (10000 / portTICK_PERIOD_MS)
+
+/* retry delays, doubled each failure with jitter */
+#define AP_BACKOFF_BASE      (5000 / portTICK_PERIOD_MS)
+#define AP_BACKOFF_MAX       (300000 / portTICK_PERIOD_MS)
+#define BROKER_BACKOFF_BASE  (3000 / portTICK_PERIOD_MS)
+#define BROKER_BACKOFF_MAX   (600000 / portTICK_PERIOD_MS)
 
 static char g_ssid[32];
 static char g_pwd[32];
 
-/* mqtt topic */
-#define TOPIC_REGISTER    "register"
+static uint8_t g_id[CONFIG_ID_LEN + 1];
+
+/* machine topic buffers from topic table, prefix is set at compile time 
+ * and id is appended once */
+#define TOPIC_BUFFER(name, prefix) \
+    static char topic_##name[CONFIG_TOPIC_LEN(prefix) + 1] = prefix "/";
+CONFIG_TOPICS(TOPIC_BUFFER)
+
+#define TOPIC_ENTRY(name, prefix) {topic_##name, sizeof(prefix)},
+static const struct
+{
+    char *buf;
+    uint8_t offset;
+}topics[] = 
+{
+    CONFIG_TOPICS(TOPIC_ENTRY)
+};
 
-static uint8_t g_id[25];
-static char topic_control[36];
-static char topic_state[31];
+/* ota chunk is requested again when it does not arrive in time */
+#define OTA_TIMEOUT          (5000 / portTICK_PERIOD_MS)
+static TickType_t g_ota_time = 0;
+static volatile bool g_ota_reboot = FALSE;
 
 /* mqtt information */
 #define MQTT_ID        2
-#define MQTT_ADDRESS   "39.105.72.237"
-#define MQTT_PORT      1883
 
-/* mqtt status */
-uint8_t mqtt_status = 0x00;
+/* broker connection state */
+typedef enum
+{
+    CONN_LINK,          /* wait active link up */
+    CONN_SOCKET,        /* connect socket when backoff is due */
+    CONN_WAIT_SOCKET,   /* wait socket connected */
+    CONN_SESSION,       /* socket connected, send mqtt connect */
+    CONN_WAIT_ACK,      /* wait connack */
+    CONN_ONLINE,
+}conn_state;
 
-bool ap_connected = FALSE;
+static volatile conn_state g_state = CONN_LINK;
+static TickType_t g_state_time = 0;
+
+static bool ap_connected = FALSE;
 
 static uint16_t g_motor_num = 0;
+/* rejected vend command */
+#define MOTOR_NUM_INVALID   (0xffff)
+#define MOTOR_NUM_DIGITS    (3)
 
 #define LED_AP            (1)
 #define LED_MQTT          (2)
 
-static TaskHandle_t xConnectMqttTask = NULL;
-static TaskHandle_t xHeartTask = NULL; 
-static TaskHandle_t xMotorStateTask = NULL; 
-static TaskHandle_t xConnectApTask = NULL; 
+static TaskHandle_t xConnectTask = NULL;
+static TimerHandle_t xHeartTimer = NULL; 
+static TimerHandle_t xMotorStateTimer = NULL; 
+static StackType_t xConnectStack[AP_STACK_SIZE];
+static StaticTask_t xConnectTaskBuffer;
+static StaticTimer_t xHeartTimerBuffer;
+static StaticTimer_t xMotorStateTimerBuffer;
+
+/* keepalive state */
+static uint16_t g_alive = KEEPALIVE_DEFAULT;
+static volatile bool g_ping_pending = FALSE;
+static TickType_t g_ping_time = 0;
+static uint32_t g_ping_packets = 0;
+static uint8_t g_quiet_pings = 0;
+/* request from keepalive to connect task */
+static volatile bool g_broker_dead = FALSE;
+static volatile bool g_renegotiate = FALSE;
+/* customer walked up, request from ir to connect task */
+static volatile bool g_presence = FALSE;
+
+static backoff g_ap_backoff;
+static backoff g_broker_backoff;
 
+/* last good ap, aps of ssid are scanned in background so roaming picks 
+ * the strongest one */
+#define SCAN_PERIOD        (600000 / portTICK_PERIOD_MS)
+#define SCAN_MAX           (4)
+/* roam when current ap is weak and another one is clearly stronger */
+#define ROAM_RSSI          (-75)
+#define ROAM_MARGIN        (10)
+static uint8_t g_bssid[6];
+static uint8_t g_channel = 0;
+static bool g_bssid_valid = FALSE;
+static bool g_ap_fast = TRUE;
+static bool g_scan_now = FALSE;
+static TickType_t g_scan_time = 0;
+static esp8266_ap g_scan[SCAN_MAX];
+
+/* credentials are restored after this many wrong password in a row */
 #define PWD_RESET_COUNT    10
-static uint8_t err_count = 0;
+static uint8_t g_auth_fail = 0;
+/* credentials restore requested by mode button */
+static volatile bool g_restore = FALSE;
+
+/* connection metrics */
+static conn_stats g_conn;
+static TickType_t g_lost_time = 0;
+static bool g_lost = FALSE;
 
 /**
- * @brief connedted default process function
+ * @brief change broker connection state
+ * @param state - new state
  */
-static void esp8266_ap_connect(void)
+static void set_state(conn_state state)
 {
-    err_count = 0;
+    if ((CONN_ONLINE == g_state) && (CONN_ONLINE != state))
+    {
+        /* reconnect time counts from here */
+        g_lost_time = xTaskGetTickCount();
+        g_lost = TRUE;
+        led_net_set_action("LED_MQTT", flash);
+    }
+    else if ((CONN_ONLINE != g_state) && (CONN_ONLINE == state))
+    {
+        g_ping_pending = FALSE;
+        g_broker_dead = FALSE;
+        g_renegotiate = FALSE;
+        g_quiet_pings = 0;
+        led_net_set_action("LED_MQTT", on);
+        backoff_reset(&g_broker_backoff);
+        if (g_lost)
+        {
+            uint32_t time = (xTaskGetTickCount() - g_lost_time) * 
+                            portTICK_PERIOD_MS;
+            g_lost = FALSE;
+            g_conn.reconnects ++;
+            g_conn.last_reconnect = time;
+            if (time > g_conn.max_reconnect)
+            {
+                g_conn.max_reconnect = time;
+            }
+            TRACE("reconnected in %dms\r\n", time);
+        }
+    }
     
-    led_net_set_action("LED_NET", on);
-    led_net_set_action("LED_MQTT", flash);
-    ap_connected = TRUE;
+    g_state = state;
+    g_state_time = xTaskGetTickCount();
 }
 
 /**
- * @brief connedted default process function
+ * @brief broker connect attempt failed, retry after backoff
+ * @param auth - TRUE: broker refused credentials
  */
-static void esp8266_ap_disconnect(void)
+static void broker_fail(bool auth)
 {
-    err_count ++;
-    if (err_count > PWD_RESET_COUNT)
+    if (auth)
     {
-        err_count = 0;
-        flash_restore();
+        g_conn.broker_auth_fail ++;
     }
-    
-    led_net_set_action("LED_NET", flash);
-    led_net_set_action("LED_MQTT", off);
-    ap_connected = FALSE;
+    else
+    {
+        g_conn.broker_transient ++;
+    }
+    TickType_t delay = backoff_fail(&g_broker_backoff);
+    TRACE("broker retry in %dms\r\n", delay * portTICK_PERIOD_MS);
     mqtt_notify_disconnect();
-    mqtt_status = 0x00;
+    set_state(connmgr_active_up() ? CONN_SOCKET : CONN_LINK);
 }
 
 /**
  * @brief connedted default process function
  */
-static void esp8266_server_connect(uint8_t id)
+static void esp8266_ap_connect(void)
 {
-    if (MQTT_ID == id)
-    {
-        mqtt_notify_connect(id);
-        mqtt_status = 0x01;
-    }
+    led_net_set_action("LED_NET", on);
+    ap_connected = TRUE;
+    connmgr_set_up(LINK_WIFI, TRUE);
 }
 
 /**
- * @brief connedted default process function
+ * @brief connedted default process function, ap loss is transient, 
+ *        credentials are kept
  */
-static void esp8266_server_disconnect(uint8_t id)
+static void esp8266_ap_disconnect(void)
 {
-    if (MQTT_ID == id)
+    led_net_set_action("LED_NET", flash);
+    ap_connected = FALSE;
+    g_conn.ap_transient ++;
+    connmgr_set_up(LINK_WIFI, FALSE);
+    if ((LINK_WIFI == connmgr_active()) && (CONN_LINK != g_state))
     {
         mqtt_notify_disconnect();
-        mqtt_status = 0x00;
+        set_state(CONN_LINK);
     }
 }
 
@@ -123,8 +257,6 @@ static void init_esp8266_driver(void)
     esp8266_driver driver;
     driver.ap_connect = esp8266_ap_connect;
     driver.ap_disconnect = esp8266_ap_disconnect;
-    driver.server_connect = esp8266_server_connect;
-    driver.server_disconnect = esp8266_server_disconnect;
     esp8266_attach(&driver);
 }
 
@@ -140,20 +272,30 @@ static void m26_net_register(uint8_t code)
  */
 static void m26_gprs_attach(uint8_t code)
 {
+    connmgr_set_up(LINK_GPRS, 
+                   (M26_REG_HOME == code) || (M26_REG_ROAMING == code));
 }
 
 /**
- * @brief m26 server connect process function
+ * @brief mqtt socket event process function
+ * @param id - socket id
+ * @param event - socket event
  */
-static void m26_server_connect(void)
-{
-}
-
-/**
- * @brief m26 server disconnect process function
- */
-static void m26_server_disconnect(void)
+static void mqtt_socket_event(uint8_t id, netif_event event)
 {
+    if (NETIF_CONNECTED == event)
+    {
+        mqtt_notify_connect(id);
+        set_state(CONN_SESSION);
+    }
+    else if ((NETIF_DISCONNECTED == event) && (CONN_SOCKET < g_state))
+    {
+        if (CONN_ONLINE == g_state)
+        {
+            connmgr_reconnected();
+        }
+        broker_fail(FALSE);
+    }
 }
 
 /**
@@ -164,114 +306,554 @@ static void init_m26_driver(void)
     m26_driver driver;
     driver.net_register = m26_net_register;
     driver.gprs_attach = m26_gprs_attach;
-    driver.server_connect = m26_server_connect;
-    driver.server_disconnect = m26_server_disconnect;
     m26_attach(&driver);
 }
 
 /**
- * @brief ap process task
+ * @brief connect ap when backoff is due, keep wifi up as backup link 
+ *        while gprs is active
  */
-static void vConnectAp(void *pvParameters)
+static void maintain_ap(void)
 {
-    led_net_set_action("LED_NET", flash);
-    for (;;)
+    if (!connmgr_has(LINK_WIFI) || ap_connected || 
+        !backoff_due(&g_ap_backoff))
     {
-        if (FALSE == ap_connected)
+        return;
+    }
+
+    bool fast = g_bssid_valid && g_ap_fast;
+    TRACE("connect ap:%s%s\r\n", g_ssid, fast ? " (cached)" : "");
+    int ret = esp8266_connect_ap(g_ssid, g_pwd, fast ? g_bssid : NULL, 
+                                 fast ? AP_FAST_TIMEOUT : AP_TIMEOUT);
+    if (ESP_ERR_OK == ret)
+    {
+        g_auth_fail = 0;
+        g_ap_fast = TRUE;
+        /* learn bssid of ap picked by full join */
+        g_scan_now = !fast;
+        backoff_reset(&g_ap_backoff);
+        esp8266_ap_connect();
+        return;
+    }
+
+    if (fast && (-ESP_ERR_PWD != ret))
+    {
+        /* cached ap is gone, join any ap of ssid right away */
+        g_ap_fast = FALSE;
+        return;
+    }
+
+    if (-ESP_ERR_PWD == ret)
+    {
+        g_conn.ap_auth_fail ++;
+        g_auth_fail ++;
+        if (g_auth_fail >= PWD_RESET_COUNT)
         {
-            TRACE("connect ap:%s, %s\r\n", g_ssid, g_pwd);
-            if(ESP_ERR_OK == esp8266_connect_ap(g_ssid, g_pwd, 
-                                                20000 / portTICK_PERIOD_MS))
+            TRACE("password refused %d times, restore\r\n", g_auth_fail);
+            g_auth_fail = 0;
+            flash_restore();
+        }
+    }
+    else
+    {
+        /* ap not found or timeout, e.g. ap is rebooting */
+        g_conn.ap_transient ++;
+    }
+    
+    TickType_t delay = backoff_fail(&g_ap_backoff);
+    TRACE("ap retry in %dms\r\n", delay * portTICK_PERIOD_MS);
+}
+
+/**
+ * @brief cache ap as last good one
+ * @param ap - ap to cache
+ */
+static void save_ap(const esp8266_ap *ap)
+{
+    memcpy(g_bssid, ap->bssid, 6);
+    g_channel = ap->channel;
+    g_bssid_valid = TRUE;
+    flash_set_bssid(g_bssid, g_channel);
+}
+
+/**
+ * @brief scan aps of ssid in background, keep strongest ap cached and 
+ *        roam when current ap is weak
+ */
+static void maintain_scan(void)
+{
+    if (!ap_connected || ota_active() || (!g_scan_now && 
+        (xTaskGetTickCount() - g_scan_time < SCAN_PERIOD)))
+    {
+        return;
+    }
+
+    /* scan commands share serial link with sockets */
+    if (!netif_lock(DEFAULT_TIMEOUT))
+    {
+        return;
+    }
+    int count = esp8266_scan(g_ssid, g_scan, SCAN_MAX);
+    netif_unlock();
+    g_scan_now = FALSE;
+    g_scan_time = xTaskGetTickCount();
+    if (count <= 0)
+    {
+        return;
+    }
+
+    const esp8266_ap *best = &g_scan[0];
+    const esp8266_ap *cur = NULL;
+    for (int i = 0; (i < count) && g_bssid_valid; ++i)
+    {
+        if (0 == memcmp(g_scan[i].bssid, g_bssid, 6))
+        {
+            cur = &g_scan[i];
+        }
+    }
+    TRACE("scan %d aps, best %d dBm ch %d, current %d dBm\r\n", count,
+          best->rssi, best->channel, (NULL == cur) ? 0 : cur->rssi);
+
+    if (NULL == cur)
+    {
+        /* first join or cached ap is gone */
+        save_ap(best);
+    }
+    else if ((cur != best) && (cur->rssi < ROAM_RSSI) &&
+             (best->rssi >= cur->rssi + ROAM_MARGIN))
+    {
+        TRACE("roam to stronger ap\r\n");
+        save_ap(best);
+        if (netif_lock(DEFAULT_TIMEOUT))
+        {
+            /* ap disconnect event starts join with new bssid */
+            esp8266_disconnect_ap();
+            netif_unlock();
+        }
+    }
+    else
+    {
+        /* channel may have changed */
+        save_ap(cur);
+    }
+}
+
+/**
+ * @brief run broker connection state machine
+ */
+static void maintain_broker(void)
+{
+    TickType_t elapsed = xTaskGetTickCount() - g_state_time;
+    int ret = 0;
+    
+    if (!connmgr_active_up())
+    {
+        if (CONN_LINK != g_state)
+        {
+            mqtt_notify_disconnect();
+            set_state(CONN_LINK);
+        }
+        return;
+    }
+    
+    switch (g_state)
+    {
+    case CONN_LINK:
+        set_state(CONN_SOCKET);
+        break;
+    case CONN_SOCKET:
+        if (backoff_due(&g_broker_backoff))
+        {
+            set_state(CONN_WAIT_SOCKET);
+            ret = mqtt_connect_server(MQTT_ID, CONFIG_BROKER_ADDRESS, 
+                                      CONFIG_BROKER_PORT);
+            if (-ESP_ERR_ALREADY == ret)
+            {
+                mqtt_notify_connect(MQTT_ID);
+                set_state(CONN_SESSION);
+            }
+            else if ((0 != ret) && (CONN_WAIT_SOCKET == g_state))
             {
-                ap_connected = TRUE;
+                broker_fail(FALSE);
             }
         }
-        else
+        break;
+    case CONN_WAIT_SOCKET:
+        if (elapsed >= BROKER_TIMEOUT)
         {
-            vTaskDelay(3000 / portTICK_PERIOD_MS);
+            broker_fail(FALSE);
         }
+        break;
+    case CONN_SESSION:
+        {
+        /* connect mqtt */
+        connect_param param;
+        /* keep session, unacknowledged messages are replayed from outbox */
+        param.flag.flag = 0x00;
+        param.client_id = (const char *)g_id;
+        param.alive_time = g_alive;
+        set_state(CONN_WAIT_ACK);
+        mqtt_connect(&param);
+        }
+        break;
+    case CONN_WAIT_ACK:
+        if (elapsed >= BROKER_TIMEOUT)
+        {
+            netif_close(MQTT_ID);
+            broker_fail(FALSE);
+        }
+        break;
+    case CONN_ONLINE:
+        if (g_broker_dead)
+        {
+            /* broker or path is dead, reconnect at once with shorter 
+             * keepalive */
+            g_alive = (g_alive / 2 < KEEPALIVE_MIN) ? KEEPALIVE_MIN : 
+                                                      g_alive / 2;
+            g_conn.broker_transient ++;
+            netif_close(MQTT_ID);
+            mqtt_notify_disconnect();
+            backoff_reset(&g_broker_backoff);
+            set_state(CONN_SOCKET);
+        }
+        else if (g_renegotiate)
+        {
+            /* quiet link, reconnect with longer keepalive */
+            g_alive = (g_alive * 2 > KEEPALIVE_MAX) ? KEEPALIVE_MAX : 
+                                                      g_alive * 2;
+            TRACE("keepalive -> %ds\r\n", g_alive);
+            mqtt_disconnect();
+            vTaskDelay(DEFAULT_TIMEOUT);
+            netif_close(MQTT_ID);
+            mqtt_notify_disconnect();
+            backoff_reset(&g_broker_backoff);
+            set_state(CONN_SOCKET);
+            /* planned, not counted as reconnect */
+            g_lost = FALSE;
+        }
+        break;
+    default:
+        break;
     }
 }
 
 /**
- * @brief heart beat process task
+ * @brief report version and ota status, offset tells server which chunk
+ *        to send next
+ * @param status - ota error code
  */
-static void vHeart(void *pvParameters)
+static void ota_reply(int status)
 {
-    for (;;)
+    char content[40];
+    sprintf(content, "%s,%x,%d", VERSION, ota_offset(), -status);
+    g_ota_time = xTaskGetTickCount();
+    mqtt_publish(topic_ota_ack, content, 0, 0, 0);
+}
+
+/**
+ * @brief process ota message
+ *        B<size hex>,<crc hex> - begin or resume patch download, patch 
+ *                                is made by tools/mkdelta.py
+ *        D<offset, 4 bytes big endian><data> - patch chunk
+ *        F - verify patch and reboot to install
+ *        A - abort download
+ * @param data - message data
+ * @param len - message length
+ */
+static void process_ota(const uint8_t *data, uint32_t len)
+{
+    int status = OTA_ERR_OK;
+    switch (data[0])
     {
-        if (0x03 == mqtt_status)
+    case 'B':
+        {
+        char str[20];
+        char *end = NULL;
+        uint32_t str_len = (len > 19) ? 19 : len;
+        memcpy(str, data, str_len);
+        str[str_len] = '\0';
+        uint32_t size = strtoul(str + 1, &end, 16);
+        if (',' == *end)
+        {
+            status = ota_begin(size, strtoul(end + 1, NULL, 16));
+        }
+        else
+        {
+            status = -OTA_ERR_SIZE;
+        }
+        }
+        break;
+    case 'D':
+        if (len > 5)
+        {
+            uint32_t offset = ((uint32_t)data[1] << 24) | 
+                              ((uint32_t)data[2] << 16) |
+                              ((uint32_t)data[3] << 8) | data[4];
+            status = ota_write(offset, data + 5, len - 5);
+        }
+        else
         {
-            mqtt_pingreq();
+            status = -OTA_ERR_SIZE;
         }
-        vTaskDelay(9000 / portTICK_PERIOD_MS);
+        break;
+    case 'F':
+        status = ota_finish();
+        g_ota_reboot = (OTA_ERR_OK == status);
+        break;
+    case 'A':
+        ota_abort();
+        break;
+    default:
+        status = -OTA_ERR_STATE;
+        break;
+    }
+
+    ota_reply(status);
+}
+
+/**
+ * @brief process debug message, result is reported on stats topic
+ *        C<level> - set modem traffic capture level, 0 off, 1 rx, 2 tx,
+ *                   3 all
+ * @param data - message data
+ * @param len - message length
+ */
+static void process_debug(const uint8_t *data, uint32_t len)
+{
+    char content[16];
+    if ((2 == len) && ('C' == data[0]) && (data[1] >= '0') && 
+        (data[1] <= '0' + CAPTURE_ALL))
+    {
+        capture_set_level(data[1] - '0');
+    }
+    else
+    {
+        TRACE("debug command invalid\r\n");
+    }
+
+    sprintf(content, "capture %d;", capture_get_level());
+    mqtt_publish(topic_stats, content, 0, 0, 0);
+}
+
+/**
+ * @brief request lost ota chunk again and reboot after verified download
+ */
+static void maintain_ota(void)
+{
+    if (g_ota_reboot)
+    {
+        /* leave time for ack */
+        vTaskDelay(DEFAULT_TIMEOUT);
+        SCB_SystemReset();
+    }
+
+    if ((CONN_ONLINE == g_state) && ota_active() &&
+        (xTaskGetTickCount() - g_ota_time >= OTA_TIMEOUT))
+    {
+        ota_reply(OTA_ERR_OK);
+    }
+}
+
+/**
+ * @brief restore credentials requested by mode button and reboot into
+ *        configure mode, flash is erased here instead of in timer task
+ */
+static void maintain_restore(void)
+{
+    if (g_restore)
+    {
+        TRACE("restore by mode button\r\n");
+        flash_restore();
+        /* leave time for trace */
+        vTaskDelay(DEFAULT_TIMEOUT);
+        SCB_SystemReset();
     }
 }
 
 /**
- * @brief ap process task
+ * @brief ir presence listener
+ * @param present - somebody in front of machine
  */
-static void vConnectMqtt(void *pvParameters)
+static void presence_cb(bool present)
 {
+    if (present)
+    {
+        g_presence = TRUE;
+    }
+}
+
+/**
+ * @brief retry link now when a customer walks up instead of waiting out
+ *        backoff, so machine is online before a vend command is sent
+ */
+static void maintain_presence(void)
+{
+    if (!g_presence)
+    {
+        return;
+    }
+
+    g_presence = FALSE;
+    /* wrong password count must not grow faster */
+    if (!ap_connected && (0 == g_auth_fail))
+    {
+        backoff_reset(&g_ap_backoff);
+    }
+
+    if (CONN_SOCKET == g_state)
+    {
+        backoff_reset(&g_broker_backoff);
+    }
+}
+
+/**
+ * @brief connect ap and mqtt server task, ap and mqtt connect requests 
+ *        block on module response, so they stay in one task
+ */
+static void vConnect(void *pvParameters)
+{
+    const netif *old = NULL;
+    if (connmgr_has(LINK_WIFI))
+    {
+        led_net_set_action("LED_NET", flash);
+    }
+    
     for (;;)
     {
-        if (ap_connected)
+        /* fall back to slower baudrate if link has receive errors */
+        netif_check();
+        maintain_restore();
+        maintain_presence();
+        maintain_ap();
+        maintain_scan();
+        
+        vTaskDelay(CONNECT_POLL);
+        old = netif_current();
+        if (connmgr_evaluate())
         {
-            vTaskDelay(3000 / portTICK_PERIOD_MS);
-            switch (mqtt_status)
+            /* migrate mqtt session to new link, events of old link are 
+             * dropped by netif now */
+            if ((CONN_SOCKET < g_state) && netif_lock(DEFAULT_TIMEOUT))
             {
-            case 0x00:
-                mqtt_connect_server(MQTT_ID, MQTT_ADDRESS, MQTT_PORT);
-                break;
-            case 0x01:
-                {
-                /* connect mqtt */
-                connect_param param;
-                param.flag.flag = 0x02;
-                param.client_id = (const char *)g_id;
-                param.alive_time = 8;
-                mqtt_connect(&param);
-                }
-                break;
-            default:
-                break;
+                /* mqtt send task may still be sending on old module */
+                old->close(MQTT_ID);
+                netif_unlock();
             }
+            mqtt_notify_disconnect();
+            backoff_reset(&g_broker_backoff);
+            set_state(CONN_LINK);
         }
-        else
+
+        maintain_broker();
+        maintain_ota();
+    }
+}
+
+/**
+ * @brief check keepalive, ping only when nothing was sent for most of 
+ *        keepalive time
+ * @return ticks to next check
+ */
+static TickType_t keepalive_check(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    if (g_ping_pending)
+    {
+        TickType_t wait = now - g_ping_time;
+        if (wait < PINGRESP_TIMEOUT)
         {
-            vTaskDelay(3000 / portTICK_PERIOD_MS);
+            return PINGRESP_TIMEOUT - wait;
         }
+        
+        TRACE("pingresp timeout\r\n");
+        g_ping_pending = FALSE;
+        g_broker_dead = TRUE;
+        return KEEPALIVE_POLL;
+    }
+
+    TickType_t interval = g_alive * 3 / 4 * 1000 / portTICK_PERIOD_MS;
+    TickType_t idle = mqtt_idle_time();
+    if (idle < interval)
+    {
+        return interval - idle;
+    }
+
+    /* no other traffic since last ping means link is quiet */
+    uint32_t packets = mqtt_data_packets();
+    if (packets == g_ping_packets)
+    {
+        g_quiet_pings ++;
+    }
+    else
+    {
+        g_quiet_pings = 0;
     }
+    g_ping_packets = packets;
+    
+    g_ping_time = now;
+    g_ping_pending = TRUE;
+    if (!mqtt_pingreq())
+    {
+        /* send queue is full, timer task must not wait, try again */
+        g_ping_pending = FALSE;
+        return KEEPALIVE_POLL;
+    }
+    connmgr_ping_sent();
+    return PINGRESP_TIMEOUT;
 }
 
 /**
- * @brief motor state process task
+ * @brief heart beat timer callback, one shot timer rearmed to next 
+ *        keepalive deadline
+ * @param xTimer - timer handle
  */
-static void vMotorState(void *pvParameters)
+static void vHeart(TimerHandle_t xTimer)
 {
-    uint16_t status = 0;
-    uint8_t status_str[11];
-    status_str[10] = 0x00;
-    for (;;)
+    TickType_t next = KEEPALIVE_POLL;
+    if ((CONN_ONLINE == g_state) && !g_broker_dead && !g_renegotiate)
     {
-        if (0x03 == mqtt_status)
+        next = keepalive_check();
+        if (next > KEEPALIVE_POLL)
         {
-            status = motor_getstatus();
-            for (int i = 0; i < 10; ++i)
-            {
-                if (status & 0x01)
-                {
-                    status_str[i] = '1';
-                }
-                else
-                {
-                    status_str[i] = '0';
-                }
-                status >>= 1;
-            }
-            mqtt_publish(topic_state, (const char *)status_str, 0, 0, 0);
-        }   
-        vTaskDelay(1800000 / portTICK_PERIOD_MS);
+            next = KEEPALIVE_POLL;
+        }
+    }
+    xTimerChangePeriod(xTimer, (0 == next) ? 1 : next, 0);
+}
+
+/**
+ * @brief publish motor status
+ * @param qos - publish qos, qos1 status is kept in outbox while offline
+ */
+static void publish_motor_status(uint8_t qos)
+{
+    uint8_t status[MOTOR_STATUS_SIZE];
+    uint8_t status_str[CONFIG_MOTOR_NUM + 1];
+    status_str[CONFIG_MOTOR_NUM] = 0x00;
+    motor_getstatus(status);
+    for (int i = 0; i < CONFIG_MOTOR_NUM; ++i)
+    {
+        if (status[i >> 3] & (1 << (i & 0x07)))
+        {
+            status_str[i] = '1';
+        }
+        else
+        {
+            status_str[i] = '0';
+        }
+    }
+    mqtt_publish(topic_state, (const char *)status_str, 0, qos, 0);
+}
+
+/**
+ * @brief motor state timer callback
+ * @param xTimer - timer handle
+ */
+static void vMotorState(TimerHandle_t xTimer)
+{
+    if (CONN_ONLINE == g_state)
+    {
+        publish_motor_status(0);
     }
 }
 
@@ -280,15 +862,30 @@ static void vMotorState(void *pvParameters)
  */
 static void mqtt_connack_cb(uint8_t status)
 {
+    if (CONN_WAIT_ACK != g_state)
+    {
+        return ;
+    }
+    
     if (MQTT_ERR_OK == status)
     {
-        led_net_set_action("LED_MQTT", on);
-        mqtt_status |= 0x02;
+        set_state(CONN_ONLINE);
+        sysinit_mark(BOOT_ONLINE);
         /* register sn */
-        mqtt_publish(TOPIC_REGISTER, (const char *)g_id, 0, 1, 0);
+        mqtt_publish(CONFIG_TOPIC_REGISTER, (const char *)g_id, 0, 1, 0);
 
         /* subscribe topic */
         mqtt_subscribe(topic_control, 2);
+        mqtt_subscribe(topic_ota, 1);
+        mqtt_subscribe(topic_debug, 1);
+        ota_reply(OTA_ERR_OK);
+    }
+    else
+    {
+        TRACE("connack refused: %d\r\n", status);
+        netif_close(MQTT_ID);
+        broker_fail((MQTT_ERR_NAME_PWD == status) || 
+                    (MQTT_ERR_AUTHORIZE == status));
     }
 }
 
@@ -298,7 +895,47 @@ static void mqtt_connack_cb(uint8_t status)
 static void mqtt_publish_cb(const char *topic, uint8_t *data, uint32_t len)
 {
     assert_param(len >= 1);
-    g_motor_num = *data - '0';
+    if (0 == strcmp(topic, topic_ota))
+    {
+        process_ota(data, len);
+        return ;
+    }
+
+    if (0 == strcmp(topic, topic_debug))
+    {
+        process_debug(data, len);
+        return ;
+    }
+    
+    /* "<num>[,<crc32 hex>]", decimal motor number, crc covers digits */
+    uint32_t digits = 0;
+    uint32_t num = 0;
+    while ((digits < len) && (digits < MOTOR_NUM_DIGITS) &&
+           (data[digits] >= '0') && (data[digits] <= '9'))
+    {
+        num = num * 10 + data[digits] - '0';
+        digits++;
+    }
+    g_motor_num = (uint16_t)num;
+    if ((0 == digits) || ((digits < len) && (',' != data[digits])))
+    {
+        TRACE("vend command invalid\r\n");
+        g_motor_num = MOTOR_NUM_INVALID;
+    }
+    else if (len > digits + 1)
+    {
+        char crc_str[9];
+        char *end = NULL;
+        uint32_t crc_len = (len - digits - 1 > 8) ? 8 : len - digits - 1;
+        memcpy(crc_str, data + digits + 1, crc_len);
+        crc_str[crc_len] = '\0';
+        uint32_t crc = strtoul(crc_str, &end, 16);
+        if ((end == crc_str) || (crc != crc32_calc(data, digits)))
+        {
+            TRACE("vend command crc error\r\n");
+            g_motor_num = MOTOR_NUM_INVALID;
+        }
+    }
 }
 
 /**
@@ -315,8 +952,10 @@ static void mqtt_puback_cb(uint16_t id)
  */
 static void mqtt_pubrel_cb(uint16_t id)
 {
-    assert_param(g_motor_num < 10);
-    motor_start(g_motor_num);
+    if (g_motor_num < CONFIG_MOTOR_NUM)
+    {
+        motor_start(g_motor_num);
+    }
 }
 
 /**
@@ -326,7 +965,7 @@ static void mqtt_suback_cb(uint8_t status, uint16_t id)
 {
     if (MQTT_SUB_ERR == status)
     {
-        if (0x03 == mqtt_status)
+        if (CONN_ONLINE == g_state)
         {
             /* try to subscribe again */
             mqtt_subscribe(topic_control, 2);
@@ -334,6 +973,20 @@ static void mqtt_suback_cb(uint8_t status, uint16_t id)
     }
 }
 
+/**
+ * @brief ping response callback, round trip time scores active link
+ */
+static void mqtt_pingresp_cb(void)
+{
+    g_ping_pending = FALSE;
+    connmgr_ping_resp();
+    if ((g_quiet_pings >= KEEPALIVE_QUIET) && (g_alive < KEEPALIVE_MAX))
+    {
+        g_quiet_pings = 0;
+        g_renegotiate = TRUE;
+    }
+}
+
 /**
  * @brief initialize mqtt driver
  */
@@ -348,7 +1001,7 @@ static void init_mqtt_driver(void)
     driver.pubrec = NULL;
     driver.pubcomp = NULL;
     driver.unsuback = NULL;
-    driver.pingresp = NULL;
+    driver.pingresp = mqtt_pingresp_cb;
     mqtt_attach(&driver);
 }
 
@@ -357,42 +1010,29 @@ static void init_mqtt_driver(void)
  */
 static void convert_chipid(void)
 {
-    uint32_t id[3];
+    static const char hex[] = "0123456789ABCDEF";
+    uint32_t id[CONFIG_CHIPID_WORDS];
     uint8_t len = 0;
-    uint8_t data = 0;
-    uint8_t up = 0, low = 0;
     Get_ChipID(id, &len);
+    assert_param(CONFIG_CHIPID_WORDS == len);
+    /* unique per machine, so machines don't retry in lock step */
+    backoff_seed(id[0] ^ id[1] ^ id[2]);
 
-    for (int i = 0; i < len; ++i)
+    uint8_t pos = 0;
+    for (uint8_t i = 0; i < CONFIG_CHIPID_WORDS; ++i)
     {
-        for(int j = 0; j < 4; j++)
+        for (int8_t shift = 28; shift >= 0; shift -= 4)
         {
-            data = ((id[i] & 0xff000000) >> 24);
-            up = data / 16;
-            low = data % 16;
-            if (up < 10)
-            {
-                g_id[i * 8 + j * 2] = up + '0';
-            }
-            else
-            {
-                g_id[i * 8 + j * 2] = up + 55;
-            }
-            
-            if (low < 10)
-            {
-                g_id[i * 8 + j * 2 + 1] = low + '0';
-            }
-            else
-            {
-                g_id[i * 8 + j * 2 + 1] = low + 55;
-            }
-           
-            id[i] <<= 8;
+            g_id[pos++] = hex[(id[i] >> shift) & 0x0f];
         }
     }
+    g_id[CONFIG_ID_LEN] = '\0';
 
-    g_id[24] = 0x00;
+    /* prefixes are in place, append id */
+    for (uint8_t i = 0; i < sizeof(topics) / sizeof(topics[0]); ++i)
+    {
+        memcpy(topics[i].buf + topics[i].offset, g_id, CONFIG_ID_LEN + 1);
+    }
 }
 
 /**
@@ -400,33 +1040,61 @@ static void convert_chipid(void)
  */
 static void init_param(void)
 {
-    mqtt_status = 0x00;
+    g_state = CONN_LINK;
     ap_connected = FALSE;
     g_motor_num = 0;
+    backoff_init(&g_ap_backoff, AP_BACKOFF_BASE, AP_BACKOFF_MAX);
+    backoff_init(&g_broker_backoff, BROKER_BACKOFF_BASE, BROKER_BACKOFF_MAX);
 }
 
 /**
- * @brief update motor status
+ * @brief update motor status after vend, must reach server
  */
 void wifi_update_motor_status(void)
 {
-    uint16_t status = 0;
-    uint8_t status_str[11];
-    status_str[10] = 0x00;
-    status = motor_getstatus();
-    for (int i = 0; i < 10; ++i)
+    publish_motor_status(1);
+}
+
+/**
+ * @brief publish runtime statistics
+ * @param content - statistics content
+ * @return publish status, FALSE when mqtt is not connected
+ */
+bool wifi_publish_stats(const char *content)
+{
+    if (CONN_ONLINE != g_state)
     {
-        if (status & 0x01)
-        {
-            status_str[i] = '1';
-        }
-        else
-        {
-            status_str[i] = '0';
-        }
-        status >>= 1;
+        return FALSE;
+    }
+    
+    mqtt_publish(topic_stats, content, 0, 0, 0);
+    return TRUE;
+}
+
+/**
+ * @brief get connection metrics
+ * @param stats - connection metrics output
+ */
+void wifi_get_conn_stats(conn_stats *stats)
+{
+    assert_param(NULL != stats);
+    *stats = g_conn;
+    stats->rx_drops = esp8266_tcp_drops() + m26_tcp_drops();
+}
+
+/**
+ * @brief request credentials restore and reboot, connect task does it
+ * @return FALSE if connect task is not running
+ */
+bool wifi_restore(void)
+{
+    if (NULL == xConnectTask)
+    {
+        return FALSE;
     }
-    mqtt_publish(topic_state, (const char *)status_str, 0, 0, 0);
+
+    g_restore = TRUE;
+    return TRUE;
 }
 
 /**
@@ -438,48 +1106,38 @@ bool wifi_init(void)
     TRACE("initialize wifi...\r\n");
     init_param();
     flash_get_ssid_pwd(g_ssid, g_pwd);
-    if (ESP_ERR_OK != esp8266_setmode(SAT))
+    g_bssid_valid = flash_get_bssid(g_bssid, &g_channel);
+    if (connmgr_has(LINK_WIFI) && (ESP_ERR_OK != esp8266_setmode(SAT)))
     {
         return FALSE;
     }
     
     init_mqtt_driver();
-    if (MODE_NET_WIFI == mode_net())
-    {
-        init_esp8266_driver();
-    }
-    else
-    {
-        init_m26_driver();
-    }
+    netif_listen(MQTT_ID, mqtt_socket_event);
+    init_esp8266_driver();
+    init_m26_driver();
     
-    xTaskCreate(vConnectMqtt, "connectmqtt", AP_STACK_SIZE, NULL, 
-                       AP_PRIORITY, &xConnectMqttTask);
-    xTaskCreate(vHeart, "heart", AP_STACK_SIZE, NULL, 
-                        AP_PRIORITY, &xHeartTask);
-    xTaskCreate(vMotorState, "motorstate", MOTOR_STATE_STACK_SIZE, NULL, 
-                       MOTOR_STATE_PRIORITY, &xMotorStateTask);
-    if ((NULL == xConnectMqttTask) ||
-        (NULL == xHeartTask) ||
-        (NULL == xMotorStateTask))
-    {
-        return FALSE;
-    }
     convert_chipid();
-    sprintf(topic_control, "%s/%s", "controller", g_id);
-    sprintf(topic_state, "%s/%s", "state", g_id);
+    ir_register(presence_cb);
 
-
-    if (MODE_NET_WIFI == mode_net())
+    xHeartTimer = xTimerCreateStatic("heart", KEEPALIVE_POLL, pdFALSE, NULL, 
+                                     vHeart, &xHeartTimerBuffer);
+    xMotorStateTimer = xTimerCreateStatic("motorstate", MOTOR_STATE_PERIOD, 
+                                          pdTRUE, NULL, vMotorState,
+                                          &xMotorStateTimerBuffer);
+    xConnectTask = xTaskCreateStatic(vConnect, "connect", AP_STACK_SIZE, NULL, 
+                                     AP_PRIORITY, xConnectStack, 
+                                     &xConnectTaskBuffer);
+    if ((NULL == xConnectTask) ||
+        (NULL == xHeartTimer) ||
+        (NULL == xMotorStateTimer))
     {
-        xTaskCreate(vConnectAp, "connectap", AP_STACK_SIZE, NULL, 
-                        AP_PRIORITY, &xConnectApTask); 
-        if (NULL == xConnectApTask)
-        {
-            return FALSE;
-        }
+        return FALSE;
     }
     
+    xTimerStart(xHeartTimer, 0);
+    xTimerStart(xMotorStateTimer, 0);
+    
     return TRUE;
 }
 
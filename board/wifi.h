@@ -12,8 +12,31 @@
 
 BEGIN_DECLS
 
+/* connection metrics */
+typedef struct
+{
+    /* ap refused password */
+    uint16_t ap_auth_fail;
+    /* ap not found, connect timeout or lost */
+    uint16_t ap_transient;
+    /* broker refused credentials */
+    uint16_t broker_auth_fail;
+    /* socket connect failed or lost, connack timeout */
+    uint16_t broker_transient;
+    /* broker reconnects after connection lost */
+    uint16_t reconnects;
+    /* time from connection lost to online again(ms) */
+    uint32_t last_reconnect;
+    uint32_t max_reconnect;
+    /* tcp data dropped by full receive queue */
+    uint32_t rx_drops;
+}conn_stats;
+
 bool wifi_init(void);
 void wifi_update_motor_status(void);
+bool wifi_publish_stats(const char *content);
+void wifi_get_conn_stats(conn_stats *stats);
+bool wifi_restore(void);
 
 END_DECLS
 
@@ -0,0 +1,271 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "stm32f10x_cfg.h"
+#include "cm3_core.h"
+#include "flash_map.h"
+#include "ota.h"
+#include "delta.h"
+#include "crc32.h"
+
+/* bootloader applies patch staged by ota and starts application, it
+ * runs on reset clock and uses no interrupt */
+#define RAM_START    (0x20000000)
+#define RAM_END      (0x20005000)
+
+#pragma language=extended
+#pragma segment="CSTACK"
+
+void __iar_program_start(void);
+
+typedef void (*intfunc)(void);
+typedef union { intfunc __fun; void * __ptr; } intvec_elem;
+
+/**
+ * @brief fault handler, wait for watchdog or power cycle
+ */
+static void fault(void)
+{
+    for (;;);
+}
+
+#pragma location = ".intvec"
+const intvec_elem __vector_table[] =
+{
+    { .__ptr = __sfe( "CSTACK" ) },
+    &__iar_program_start,
+    fault,
+    fault,
+    fault,
+    fault,
+    fault,
+};
+
+/**
+ * @brief read halfword from ota state page
+ * @param offset - halfword offset
+ * @return halfword
+ */
+static uint16_t state_half(uint32_t offset)
+{
+    return *(volatile const uint16_t *)(FLASH_OTA_ADDR + offset);
+}
+
+/**
+ * @brief read word from ota state page
+ * @param offset - word offset
+ * @return word
+ */
+static uint32_t state_word(uint32_t offset)
+{
+    return *(volatile const uint32_t *)(FLASH_OTA_ADDR + offset);
+}
+
+/**
+ * @brief set flag in ota state page
+ * @param offset - flag offset
+ */
+static void state_set(uint32_t offset)
+{
+    uint16_t flag = OTA_FLAG_SET;
+    FLASH_Write(FLASH_OTA_ADDR + offset, (uint8_t *)&flag, 2);
+}
+
+/* page being rebuilt */
+static uint8_t g_page[FLASH_PAGE_SIZE];
+static uint32_t g_fill = 0;
+
+/**
+ * @brief collect rebuilt page content
+ * @param arg - unused
+ * @param data - page content
+ * @param len - content length
+ */
+static void page_output(void *arg, const uint8_t *data, uint32_t len)
+{
+    (void)arg;
+    memcpy(g_page + g_fill, data, len);
+    g_fill += len;
+}
+
+/**
+ * @brief check if install has changed application area
+ * @return TRUE if any page is buffered
+ */
+static bool install_started(void)
+{
+    for (uint32_t i = 0; i < OTA_APP_PAGES; ++i)
+    {
+        if (OTA_FLAG_SET == state_half(OTA_OFFSET_BUFFERED + i * 2))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief rebuild one application page, content is kept in scratch page
+ *        until application page is rewritten and verified, so a power 
+ *        loss while page is erased restores it from scratch
+ * @param patch - staged patch
+ * @param size - patch size
+ * @param offset - segment offset
+ * @param header - patch header
+ * @param written - pages rebuilt by earlier segments
+ * @param seg - segment page and crc
+ * @return TRUE if page holds new content
+ */
+static bool install_page(const uint8_t *patch, uint32_t size, uint32_t offset,
+                         const delta_header *header, const uint32_t *written,
+                         delta_seg *seg)
+{
+    uint32_t addr = FLASH_APP_ADDR + seg->page * FLASH_PAGE_SIZE;
+    uint32_t len = delta_page_len(header, seg->page);
+    if (OTA_FLAG_SET != state_half(OTA_OFFSET_BUFFERED + seg->page * 2))
+    {
+        memset(g_page, 0xff, FLASH_PAGE_SIZE);
+        g_fill = 0;
+        if ((0 == delta_segment(patch, size, offset, header, written, seg,
+                                page_output, NULL)) ||
+            (seg->crc != crc32_calc(g_page, len)))
+        {
+            return FALSE;
+        }
+
+        if (0 == memcmp((const void *)addr, g_page, len))
+        {
+            /* page is not changed */
+            return TRUE;
+        }
+
+        do
+        {
+            FLASH_ErasePage(FLASH_SCRATCH_ADDR);
+            FLASH_Write(FLASH_SCRATCH_ADDR, g_page, FLASH_PAGE_SIZE);
+        } while (0 != memcmp((const void *)FLASH_SCRATCH_ADDR, g_page, len));
+        state_set(OTA_OFFSET_BUFFERED + seg->page * 2);
+    }
+    else if (seg->crc != crc32_calc((const void *)FLASH_SCRATCH_ADDR, len))
+    {
+        return FALSE;
+    }
+
+    while (0 != memcmp((const void *)addr, (const void *)FLASH_SCRATCH_ADDR,
+                       len))
+    {
+        FLASH_ErasePage(addr);
+        FLASH_Write(addr, (uint8_t *)FLASH_SCRATCH_ADDR, FLASH_PAGE_SIZE);
+    }
+
+    return TRUE;
+}
+
+/**
+ * @brief rebuild application area from staged patch in place, every done
+ *        page is recorded so install resumes after power loss, staging 
+ *        area is never changed during install, installed is set only when
+ *        application area crc matches
+ * @return TRUE if installed, FALSE if install failed
+ */
+static bool install(void)
+{
+    const uint8_t *patch = (const uint8_t *)FLASH_STAGING_ADDR;
+    uint32_t size = state_word(OTA_OFFSET_SIZE);
+    uint32_t crc = state_word(OTA_OFFSET_CRC);
+    delta_header header;
+    if ((0 == size) || (size > FLASH_STAGING_SIZE) ||
+        (crc != crc32_calc(patch, size)) ||
+        !delta_header_get(patch, size, &header))
+    {
+        return FALSE;
+    }
+
+    uint32_t written[DELTA_BITMAP_WORDS] = {0};
+    for (uint32_t i = 0; i < header.pages; ++i)
+    {
+        if (OTA_FLAG_SET == state_half(OTA_OFFSET_DONE + i * 2))
+        {
+            written[i >> 5] |= (1UL << (i & 0x1f));
+        }
+    }
+
+    /* segment order is the order ota verified against running image */
+    uint32_t offset = DELTA_HEADER_SIZE;
+    for (uint32_t i = 0; i < header.pages; ++i)
+    {
+        delta_seg seg;
+        uint32_t next = delta_segment(patch, size, offset, &header, written,
+                                      &seg, NULL, NULL);
+        if (0 == next)
+        {
+            return FALSE;
+        }
+
+        if (OTA_FLAG_SET != state_half(OTA_OFFSET_DONE + seg.page * 2))
+        {
+            if (!install_page(patch, size, offset, &header, written, &seg))
+            {
+                return FALSE;
+            }
+            state_set(OTA_OFFSET_DONE + seg.page * 2);
+            written[seg.page >> 5] |= (1UL << (seg.page & 0x1f));
+        }
+        offset = next;
+    }
+
+    if (header.new_crc != crc32_calc((const void *)FLASH_APP_ADDR,
+                                     header.new_size))
+    {
+        return FALSE;
+    }
+
+    state_set(OTA_OFFSET_INSTALLED);
+    return TRUE;
+}
+
+/**
+ * @brief start application with its own stack and vector table
+ */
+static void start_app(void)
+{
+    uint32_t sp = *(volatile const uint32_t *)FLASH_APP_ADDR;
+    intfunc entry = (intfunc)(*(volatile const uint32_t *)(FLASH_APP_ADDR + 4));
+    if ((sp <= RAM_START) || (sp > RAM_END))
+    {
+        /* no application */
+        return ;
+    }
+
+    VectTable table;
+    table.offsetAddr = (FLASH_APP_ADDR >> 9);
+    table.place = CODE;
+    SCB_SetVectTableConfig(table);
+    __set_MSP(sp);
+    entry();
+}
+
+int main(void)
+{
+    if ((OTA_MAGIC == state_half(OTA_OFFSET_MAGIC)) &&
+        (OTA_FLAG_SET == state_half(OTA_OFFSET_READY)) &&
+        (OTA_FLAG_CLEAR == state_half(OTA_OFFSET_INSTALLED)))
+    {
+        if (!install() && install_started())
+        {
+            /* install failed after application area was changed, never
+             * start a partly rebuilt application */
+            for (;;);
+        }
+    }
+
+    start_app();
+
+    for (;;);
+}
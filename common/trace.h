@@ -27,7 +27,18 @@ BEGIN_DECLS
       #define TRECE(fmt, ...) trace(__FILE__, STR(__LINE__), fmt, ##__VA_ARGS__)
     */
     extern void trace(const char *module, const char *fmt, ...);
+  #ifdef __BINARY_TRACE
+    /**
+     * @brief binary trace output, module and fmt are sent as their flash 
+     *        address and resolved against the firmware elf on the host by 
+     *        tools/tracedec.py, only arguments are sent as raw data
+     */
+    /* external function */
+    extern void trace_bin(const char *module, const char *fmt, ...);
+    #define TRACE(fmt, ...) trace_bin(__TRACE_MODULE, fmt, ##__VA_ARGS__)
+  #else
     #define TRACE(fmt, ...) trace(__TRACE_MODULE, fmt, ##__VA_ARGS__)
+  #endif
 #else
     #define TRACE(fmt, ...)
 #endif
@@ -6,18 +6,17 @@
 * See the COPYING file for the terms of usage and distribution.
 */
 #include <string.h>
-#include <stdio.h>
 #include "mqtt.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
 #include "semphr.h"
-#include "esp8266.h"
-#include "m26.h"
+#include "timers.h"
+#include "netif.h"
+#include "outbox.h"
 #include "trace.h"
 #include "global.h"
 #include "assert.h"
-#include "mode.h"
 
 
 #undef __TRACE_MODULE
@@ -32,6 +31,7 @@ static SemaphoreHandle_t xSendMutex = NULL;
 
 #define MQTT_MAX_MSG_NUM     (6)
 #define MQTT_MAX_MSG_SIZE    (128)
+#define MQTT_SEND_WAIT       (200 / portTICK_PERIOD_MS)
 
 typedef struct
 {
@@ -39,6 +39,15 @@ typedef struct
     uint8_t data[MQTT_MAX_MSG_SIZE];
 }mqtt_msg;
 
+/* queue and task storage */
+static uint8_t ucSendStorage[MQTT_MAX_MSG_NUM * sizeof(mqtt_msg)];
+static StaticQueue_t xSendQueueBuffer;
+static StaticSemaphore_t xSendMutexBuffer;
+static StackType_t xMqttRecvStack[MQTT_STACK_SIZE];
+static StaticTask_t xMqttRecvTaskBuffer;
+static StackType_t xMqttSendStack[MQTT_STACK_SIZE];
+static StaticTask_t xMqttSendTaskBuffer;
+
  
 /* message type definition */
 #define TYPE_CONNECT        (0x10)
@@ -56,20 +65,30 @@ typedef struct
 #define TYPE_PINGRESP       (0xd0)
 #define TYPE_DISCONNECT     (0xe0)
 
+/* last outbound packet, any control packet resets keepalive */
+static volatile TickType_t g_last_send = 0;
+/* outbound packets except pingreq */
+static volatile uint32_t g_data_packets = 0;
+
 /* uuid */
 static uint16_t g_uuid = 0;
 static uint8_t g_linkid = 0xff;
+/* session accepted by server, outbox can be sent */
+static volatile bool g_session = FALSE;
 
 /* connect */
 const uint8_t protocol_name[6] = {0x00, 0x04, 'M', 'Q', 'T', 'T'};
 #define PROTOCOL_LEVEL    (0x04)
 connect_flag default_connect_flag = {0x00};
 
-static TaskHandle_t xMqttHandle = NULL;
+static TaskHandle_t xMqttRecvHandle = NULL;
+static TaskHandle_t xMqttSendHandle = NULL;
 
 /* process function */
 typedef void (*process_func)(const uint8_t *data, uint8_t len);
 
+static void mqtt_send_kick(void);
+
 
 /**
  * @brief connack default process function
@@ -235,6 +254,13 @@ void process_connack(const uint8_t *data, uint8_t len)
     {
         assert_param(decode_length(data, NULL) == 2);
         g_driver.connack(data[3]);
+        if (MQTT_ERR_OK == data[3])
+        {
+            /* replay unacknowledged messages in order */
+            outbox_rewind();
+            g_session = TRUE;
+            mqtt_send_kick();
+        }
     }
 }
 
@@ -313,6 +339,7 @@ void process_puback(const uint8_t *data, uint8_t len)
         uint16_t uuid = data[2];
         uuid <<= 8;
         uuid += data[3];
+        outbox_ack(uuid);
         g_driver.puback(uuid);
     }
 }
@@ -330,6 +357,8 @@ void process_pubrec(const uint8_t *data, uint8_t len)
         uint16_t uuid = data[2];
         uuid <<= 8;
         uuid += data[3];
+        /* outbox only holds qos1 records, this answers the broker */
+        mqtt_pubrel(uuid);
         g_driver.pubrec(uuid);
     }
 }
@@ -435,13 +464,59 @@ func_node funcs[] =
 };
 
 /**
- * @brief mqtt send data
- * @param data - data to send
- * @param length - data length
+ * @brief mqtt send data, timer callbacks never wait for queue space, 
+ *        all other timers run in the same task
+ * @param msg - message to send
+ * @return TRUE if message is queued
  */
-static __INLINE void mqtt_send_data(const mqtt_msg *msg)
+static bool mqtt_send_data(const mqtt_msg *msg)
 {
-    xQueueSend(xSendQueue, msg, 200 / portTICK_PERIOD_MS);
+    TickType_t wait = MQTT_SEND_WAIT;
+    if (xTaskGetCurrentTaskHandle() == xTimerGetTimerDaemonTaskHandle())
+    {
+        wait = 0;
+    }
+
+    return (pdPASS == xQueueSend(xSendQueue, msg, wait));
+}
+
+/**
+ * @brief wake up send task to send outbox, empty message is the signal
+ */
+static void mqtt_send_kick(void)
+{
+    mqtt_msg msg;
+    msg.size = 0;
+    xQueueSend(xSendQueue, &msg, 0);
+}
+
+/**
+ * @brief send pending outbox messages
+ * @param msg - message buffer
+ */
+static void send_outbox(mqtt_msg *msg)
+{
+    bool dup = FALSE;
+    while (g_session)
+    {
+        msg->size = outbox_next(msg->data, MQTT_MAX_MSG_SIZE, &dup);
+        if (0 == msg->size)
+        {
+            break;
+        }
+
+        if (dup)
+        {
+            msg->data[0] |= 0x08;
+        }
+        if (NETIF_ERR_OK != netif_send(g_linkid, msg->data, msg->size))
+        {
+            /* replayed on next session */
+            break;
+        }
+        g_last_send = xTaskGetTickCount();
+        g_data_packets ++;
+    }
 }
 
 /**
@@ -455,26 +530,136 @@ void vMqttSend(void *pvParameters)
     {
         if (xQueueReceive(xSendQueue, &msg, portMAX_DELAY))
         {
-            if (MODE_NET_WIFI == mode_net())
+            if (0 == msg.size)
             {
-                if (ESP_ERR_OK == esp8266_prepare_send(g_linkid, msg.size))
-                {
-                    esp8266_write((const char *)msg.data, msg.size);
-                }
+                send_outbox(&msg);
             }
-            else
+            else if (NETIF_ERR_OK == netif_send(g_linkid, msg.data, msg.size))
             {
-                if (M26_ERR_OK == m26_prepare_send(msg.size, 
-                                                   3000 / portTICK_PERIOD_MS))
+                g_last_send = xTaskGetTickCount();
+                if (TYPE_PINGREQ != msg.data[0])
                 {
-                    m26_write((const char *)msg.data, msg.size, 
-                              1000 / portTICK_PERIOD_MS);
+                    g_data_packets ++;
                 }
             }
         }
     }
 }
 
+/**
+ * @brief get packet length from fixed header
+ * @param data - packet data
+ * @param len - valid data length
+ * @return packet length, 0 if fixed header is not complete, 0xffffffff
+ *         if remaining length is invalid
+ */
+static uint32_t packet_length(const uint8_t *data, uint8_t len)
+{
+    uint32_t multipiler = 1;
+    uint32_t value = 0;
+    for (uint8_t i = 1; i < len; ++i)
+    {
+        value += (data[i] & 0x7f) * multipiler;
+        if (0 == (data[i] & 0x80))
+        {
+            return value + i + 1;
+        }
+        
+        multipiler *= 128;
+        if (i >= 4)
+        {
+            return 0xffffffff;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief process one complete packet
+ * @param data - packet data
+ * @param len - packet length
+ */
+static void process_packet(const uint8_t *data, uint8_t len)
+{
+    int count = sizeof(funcs) / sizeof(funcs[0]);
+    for (int i = 0; i < count; ++i)
+    {
+        if ((funcs[i].type & 0xf0) == (data[0] & 0xf0))
+        {
+            funcs[i].process(data, len);
+            break;
+        }
+    }
+}
+
+/* received stream, packets may be split or merged by network module */
+static uint8_t g_stream[MQTT_MAX_MSG_SIZE];
+static uint8_t g_stream_len = 0;
+/* rest of dropped oversized packet still to come */
+static uint32_t g_skip = 0;
+
+/**
+ * @brief add received data to stream and process complete packets
+ * @param data - received data
+ * @param len - data length
+ */
+static void process_stream(const uint8_t *data, uint16_t len)
+{
+    while (len > 0)
+    {
+        if (g_skip > 0)
+        {
+            uint16_t skip = (g_skip > len) ? len : (uint16_t)g_skip;
+            g_skip -= skip;
+            data += skip;
+            len -= skip;
+            continue;
+        }
+
+        uint16_t copy = MQTT_MAX_MSG_SIZE - g_stream_len;
+        if (copy > len)
+        {
+            copy = len;
+        }
+        memcpy(g_stream + g_stream_len, data, copy);
+        g_stream_len += copy;
+        data += copy;
+        len -= copy;
+
+        for (;;)
+        {
+            uint32_t packet_len = packet_length(g_stream, g_stream_len);
+            if (0xffffffff == packet_len)
+            {
+                /* stream lost sync, drop it */
+                TRACE("drop stream: %d\r\n", g_stream_len);
+                g_stream_len = 0;
+                break;
+            }
+
+            if (packet_len > MQTT_MAX_MSG_SIZE)
+            {
+                /* packet too large, discard it as it arrives so its body
+                 * is not parsed as headers */
+                TRACE("drop packet: %d\r\n", packet_len);
+                g_skip = packet_len - g_stream_len;
+                g_stream_len = 0;
+                break;
+            }
+
+            if ((0 == packet_len) || (packet_len > g_stream_len))
+            {
+                break;
+            }
+
+            process_packet(g_stream, packet_len);
+            g_stream_len -= packet_len;
+            memmove(g_stream, g_stream + packet_len, g_stream_len);
+        }
+    }
+}
+
 /**
  * @brief mqtt receive task
  * @param pvParameters - task parameters
@@ -483,45 +668,35 @@ void vMqttRecv(void *pvParameters)
 {
     uint8_t data[65];
     uint16_t len;
-    int count = sizeof(funcs) / sizeof(funcs[0]);
-    uint8_t id = 0;
+    uint8_t id = 0xff;
     for (;;)
     {
-        if (MODE_NET_WIFI == mode_net())
+        if (id != g_linkid)
         {
-            if (ESP_ERR_OK == esp8266_recv(&id, data, &len, portMAX_DELAY))
-            {
-                for (int i = 0; i < count; ++i)
-                {
-                    if (funcs[i].type == (data[0] & 0xf0))
-                    {
-                        funcs[i].process(data, len);
-                        break;
-                    }
-                    else if (funcs[i].type == data[0])
-                    {
-                        funcs[i].process(data, len);
-                        break;
-                    }
-                }
-            }
+            /* new connection, drop data of last one */
+            id = g_linkid;
+            g_stream_len = 0;
+            g_skip = 0;
         }
-        else
+        
+        if (id >= NETIF_MAX_SOCKET_NUM)
         {
-            if (M26_ERR_OK == m26_recv(data, &len, portMAX_DELAY))
-            {
-                for (int i = 0; i < count; ++i)
-                {
-                    if (funcs[i].type == data[0])
-                    {
-                        funcs[i].process(data, len);
-                        break;
-                    }
-                }
-            }
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        int ret = netif_recv(id, data, &len, 1000 / portTICK_PERIOD_MS);
+        if (NETIF_ERR_OK == ret)
+        {
+            process_stream(data, len);
+        }
+        else if (-NETIF_ERR_LOST == ret)
+        {
+            /* part of stream is gone, do not join data across the gap */
+            TRACE("stream data lost\r\n");
+            g_stream_len = 0;
+            g_skip = 0;
         }
-         
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
 }
 
@@ -531,23 +706,33 @@ void vMqttRecv(void *pvParameters)
 bool mqtt_init(void)
 {
     TRACE("init mqtt...\r\n");
-    xSendMutex = xSemaphoreCreateMutex();
+    if (!outbox_init())
+    {
+        return FALSE;
+    }
+    g_uuid = outbox_last_id() + 1;
+    
+    xSendMutex = xSemaphoreCreateMutexStatic(&xSendMutexBuffer);
     if (NULL == xSendMutex)
     {
         return FALSE;
     }
     
-    xSendQueue = xQueueCreate(MQTT_MAX_MSG_NUM, sizeof(mqtt_msg) / sizeof(uint8_t));
+    xSendQueue = xQueueCreateStatic(MQTT_MAX_MSG_NUM, 
+                                    sizeof(mqtt_msg) / sizeof(uint8_t),
+                                    ucSendStorage, &xSendQueueBuffer);
     if (NULL == xSendQueue)
     {
         return FALSE;
     }
     
-    xTaskCreate(vMqttRecv, "MqttRecv", MQTT_STACK_SIZE, 
-            NULL, MQTT_PRIORITY, &xMqttHandle);
-    xTaskCreate(vMqttSend, "MqttSend", MQTT_STACK_SIZE, 
-            NULL, MQTT_PRIORITY, &xMqttHandle);
-    if (NULL == xMqttHandle)
+    xMqttRecvHandle = xTaskCreateStatic(vMqttRecv, "MqttRecv", MQTT_STACK_SIZE, 
+                                        NULL, MQTT_PRIORITY, xMqttRecvStack,
+                                        &xMqttRecvTaskBuffer);
+    xMqttSendHandle = xTaskCreateStatic(vMqttSend, "MqttSend", MQTT_STACK_SIZE, 
+                                        NULL, MQTT_PRIORITY, xMqttSendStack,
+                                        &xMqttSendTaskBuffer);
+    if ((NULL == xMqttRecvHandle) || (NULL == xMqttSendHandle))
     {
         return FALSE;
     }
@@ -707,16 +892,7 @@ static uint32_t calculate_connect_payload_len(const connect_param *param)
  */
 int mqtt_connect_server(uint16_t id, const char *ip, uint16_t port)
 {
-    if (MODE_NET_WIFI == mode_net())
-    {
-        return esp8266_connect_server(id, "TCP", ip, port);
-    }
-    else
-    {
-        char port_str[6];
-        sprintf(port_str, "%d", port);
-        return m26_connect("TCP", ip, port_str, 3000 / portTICK_PERIOD_MS);
-    }
+    return netif_connect(id, "TCP", ip, port);
 }
 
 /**
@@ -804,6 +980,7 @@ void mqtt_connect(const connect_param *param)
     if (0x01 == param->flag._flag.clear_session)
     {
         /* clear unack qos1 and qos2 message*/
+        outbox_clear();
     }
 
     /* send message to queue */
@@ -811,9 +988,11 @@ void mqtt_connect(const connect_param *param)
 }
 
 /**
- * @brief public content to topic
+ * @brief public content to topic, qos2 is not supported, outbox keeps
+ *        no pubrel state to finish the flow after reconnect
  * @param topic - topic to publish
  * @param content - content to publish
+ * @param qos - publish qos, 0 or 1
  */
 
 void mqtt_publish(const char *topic, const char *content, uint8_t dup,
@@ -821,6 +1000,11 @@ void mqtt_publish(const char *topic, const char *content, uint8_t dup,
 {
     assert_param(NULL != topic);
     assert_param(NULL != content);
+    if (qos > 1)
+    {
+        TRACE("qos2 publish is not supported\r\n");
+        return ;
+    }
     //TRACE("mqtt publish\r\n");
     mqtt_msg msg;
     uint8_t *pdata = msg.data;
@@ -851,18 +1035,33 @@ void mqtt_publish(const char *topic, const char *content, uint8_t dup,
     *pdata ++ = (uint8_t)(str_len & 0xff);
     strcpy((char *)pdata, topic);
     pdata += str_len;
+    uint16_t id = 0;
     if (0 != qos)
     {
-        *pdata ++ = (uint8_t)(g_uuid >> 8);
-        *pdata ++ = (uint8_t)(g_uuid & 0xff);
-        g_uuid ++;
+        /* packet id 0 is not allowed */
+        if (0 == g_uuid)
+        {
+            g_uuid ++;
+        }
+        id = g_uuid ++;
+        *pdata ++ = (uint8_t)(id >> 8);
+        *pdata ++ = (uint8_t)(id & 0xff);
     }
     strcpy((char *)pdata, content);
     
     msg.size = payload_len + encode_len + 1;
 
-    /* send message to queue */
-    mqtt_send_data(&msg);
+    if ((0 != qos) && outbox_append(id, msg.data, msg.size))
+    {
+        /* sent from outbox when session is online, kept over outage and 
+         * reboot until acknowledged */
+        mqtt_send_kick();
+    }
+    else
+    {
+        /* send message to queue */
+        mqtt_send_data(&msg);
+    }
 }
 
 /**
@@ -996,6 +1195,26 @@ void mqtt_pubrec(uint16_t id)
     mqtt_send_data(&msg);
 }
 
+/**
+ * @brief pubrel signal
+ */
+void mqtt_pubrel(uint16_t id)
+{
+    mqtt_msg msg;
+    uint8_t *pdata = msg.data;
+
+    /* packet data */
+    *pdata ++ = TYPE_PUBREL;
+    *pdata ++ = 0x02;
+    *pdata ++ = (uint8_t)(id >> 8);
+    *pdata ++ = (uint8_t)(id & 0xff);
+    
+    msg.size = 4;
+
+    /* send message to queue */
+    mqtt_send_data(&msg);
+}
+
 /**
  * @brief pubcomp signal
  */
@@ -1020,8 +1239,9 @@ void mqtt_pubcomp(uint16_t id)
 
 /**
  * @brief pingreq topic from server
+ * @return TRUE if pingreq is queued
  */
-void mqtt_pingreq(void)
+bool mqtt_pingreq(void)
 {
     //TRACE("mqtt pingreq\r\n");
     mqtt_msg msg;
@@ -1034,7 +1254,7 @@ void mqtt_pingreq(void)
     msg.size = 2;
 
     /* send message to queue */
-    mqtt_send_data(&msg);
+    return mqtt_send_data(&msg);
 }
 
 /**
@@ -1056,6 +1276,25 @@ void mqtt_disconnect(void)
     mqtt_send_data(&msg);
 }
 
+/**
+ * @brief get time since last outbound packet
+ * @return idle time in ticks
+ */
+uint32_t mqtt_idle_time(void)
+{
+    return xTaskGetTickCount() - g_last_send;
+}
+
+/**
+ * @brief get outbound packet count except pingreq, keepalive uses it to 
+ *        find quiet link
+ * @return packet count
+ */
+uint32_t mqtt_data_packets(void)
+{
+    return g_data_packets;
+}
+
 /**
  * @brief notify socket connect
  * @param id - connect id
@@ -1070,6 +1309,7 @@ void mqtt_notify_connect(uint8_t id)
  */
 void mqtt_notify_disconnect(void)
 {
+    g_session = FALSE;
     g_linkid = 0xff;
 }
 
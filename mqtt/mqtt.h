@@ -74,11 +74,14 @@ void mqtt_publish(const char *topic, const char *content, uint8_t dup,
                   uint8_t qos, uint8_t retain);
 void mqtt_puback(uint16_t id);
 void mqtt_pubrec(uint16_t id);
+void mqtt_pubrel(uint16_t id);
 void mqtt_pubcomp(uint16_t id);
 uint8_t mqtt_subscribe(const char *topic, uint8_t qos);
 void mqtt_unsubscribe(const char *topic);
-void mqtt_pingreq(void);
+bool mqtt_pingreq(void);
 void mqtt_disconnect(void);
+uint32_t mqtt_idle_time(void);
+uint32_t mqtt_data_packets(void);
 void mqtt_notify_connect(uint8_t id);
 void mqtt_notify_disconnect(void);
 
@@ -41,6 +41,27 @@ have bit-0 clear, as it is loaded into the PC on exit from an ISR. */
 variable. */
 static UBaseType_t uxCriticalNesting = 0xaaaaaaaa;
 
+#if configUSE_TICKLESS_IDLE == 1
+/* max systick reload value */
+#define portMAX_24_BIT_NUMBER				(0xffffffUL)
+
+/* A fiddle factor to estimate the number of SysTick counts that would have
+occurred while the SysTick counter is stopped during tickless idle
+calculations. */
+#define portMISSED_COUNTS_FACTOR			(45UL)
+
+/* The number of SysTick increments that make up one tick period. */
+static uint32_t ulTimerCountsForOneTick = 0;
+
+/* The maximum number of tick periods that can be suppressed is limited by the
+24 bit resolution of the SysTick timer. */
+static uint32_t xMaximumPossibleSuppressedTicks = 0;
+
+/* Compensate for the CPU cycles that pass while the SysTick is stopped, in
+systick counts (systick runs at AHB / 8). */
+static uint32_t ulStoppedTimerCompensation = 0;
+#endif /* configUSE_TICKLESS_IDLE */
+
 
 /* interface */
 void vPortSetupTimerInterrupt( void );
@@ -173,12 +194,175 @@ void vPortSetupTimerInterrupt( void )
 	/* Configure SysTick to interrupt at the requested rate. */
     SYSTICK_SetClockSource(SYSTICK_CLOCK_AHB_DIV_EIGHT);
     SYSTICK_SetTickInterval(1000 / configTICK_RATE_HZ);
+#if configUSE_TICKLESS_IDLE == 1
+    ulTimerCountsForOneTick = SYSTICK_GetReload() + 1UL;
+    xMaximumPossibleSuppressedTicks = portMAX_24_BIT_NUMBER / 
+                                      ulTimerCountsForOneTick;
+    ulStoppedTimerCompensation = portMISSED_COUNTS_FACTOR / 8;
+#endif
     SYSTICK_EnableInt(TRUE);
     SYSTICK_ClrCountFlag();
     SYSTICK_EnableCounter(TRUE);
 }
 /*-----------------------------------------------------------*/
 
+#if configUSE_TICKLESS_IDLE == 1
+/**
+ * @brief stop tick interrupt and sleep until next task wakeup time or any
+ *        interrupt, then step tick count by the time slept
+ * @param xExpectedIdleTime - expected idle ticks
+ */
+void vPortSuppressTicksAndSleep( TickType_t xExpectedIdleTime )
+{
+    uint32_t ulReloadValue, ulCompleteTickPeriods, ulCompletedSysTickDecrements;
+    TickType_t xModifiableIdleTime;
+    bool counted;
+
+	/* Make sure the SysTick reload value does not overflow the counter. */
+	if( xExpectedIdleTime > xMaximumPossibleSuppressedTicks )
+	{
+		xExpectedIdleTime = xMaximumPossibleSuppressedTicks;
+	}
+
+	/* Stop the SysTick momentarily.  The time the SysTick is stopped for
+	is accounted for as best it can be, but using the tickless mode will
+	inevitably result in some tiny drift of the time maintained by the
+	kernel with respect to calendar time. */
+	SYSTICK_StopCounter();
+
+	/* Calculate the reload value required to wait xExpectedIdleTime
+	tick periods.  -1 is used because this code will execute part way
+	through one of the tick periods. */
+	ulReloadValue = SYSTICK_GetCounter() + 
+                    ( ulTimerCountsForOneTick * ( xExpectedIdleTime - 1UL ) );
+	if( ulReloadValue > ulStoppedTimerCompensation )
+	{
+		ulReloadValue -= ulStoppedTimerCompensation;
+	}
+
+	/* Enter a critical section but don't use the taskENTER_CRITICAL()
+	method as that will mask interrupts that should exit sleep mode. */
+	__set_PRIMASK();
+	__DSB();
+	__ISB();
+
+	/* If a context switch is pending or a task is waiting for the scheduler
+	to be unsuspended then abandon the low power entry. */
+	if( eTaskConfirmSleepModeStatus() == eAbortSleep )
+	{
+		/* Restart from whatever is left in the count register to complete
+		this tick period. */
+		SYSTICK_SetReload( SYSTICK_GetCounter() );
+		SYSTICK_EnableCounter( TRUE );
+
+		/* Reset the reload register to the value required for normal tick
+		periods. */
+		SYSTICK_SetReload( ulTimerCountsForOneTick - 1UL );
+
+		/* Re-enable interrupts. */
+		__reset_PRIMASK();
+	}
+	else
+	{
+		/* Set the new reload value. */
+		SYSTICK_SetReload( ulReloadValue );
+
+		/* Clear the SysTick count flag and set the count value back to
+		zero. */
+		SYSTICK_ClrCounter();
+
+		/* Restart SysTick. */
+		SYSTICK_EnableCounter( TRUE );
+
+		/* Sleep until something happens.  configPRE_SLEEP_PROCESSING() can
+		set its parameter to 0 to indicate that its implementation contains
+		its own wait for interrupt or wait for event instruction, and so wfi
+		should not be executed again. */
+		xModifiableIdleTime = xExpectedIdleTime;
+		configPRE_SLEEP_PROCESSING( xModifiableIdleTime );
+		if( xModifiableIdleTime > 0 )
+		{
+			__DSB();
+			__WFI();
+			__ISB();
+		}
+		configPOST_SLEEP_PROCESSING( xExpectedIdleTime );
+
+		/* Stop SysTick.  Again, the time the SysTick is stopped for is
+		accounted for as best it can be, but using the tickless mode will
+		inevitably result in some tiny drift of the time maintained by the
+		kernel with respect to calendar time. */
+		counted = SYSTICK_StopCounter();
+
+		/* Re-enable interrupts - see comments above __set_PRIMASK()
+		call above. */
+		__reset_PRIMASK();
+
+		if( counted )
+		{
+			uint32_t ulCalculatedLoadValue;
+
+			/* The tick interrupt has already executed, and the SysTick
+			count reloaded with ulReloadValue.  Reset the reload register
+			with whatever remains of this tick period. */
+			ulCalculatedLoadValue = ( ulTimerCountsForOneTick - 1UL ) - 
+                                    ( ulReloadValue - SYSTICK_GetCounter() );
+
+			/* Don't allow a tiny value, or values that have somehow
+			underflowed because the post sleep hook did something
+			that took too long. */
+			if( ( ulCalculatedLoadValue < ulStoppedTimerCompensation ) || 
+                ( ulCalculatedLoadValue > ulTimerCountsForOneTick ) )
+			{
+				ulCalculatedLoadValue = ( ulTimerCountsForOneTick - 1UL );
+			}
+
+			SYSTICK_SetReload( ulCalculatedLoadValue );
+
+			/* The tick interrupt handler will already have pended the tick
+			processing in the kernel.  As the pending tick will be
+			processed as soon as this function exits, the tick value
+			maintained by the tick is stepped forward by one less than the
+			time spent waiting. */
+			ulCompleteTickPeriods = xExpectedIdleTime - 1UL;
+		}
+		else
+		{
+			/* Something other than the tick interrupt ended the sleep.
+			Work out how long the sleep lasted rounded to complete tick
+			periods (not the ulReload value which accounted for part
+			ticks). */
+			ulCompletedSysTickDecrements = ( xExpectedIdleTime * 
+                                             ulTimerCountsForOneTick ) - 
+                                           SYSTICK_GetCounter();
+
+			/* How many complete tick periods passed while the processor
+			was waiting? */
+			ulCompleteTickPeriods = ulCompletedSysTickDecrements / 
+                                    ulTimerCountsForOneTick;
+
+			/* The reload value is set to whatever fraction of a single tick
+			period remains. */
+			SYSTICK_SetReload( ( ( ulCompleteTickPeriods + 1UL ) * 
+                                 ulTimerCountsForOneTick ) - 
+                               ulCompletedSysTickDecrements );
+		}
+
+		/* Restart SysTick so it runs from reload register again, then set
+		reload register back to its standard value. */
+		SYSTICK_ClrCounter();
+		portENTER_CRITICAL();
+		{
+			SYSTICK_EnableCounter( TRUE );
+			vTaskStepTick( ulCompleteTickPeriods );
+			SYSTICK_SetReload( ulTimerCountsForOneTick - 1UL );
+		}
+		portEXIT_CRITICAL();
+	}
+}
+/*-----------------------------------------------------------*/
+#endif /* configUSE_TICKLESS_IDLE */
+
 #if (configASSERT_DEFINED == 1)
 /**
  * @brief validate current running exception priority  
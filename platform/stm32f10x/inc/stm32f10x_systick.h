@@ -24,6 +24,11 @@ void SYSTICK_EnableCounter(bool flag);
 bool SYSTICK_IsCountFlagSet(void);
 void SYSTICK_ClrCountFlag(void);
 void SYSTICK_SetTickInterval(uint32_t time);
+uint32_t SYSTICK_GetReload(void);
+void SYSTICK_SetReload(uint32_t reload);
+uint32_t SYSTICK_GetCounter(void);
+void SYSTICK_ClrCounter(void);
+bool SYSTICK_StopCounter(void);
 
 
 #endif /* _STM32F10X_SYSTICK_H_ */
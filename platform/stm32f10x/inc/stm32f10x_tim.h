@@ -0,0 +1,53 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _STM32F10X_TIM_H_
+  #define _STM32F10X_TIM_H_
+
+#include "types.h"
+
+/* general purpose timer group definition */
+typedef enum
+{
+    TIM2,
+    TIM3,
+    TIM4,
+    TIM_Count,
+}TIM_Group;
+
+/* timer flags */
+#define TIM_FLAG_UPDATE          (1 << 0)
+#define TIM_FLAG_CC1             (1 << 1)
+#define TIM_FLAG_CC2             (1 << 2)
+#define TIM_FLAG_CC3             (1 << 3)
+#define TIM_FLAG_CC4             (1 << 4)
+#define IS_TIM_FLAG(FLAG) ((FLAG == TIM_FLAG_UPDATE) || \
+                           (FLAG == TIM_FLAG_CC1) || \
+                           (FLAG == TIM_FLAG_CC2) || \
+                           (FLAG == TIM_FLAG_CC3) || \
+                           (FLAG == TIM_FLAG_CC4))
+
+/* timer interrupt definition */
+#define TIM_IT_UPDATE            (1 << 0)
+#define TIM_IT_CC1               (1 << 1)
+#define TIM_IT_CC2               (1 << 2)
+#define TIM_IT_CC3               (1 << 3)
+#define TIM_IT_CC4               (1 << 4)
+
+/* interface */
+uint32_t TIM_GetClock(TIM_Group group);
+void TIM_Setup(TIM_Group group, uint16_t prescaler, uint16_t period);
+void TIM_Enable(TIM_Group group, bool flag);
+uint16_t TIM_GetCounter(TIM_Group group);
+void TIM_SetCounter(TIM_Group group, uint16_t counter);
+void TIM_SetCompare(TIM_Group group, uint8_t channel, uint16_t value);
+void TIM_EnableInt(TIM_Group group, uint16_t intFlag, bool flag);
+bool TIM_IsFlagOn(TIM_Group group, uint16_t flag);
+void TIM_ClearFlag(TIM_Group group, uint16_t flag);
+
+#endif /* _STM32F10X_TIM_H_ */
+
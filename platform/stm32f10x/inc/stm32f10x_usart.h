@@ -178,6 +178,8 @@ void USART_ClearFlag(USART_Group group, uint16_t intFlag);
 void USART_WriteData_Wait(USART_Group group, uint8_t data);
 void USART_WriteData(USART_Group group, uint8_t data);
 uint8_t USART_ReadData(USART_Group group);
+uint16_t USART_GetStatus(USART_Group group);
+uint32_t USART_GetBaudrate(USART_Group group);
 void USART_SetWakeupMethod(USART_Group group, uint16_t method);
 void USART_EnableInt(USART_Group group, uint8_t intFlag, 
                      bool flag);
@@ -103,3 +103,54 @@ void SYSTICK_SetTickInterval(uint32_t time)
     
     SYSTICK->LOAD = ((tickClock / 1000 * time) & 0xffffff);
 }
+
+/**
+ * @brief get systick reload value
+ * @return reload value
+ */
+uint32_t SYSTICK_GetReload(void)
+{
+    return SYSTICK->LOAD;
+}
+
+/**
+ * @brief set systick reload value
+ * @param reload value, 24 bits
+ */
+void SYSTICK_SetReload(uint32_t reload)
+{
+    assert_param(reload <= 0xffffff);
+    SYSTICK->LOAD = reload;
+}
+
+/**
+ * @brief get systick current counter value
+ * @return counter value
+ */
+uint32_t SYSTICK_GetCounter(void)
+{
+    return SYSTICK->VAL;
+}
+
+/**
+ * @brief clear systick counter, counter reloads on next clock
+ */
+void SYSTICK_ClrCounter(void)
+{
+    SYSTICK->VAL = 0;
+}
+
+/**
+ * @brief stop systick counter
+ * @return count flag before stop, reading control register clears it, so
+ *         flag is sampled in the same access that stops the counter
+ */
+bool SYSTICK_StopCounter(void)
+{
+    uint32_t ctrl = SYSTICK->CTRL;
+    SYSTICK->CTRL = (ctrl & ~(CTRL_ENABLE | CTRL_COUNTFLAG));
+    if(ctrl & CTRL_COUNTFLAG)
+        return TRUE;
+    
+    return FALSE;
+}
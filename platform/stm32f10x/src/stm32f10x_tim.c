@@ -0,0 +1,191 @@
+/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "stm32f10x_tim.h"
+#include "stm32f10x_map.h"
+#include "stm32f10x_rcc.h"
+#include "stm32f10x_cfg.h"
+
+
+/* timer register structure */
+typedef struct 
+{
+    volatile uint16_t CR1;
+    uint16_t RESERVED0;
+    volatile uint16_t CR2;
+    uint16_t RESERVED1;
+    volatile uint16_t SMCR;
+    uint16_t RESERVED2;
+    volatile uint16_t DIER;
+    uint16_t RESERVED3;
+    volatile uint16_t SR;
+    uint16_t RESERVED4;
+    volatile uint16_t EGR;
+    uint16_t RESERVED5;
+    volatile uint16_t CCMR1;
+    uint16_t RESERVED6;
+    volatile uint16_t CCMR2;
+    uint16_t RESERVED7;
+    volatile uint16_t CCER;
+    uint16_t RESERVED8;
+    volatile uint16_t CNT;
+    uint16_t RESERVED9;
+    volatile uint16_t PSC;
+    uint16_t RESERVED10;
+    volatile uint16_t ARR;
+    uint16_t RESERVED11;
+    uint32_t RESERVED12;
+    volatile uint16_t CCR[4][2];
+}TIM_T;
+
+/* timer definition */
+#define CEN              (1 << 0)
+#define URS              (1 << 2)
+#define DIR              (1 << 4)
+#define UG               (1 << 0)
+
+/* timer group array */
+static TIM_T * const TIMx[] = {(TIM_T *)TIM2_BASE, 
+                               (TIM_T *)TIM3_BASE,
+                               (TIM_T *)TIM4_BASE};
+
+/**
+ * @brief get timer input clock
+ * @param group: timer group
+ * @return timer clock, twice PCLK1 if APB1 is prescaled
+ */
+uint32_t TIM_GetClock(TIM_Group group)
+{
+    assert_param(group < TIM_Count);
+    uint32_t pclk = RCC_GetPCLK1();
+    if (pclk != RCC_GetHCLK())
+    {
+        pclk *= 2;
+    }
+
+    return pclk;
+}
+
+/**
+ * @brief setup timer as up counter
+ * @param group: timer group
+ * @param prescaler: clock prescaler, counter clock is clock / (prescaler + 1)
+ * @param period: auto reload value
+ */
+void TIM_Setup(TIM_Group group, uint16_t prescaler, uint16_t period)
+{
+    assert_param(group < TIM_Count);
+    
+    TIM_T * const TimX = TIMx[group];
+    TimX->CR1 &= ~(CEN | DIR);
+    TimX->CR1 |= URS;
+    TimX->PSC = prescaler;
+    TimX->ARR = period;
+    TimX->CNT = 0;
+    /* load prescaler now */
+    TimX->EGR = UG;
+    TimX->SR = 0;
+}
+
+/**
+ * @brief enable or disable timer counter
+ * @param group: timer group
+ * @param flag: TRUE: enable FALSE:disable
+ */
+void TIM_Enable(TIM_Group group, bool flag)
+{
+    assert_param(group < TIM_Count);
+    
+    TIM_T * const TimX = TIMx[group];
+    if(flag)
+        TimX->CR1 |= CEN;
+    else
+        TimX->CR1 &= ~CEN;
+}
+
+/**
+ * @brief get timer counter value
+ * @param group: timer group
+ * @return counter value
+ */
+uint16_t TIM_GetCounter(TIM_Group group)
+{
+    assert_param(group < TIM_Count);
+
+    return TIMx[group]->CNT;
+}
+
+/**
+ * @brief set timer counter value
+ * @param group: timer group
+ * @param counter: counter value
+ */
+void TIM_SetCounter(TIM_Group group, uint16_t counter)
+{
+    assert_param(group < TIM_Count);
+
+    TIMx[group]->CNT = counter;
+}
+
+/**
+ * @brief set capture/compare register value
+ * @param group: timer group
+ * @param channel: channel number(1-4)
+ * @param value: compare value
+ */
+void TIM_SetCompare(TIM_Group group, uint8_t channel, uint16_t value)
+{
+    assert_param(group < TIM_Count);
+    assert_param((channel >= 1) && (channel <= 4));
+
+    TIMx[group]->CCR[channel - 1][0] = value;
+}
+
+/**
+ * @brief enable or disable timer interrupt
+ * @param group: timer group
+ * @param intFlag: interrupt flag
+ * @param flag: TRUE: enable FALSE:disable
+ */
+void TIM_EnableInt(TIM_Group group, uint16_t intFlag, bool flag)
+{
+    assert_param(group < TIM_Count);
+    
+    TIM_T * const TimX = TIMx[group];
+    if(flag)
+        TimX->DIER |= intFlag;
+    else
+        TimX->DIER &= ~intFlag;
+}
+
+/**
+ * @brief check timer flag status
+ * @param group: timer group
+ * @param flag: flag to check
+ * @return TRUE: flag is set FALSE: flag is not set
+ */
+bool TIM_IsFlagOn(TIM_Group group, uint16_t flag)
+{
+    assert_param(group < TIM_Count);
+    assert_param(IS_TIM_FLAG(flag));
+
+    return (0 != (TIMx[group]->SR & flag));
+}
+
+/**
+ * @brief clear timer flag
+ * @param group: timer group
+ * @param flag: flag to clear
+ */
+void TIM_ClearFlag(TIM_Group group, uint16_t flag)
+{
+    assert_param(group < TIM_Count);
+
+    /* status bits are cleared by writing 0, writing 1 has no effect */
+    TIMx[group]->SR = (uint16_t)~flag;
+}
+
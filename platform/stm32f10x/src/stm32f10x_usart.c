@@ -137,6 +137,12 @@ void USART_Setup(USART_Group group, const USART_Config *config)
     divFraction = (uint8_t)((divVal - divMantissa * 16));
     if(((divVal - divMantissa * 16) - divFraction) >= 0.5)
         divFraction += 1;
+    if(divFraction > 15)
+    {
+        /* fraction rounded up, carry to mantissa */
+        divFraction = 0;
+        divMantissa += 1;
+    }
     
     UsartX->BRR = (divMantissa << 4) + divFraction;
     
@@ -296,6 +302,42 @@ uint8_t USART_ReadData(USART_Group group)
     return UsartX->DR;
 }
 
+/**
+ * @brief get usart status register, reading status then data register 
+ *        clears error flags
+ * @param group: usart group
+ * @return status register value
+ */
+uint16_t USART_GetStatus(USART_Group group)
+{
+    assert_param(group < UASRT_Count);
+
+    return USARTx[group]->SR;
+}
+
+/**
+ * @brief get actual baudrate generated from peripheral clock
+ * @param group: usart group
+ * @return baudrate
+ */
+uint32_t USART_GetBaudrate(USART_Group group)
+{
+    assert_param(group < UASRT_Count);
+
+    USART_T * const UsartX = USARTx[group];
+    uint32_t pclk = 0;
+    if(group == USART1)
+        pclk = RCC_GetPCLK2();
+    else
+        pclk = RCC_GetPCLK1();
+
+    if(0 == UsartX->BRR)
+        return 0;
+    
+    /* BRR holds 16 times of usart divider */
+    return pclk / UsartX->BRR;
+}
+
 /**
  * @param set usart wakeup mode
  * @param group: usart group
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+# This file is part of the vendoring machine project.
+#
+# Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+#
+# See the COPYING file for the terms of usage and distribution.
+#
+"""embed provisioning portal pages into firmware
+
+Every page is converted to utf-8, gzip compressed and written as a const
+array to board/http_assets.c, together with its url, content type and an
+ETag made from the compressed data. The http server sends the arrays as
+they are with Content-Encoding: gzip, so pages cost flash only once and
+no compression runs on the device.
+
+Run it again whenever a page changes, the output is reproducible:
+
+    mkassets.py --encoding gbk /=setting.html -o board/http_assets.c
+"""
+
+import argparse
+import gzip
+import mimetypes
+import os
+import zlib
+
+HEADER = '''/**
+* This file is part of the vendoring machine project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+/* generated by tools/mkassets.py, do not edit */
+#include "http_assets.h"
+'''
+
+
+def content_type(path):
+    """content type of page, text is always sent as utf-8"""
+    ctype = mimetypes.guess_type(path)[0] or 'application/octet-stream'
+    if ctype.startswith('text/'):
+        ctype += '; charset=utf-8'
+    return ctype
+
+
+def load(path, encoding):
+    """read page and convert text to utf-8"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if content_type(path).startswith('text/'):
+        data = data.decode(encoding).encode('utf-8')
+    return data
+
+
+def c_array(name, data):
+    """format bytes as c array"""
+    lines = ['static const uint8_t %s[%d] =' % (name, len(data)), '{']
+    for i in range(0, len(data), 12):
+        lines.append('    ' + ', '.join('0x%02x' % b for b in data[i:i + 12])
+                     + ',')
+    lines.append('};')
+    return '\n'.join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='embed gzip compressed portal pages')
+    parser.add_argument('assets', nargs='+', metavar='URL=FILE',
+                        help='url and page file')
+    parser.add_argument('--encoding', default='utf-8',
+                        help='source encoding of text pages')
+    parser.add_argument('-o', '--output', default='board/http_assets.c',
+                        help='output c file')
+    args = parser.parse_args()
+
+    arrays = []
+    entries = []
+    for i, spec in enumerate(args.assets):
+        url, path = spec.split('=', 1)
+        raw = load(path, args.encoding)
+        data = gzip.compress(raw, 9, mtime=0)
+        name = 'asset_%d' % i
+        etag = '\\"%08x\\"' % zlib.crc32(data)
+        arrays.append('/* %s, %d bytes */\n%s'
+                      % (os.path.basename(path), len(raw),
+                         c_array(name, data)))
+        entries.append('    {"%s", "%s", "%s", %s, sizeof(%s)},'
+                       % (url, content_type(path), etag, name, name))
+        print('%-12s %-16s %5d -> %5d bytes' % (url, path, len(raw),
+                                                 len(data)))
+
+    with open(args.output, 'w', newline='\n') as f:
+        f.write(HEADER + '\n')
+        f.write('\n\n'.join(arrays) + '\n\n')
+        f.write('const http_asset http_assets[] =\n{\n')
+        f.write('\n'.join(entries) + '\n')
+        f.write('    {NULL, NULL, NULL, NULL, 0},\n};\n')
+
+
+if __name__ == '__main__':
+    main()
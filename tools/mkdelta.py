@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+#
+# This file is part of the vendoring machine project.
+#
+# Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+#
+# See the COPYING file for the terms of usage and distribution.
+#
+"""make delta patch between two application images
+
+The device stages only the patch and the bootloader rebuilds the application
+area in place, one page per segment (see board/delta.h). Integers are little
+endian:
+
+    header:  "VMD2" | old size u32 | old crc u32 | new size u32 | new crc u32
+             | pages u16 | reserved u16
+    segment: page u16 | page crc u32 | length u16 | commands
+    command: 0x01 | source offset u32 | length u16 - copy from application
+             0x02 | length u16 | data - literal data
+
+A copy never reads a page rebuilt by an earlier segment, pages are rebuilt
+in ascending or descending order, whichever gives the smaller patch. crc is
+CRC-32/MPEG-2, same as the hardware crc unit. The old image must be exactly
+what is running, the device rejects the patch otherwise, and the patch must
+fit the staging area.
+
+usage:
+    mkdelta.py old.bin new.bin patch.bin
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b'VMD2'
+CMD_COPY = 0x01
+CMD_DATA = 0x02
+
+# shortest match worth a copy command, same size as its encoding
+BLOCK = 8
+# see board/flash_map.h
+PAGE_SIZE = 0x400
+APP_SIZE = 0xa800
+STAGING_SIZE = 0x2400
+
+
+def crc32_mpeg2(data):
+    """CRC-32/MPEG-2, poly 0x04c11db7, init 0xffffffff, no reflection"""
+    crc = 0xffffffff
+    for byte in data:
+        crc ^= byte << 24
+        for _ in range(8):
+            if crc & 0x80000000:
+                crc = ((crc << 1) ^ 0x04c11db7) & 0xffffffff
+            else:
+                crc = (crc << 1) & 0xffffffff
+    return crc
+
+
+def index_blocks(old):
+    """map every BLOCK bytes of old image to its offsets"""
+    index = {}
+    for offset in range(len(old) - BLOCK + 1):
+        index.setdefault(old[offset:offset + BLOCK], []).append(offset)
+    return index
+
+
+def readable(rewritten, src, length):
+    """bytes of old image still present when a page is rebuilt"""
+    end = src
+    while end < src + length and end // PAGE_SIZE not in rewritten:
+        end = (end // PAGE_SIZE + 1) * PAGE_SIZE
+    return min(end, src + length) - src
+
+
+def longest_match(old, new, pos, end, candidates, rewritten):
+    """find longest run of new[pos:end] inside readable old image, prefer
+    same offset"""
+    best_src = 0
+    best_len = 0
+    for src in sorted(candidates, key=lambda x: abs(x - pos))[:32]:
+        limit = readable(rewritten, src, min(len(old) - src, end - pos))
+        if limit < BLOCK:
+            continue
+        length = BLOCK
+        while length < limit and old[src + length] == new[pos + length]:
+            length += 1
+        if length > best_len:
+            best_src, best_len = src, length
+    return best_src, best_len
+
+
+def diff_page(old, new, start, end, index, rewritten):
+    """greedy diff of one page, returns list of ('copy', src, len) /
+    ('data', bytes)"""
+    commands = []
+    literal = bytearray()
+    pos = start
+    while pos < end:
+        length = 0
+        if pos + BLOCK <= end:
+            candidates = index.get(new[pos:pos + BLOCK])
+            if candidates:
+                src, length = longest_match(old, new, pos, end, candidates,
+                                            rewritten)
+        if length:
+            if literal:
+                commands.append(('data', bytes(literal)))
+                literal = bytearray()
+            commands.append(('copy', src, length))
+            pos += length
+        else:
+            literal.append(new[pos])
+            pos += 1
+    if literal:
+        commands.append(('data', bytes(literal)))
+    return commands
+
+
+def diff(old, new, order):
+    """diff every page in rebuild order, returns list of (page, commands)"""
+    index = index_blocks(old)
+    rewritten = set()
+    segments = []
+    for page in order:
+        start = page * PAGE_SIZE
+        end = min(start + PAGE_SIZE, len(new))
+        segments.append((page, diff_page(old, new, start, end, index,
+                                         rewritten)))
+        rewritten.add(page)
+    return segments
+
+
+def encode(old, new, segments):
+    """encode header and segments, page is short enough for u16 lengths"""
+    out = bytearray(MAGIC)
+    out += struct.pack('<IIIIHH', len(old), crc32_mpeg2(old),
+                       len(new), crc32_mpeg2(new), len(segments), 0)
+    for page, commands in segments:
+        body = bytearray()
+        for cmd in commands:
+            if cmd[0] == 'copy':
+                body += struct.pack('<BIH', CMD_COPY, cmd[1], cmd[2])
+            else:
+                body += struct.pack('<BH', CMD_DATA, len(cmd[1])) + cmd[1]
+        start = page * PAGE_SIZE
+        crc = crc32_mpeg2(new[start:start + PAGE_SIZE])
+        out += struct.pack('<HIH', page, crc, len(body)) + body
+    return bytes(out)
+
+
+def apply(old, patch):
+    """apply patch in place like the bootloader does, used to check the
+    result"""
+    if patch[:4] != MAGIC:
+        raise ValueError('bad magic')
+    old_size, old_crc, new_size, new_crc, pages, _ = struct.unpack_from(
+        '<IIIIHH', patch, 4)
+    if old_size != len(old) or old_crc != crc32_mpeg2(old):
+        raise ValueError('patch is not made for old image')
+    if new_size > APP_SIZE or pages != (new_size + PAGE_SIZE - 1) // PAGE_SIZE:
+        raise ValueError('bad new image size')
+    flash = bytearray(old) + b'\xff' * (APP_SIZE - len(old))
+    rewritten = set()
+    pos = 24
+    for _ in range(pages):
+        page, crc, length = struct.unpack_from('<HIH', patch, pos)
+        pos += 8
+        end = pos + length
+        if page >= pages or page in rewritten or end > len(patch):
+            raise ValueError('bad segment at %d' % (pos - 8))
+        data = bytearray()
+        while pos < end:
+            cmd = patch[pos]
+            if cmd == CMD_COPY:
+                src, size = struct.unpack_from('<IH', patch, pos + 1)
+                if src + size > old_size or \
+                        readable(rewritten, src, size) != size:
+                    raise ValueError('bad copy source at %d' % pos)
+                data += flash[src:src + size]
+                pos += 7
+            elif cmd == CMD_DATA:
+                size, = struct.unpack_from('<H', patch, pos + 1)
+                data += patch[pos + 3:pos + 3 + size]
+                pos += 3 + size
+            else:
+                raise ValueError('bad command 0x%02x at %d' % (cmd, pos))
+        start = page * PAGE_SIZE
+        if len(data) != min(PAGE_SIZE, new_size - start) or \
+                crc32_mpeg2(data) != crc:
+            raise ValueError('page %d does not match' % page)
+        flash[start:start + len(data)] = data
+        rewritten.add(page)
+    if pos != len(patch) or crc32_mpeg2(flash[:new_size]) != new_crc:
+        raise ValueError('result does not match new image')
+    return bytes(flash[:new_size])
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='make vending machine delta firmware patch')
+    parser.add_argument('old', help='running application image (.bin)')
+    parser.add_argument('new', help='new application image (.bin)')
+    parser.add_argument('patch', help='output patch file')
+    args = parser.parse_args()
+
+    with open(args.old, 'rb') as f:
+        old = f.read()
+    with open(args.new, 'rb') as f:
+        new = f.read()
+
+    if len(old) > APP_SIZE or not 0 < len(new) <= APP_SIZE:
+        sys.exit('image does not fit application area (%d bytes)' % APP_SIZE)
+
+    pages = (len(new) + PAGE_SIZE - 1) // PAGE_SIZE
+    patch = None
+    for order in (range(pages), range(pages - 1, -1, -1)):
+        segments = diff(old, new, order)
+        candidate = encode(old, new, segments)
+        if patch is None or len(candidate) < len(patch):
+            patch = candidate
+            best = segments
+    try:
+        apply(old, patch)
+    except ValueError as e:
+        sys.exit('patch check failed: %s' % e)
+
+    commands = [cmd for _, page in best for cmd in page]
+    copied = sum(cmd[2] for cmd in commands if cmd[0] == 'copy')
+    print('old %d bytes, new %d bytes, crc 0x%08x'
+          % (len(old), len(new), crc32_mpeg2(new)))
+    print('copied %d bytes, literal %d bytes, %d commands, %s order'
+          % (copied, len(new) - copied, len(commands),
+             'ascending' if best[0][0] == 0 else 'descending'))
+    print('patch %d bytes (%.1f%% of new image)'
+          % (len(patch), 100.0 * len(patch) / len(new)))
+    if len(patch) > STAGING_SIZE:
+        sys.exit('patch does not fit staging area (%d bytes), '
+                 'flash the image with the debug port' % STAGING_SIZE)
+
+    with open(args.patch, 'wb') as f:
+        f.write(patch)
+
+
+if __name__ == '__main__':
+    main()
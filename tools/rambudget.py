@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+#
+# This file is part of the vendoring machine project.
+#
+# Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+#
+# See the COPYING file for the terms of usage and distribution.
+#
+"""report ram budget from iar linker map file
+
+All kernel objects, stacks and pools are statically allocated, so the ram
+used by the firmware is known at link time. This reads the map file written
+by ilink (Debug/List/VendoringMachine.map) and prints
+
+    - total readwrite memory against the device ram size
+    - readwrite data per module
+    - largest ram symbols (task stacks, queue storage, pools...)
+
+usage:
+    rambudget.py Debug/List/VendoringMachine.map
+    rambudget.py VendoringMachine.map --top 30 --limit 19456
+"""
+
+import argparse
+import re
+import sys
+
+RAM_BASE = 0x20000000
+RAM_SIZE = 20 * 1024
+
+
+def parse_number(text):
+    """parse iar number, decimal with space group separator or hex"""
+    text = text.strip().replace("'", '')
+    if not text:
+        return 0
+    if text.lower().startswith('0x'):
+        return int(text, 16)
+    return int(text.replace(' ', ''))
+
+
+def section(lines, title):
+    """lines of map file section started with '*** title'"""
+    out = []
+    inside = False
+    for line in lines:
+        if line.startswith('***'):
+            if inside and line.strip('* \n'):
+                break
+            if title in line:
+                inside = True
+            continue
+        if inside:
+            out.append(line.rstrip('\n'))
+    return out
+
+
+def module_summary(lines):
+    """rw data per module from MODULE SUMMARY"""
+    modules = []
+    columns = None
+    for line in section(lines, 'MODULE SUMMARY'):
+        if 'ro code' in line and 'rw data' in line:
+            columns = [m.end() for m in re.finditer(r'ro code|ro data|rw data',
+                                                    line)]
+            continue
+        if columns is None or not line.startswith('    ') or \
+                line.strip().startswith('-'):
+            continue
+        m = re.match(r'\s+(\S.*?\S)(\s{2,}.*)?$', line)
+        if not m or m.group(2) is None:
+            continue
+        name = m.group(1)
+        if 'Total' in name:
+            continue
+        values = [0] * len(columns)
+        # numbers are right aligned to the column header
+        for num in re.finditer(r'\d{1,3}(?: \d{3})*(?!\d)', m.group(2)):
+            end = m.start(2) + num.end()
+            col = min(range(len(columns)),
+                      key=lambda i: abs(columns[i] - end))
+            values[col] = parse_number(num.group(0))
+        modules.append((name, values[0], values[1], values[2]))
+    return modules
+
+
+def ram_symbols(lines):
+    """symbols located in ram from ENTRY LIST"""
+    symbols = []
+    entry = re.compile(r"^\s*(\S+)\s+(0x[0-9a-fA-F']+)\s+(0x[0-9a-fA-F']+|\d+)"
+                       r"\s+Data\s+\S+\s+(.*)$")
+    pending = None
+    for line in section(lines, 'ENTRY LIST'):
+        # long names are printed on their own line
+        if pending is not None:
+            line = pending + ' ' + line
+            pending = None
+        elif re.match(r'^\S+\s*$', line):
+            pending = line.strip()
+            continue
+        m = entry.match(line)
+        if not m:
+            continue
+        addr = parse_number(m.group(2))
+        if RAM_BASE <= addr < RAM_BASE + 0x100000:
+            symbols.append((m.group(1), addr, parse_number(m.group(3)),
+                            m.group(4).strip()))
+    return symbols
+
+
+def memory_totals(lines):
+    """totals from the end of map file"""
+    totals = {}
+    for line in lines:
+        m = re.match(r'^\s*([\d ]+) bytes of (readonly|readwrite)\s+'
+                     r'(code|data) memory', line)
+        if m:
+            totals[m.group(2) + ' ' + m.group(3)] = parse_number(m.group(1))
+    return totals
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='report ram budget from iar linker map file')
+    parser.add_argument('map', help='ilink map file')
+    parser.add_argument('--ram', type=int, default=RAM_SIZE,
+                        help='device ram size in bytes (default %(default)s)')
+    parser.add_argument('--top', type=int, default=20,
+                        help='number of largest ram symbols to list')
+    parser.add_argument('--limit', type=int,
+                        help='fail if readwrite memory exceeds LIMIT bytes')
+    args = parser.parse_args()
+
+    with open(args.map, 'r', errors='replace') as f:
+        lines = f.readlines()
+
+    totals = memory_totals(lines)
+    used = totals.get('readwrite data')
+    modules = module_summary(lines)
+    symbols = ram_symbols(lines)
+    if used is None:
+        used = sum(m[3] for m in modules)
+
+    print('ram budget')
+    print('  used  %6d bytes' % used)
+    print('  free  %6d bytes' % (args.ram - used))
+    print('  total %6d bytes (%d%% used)' % (args.ram, used * 100 // args.ram))
+    for key in ('readonly code', 'readonly data'):
+        if key in totals:
+            print('  %s %d bytes' % (key, totals[key]))
+
+    print('\nreadwrite data by module')
+    for name, _, _, rw in sorted(modules, key=lambda m: -m[3]):
+        if rw:
+            print('  %-32s %6d' % (name, rw))
+
+    print('\nlargest ram symbols')
+    for name, addr, size, obj in sorted(symbols,
+                                        key=lambda s: -s[2])[:args.top]:
+        print('  %-32s 0x%08x %6d  %s' % (name, addr, size, obj))
+
+    if args.limit is not None and used > args.limit:
+        sys.stderr.write('ram budget exceeded: %d > %d bytes\n' %
+                         (used, args.limit))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+#
+# This file is part of the vendoring machine project.
+#
+# Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+#
+# See the COPYING file for the terms of usage and distribution.
+#
+"""decode binary trace captured from the debug serial port
+
+Firmware built with __ENABLE_TRACE and __BINARY_TRACE sends records
+
+    0xa5 | type | len | payload[len] | xor(type, len, payload)
+
+type 0x01 (message): tick u32, task u32, module u32, fmt u32, arguments
+type 0x02 (task):    task u32, task name
+
+module and fmt are flash addresses of the string literals, they are looked
+up in the firmware elf (.out) so the capture can be decoded offline. Bytes
+outside valid records (assert output, raw dumps) are kept as text lines.
+
+usage:
+    tracedec.py firmware.out capture.bin
+    tracedec.py firmware.out capture.bin --chrome trace.json \\
+        --span mqtt "send: AT\\+CIPSEND" "SEND OK"
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+SYNC = 0xa5
+TYPE_MSG = 0x01
+TYPE_TASK = 0x02
+
+
+class Elf(object):
+    """minimal elf32 little endian reader, only loadable sections"""
+
+    SHF_ALLOC = 0x02
+    SHT_NOBITS = 8
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 1:
+            raise ValueError('%s is not an elf32 file' % path)
+        shoff, = struct.unpack_from('<I', self.data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.data, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            (name, stype, flags, addr, offset,
+             size) = struct.unpack_from('<IIIIII', self.data,
+                                        shoff + i * shentsize)
+            if (flags & self.SHF_ALLOC) and stype != self.SHT_NOBITS:
+                self.sections.append((addr, size, offset))
+
+    def string(self, addr):
+        """read zero terminated string at target address"""
+        for base, size, offset in self.sections:
+            if base <= addr < base + size:
+                start = offset + addr - base
+                end = self.data.index(b'\0', start, offset + size)
+                return self.data[start:end].decode('latin-1')
+        return None
+
+
+class Event(object):
+    def __init__(self, tick, task, module, text):
+        self.tick = tick
+        self.task = task
+        self.module = module
+        self.text = text
+
+
+def format_args(fmt, args):
+    """render printf format with raw record arguments"""
+    out = []
+    pos = 0
+    spec = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(l|h|hh|ll)?([diuxXcsp%])')
+    for m in spec.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        conv = m.group(3)
+        if conv == '%':
+            out.append('%')
+            continue
+        if conv == 's':
+            end = args.find(b'\0')
+            if end < 0:
+                end = len(args)
+            out.append(args[:end].decode('latin-1'))
+            args = args[end + 1:]
+            continue
+        if len(args) < 4:
+            out.append('<?>')
+            continue
+        val, = struct.unpack_from('<I', args)
+        args = args[4:]
+        if conv in 'di':
+            val = struct.unpack('<i', struct.pack('<I', val))[0]
+        elif conv == 'c':
+            out.append(chr(val & 0xff))
+            continue
+        elif conv == 'p':
+            conv = 'x'
+        out.append(('%' + m.group(1) + conv) % val)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode(elf, data):
+    """split capture into events, task names and raw text"""
+    events = []
+    tasks = {}
+    raw = bytearray()
+    last_tick = 0
+    i = 0
+
+    def flush_raw():
+        text = raw.decode('latin-1').strip()
+        if text:
+            for line in text.splitlines():
+                events.append(Event(last_tick, None, '[raw]', line))
+        del raw[:]
+
+    while i < len(data):
+        if data[i] == SYNC and i + 3 <= len(data):
+            rtype, length = data[i + 1], data[i + 2]
+            end = i + 3 + length
+            if rtype in (TYPE_MSG, TYPE_TASK) and end < len(data):
+                payload = data[i + 3:end]
+                csum = rtype ^ length
+                for b in payload:
+                    csum ^= b
+                if csum == data[end]:
+                    flush_raw()
+                    if rtype == TYPE_TASK and length >= 4:
+                        task, = struct.unpack_from('<I', payload)
+                        tasks[task] = payload[4:].decode('latin-1')
+                    elif rtype == TYPE_MSG and length >= 16:
+                        tick, task, module, fmt = struct.unpack_from(
+                            '<IIII', payload)
+                        module_str = elf.string(module) or '[0x%08x]' % module
+                        fmt_str = elf.string(fmt)
+                        if fmt_str is None:
+                            text = '<unknown format 0x%08x>' % fmt
+                        else:
+                            text = format_args(fmt_str, payload[16:])
+                        events.append(Event(tick, task, module_str,
+                                            text.rstrip('\r\n')))
+                        last_tick = tick
+                    i = end + 1
+                    continue
+        raw.append(data[i])
+        i += 1
+    flush_raw()
+    return events, tasks
+
+
+def task_name(tasks, task):
+    if task is None:
+        return '-'
+    return tasks.get(task, '0x%08x' % task)
+
+
+def print_timeline(events, tasks, out):
+    for ev in events:
+        out.write('%10.3f %-16s %-10s %s\n' % (ev.tick / 1000.0,
+                                              task_name(tasks, ev.task),
+                                              ev.module, ev.text))
+
+
+def chrome_trace(events, tasks, spans):
+    """build chrome trace-event json (chrome://tracing, perfetto)"""
+    trace = []
+    tids = {}
+
+    def tid_of(task):
+        if task not in tids:
+            tids[task] = len(tids) + 1
+            trace.append({'name': 'thread_name', 'ph': 'M', 'pid': 1,
+                          'tid': tids[task],
+                          'args': {'name': task_name(tasks, task)}})
+        return tids[task]
+
+    trace.append({'name': 'process_name', 'ph': 'M', 'pid': 1,
+                  'args': {'name': 'vending machine'}})
+    for ev in events:
+        trace.append({'name': ev.text, 'cat': ev.module.strip('[]'),
+                      'ph': 'i', 's': 't', 'ts': ev.tick * 1000,
+                      'pid': 1, 'tid': tid_of(ev.task)})
+
+    # spans match a start and an end message, e.g. mqtt round trips
+    for name, start, end in spans:
+        start_re = re.compile(start)
+        end_re = re.compile(end)
+        begin = None
+        for ev in events:
+            if begin is None and start_re.search(ev.text):
+                begin = ev
+            elif begin is not None and end_re.search(ev.text):
+                trace.append({'name': name, 'cat': 'span', 'ph': 'X',
+                              'ts': begin.tick * 1000,
+                              'dur': (ev.tick - begin.tick) * 1000,
+                              'pid': 1, 'tid': tid_of(begin.task),
+                              'args': {'start': begin.text,
+                                       'end': ev.text}})
+                begin = None
+    return {'traceEvents': trace, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='decode vending machine binary trace capture')
+    parser.add_argument('elf', help='firmware elf file (.out)')
+    parser.add_argument('capture', help='raw debug serial capture')
+    parser.add_argument('--chrome', metavar='JSON',
+                        help='write chrome trace-event json')
+    parser.add_argument('--span', nargs=3, action='append', default=[],
+                        metavar=('NAME', 'START', 'END'),
+                        help='add duration events between messages '
+                             'matching START and END regex')
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    with open(args.capture, 'rb') as f:
+        data = f.read()
+    events, tasks = decode(elf, data)
+    print_timeline(events, tasks, sys.stdout)
+
+    if args.chrome:
+        with open(args.chrome, 'w') as f:
+            json.dump(chrome_trace(events, tasks, args.span), f, indent=1)
+
+
+if __name__ == '__main__':
+    main()